@@ -0,0 +1,333 @@
+/* Throughput and latency benchmark for the remote sqlite3 client
+ *
+ * Runs on the linux target against sqlite/mock_arrestdb.py (or a real ArrestDB):
+ *   python3 ../sqlite/mock_arrestdb.py --rows 1000 --return-id &
+ *   idf.py --preview set-target linux && idf.py build
+ *   BENCH_REQUESTS=500 BENCH_TABLE_ROWS=1000 ./build/sqlite3-benchmark.elf
+ *
+ * Environment: BENCH_SERVER, BENCH_PORT, BENCH_REQUESTS (per workload), BENCH_SCANS,
+ * BENCH_TABLE_ROWS (rows the table was seeded with, read back by GET),
+ * BENCH_BURST (identical reads submitted at once by the BURST workload),
+ * BENCH_MULTI_KEYS (keys per multi-get of the MDENSE and MSPARSE workloads).
+ *
+ * This sample code is in the public domain.
+ */
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "http_pool.h"
+#include "json_arena.h"
+#include "sqlite3_async.h"
+#include "sqlite3_client.h"
+#include "sqlite3_cursor.h"
+#include "sqlite3_flight.h"
+#include "sqlite3_multi.h"
+#include "sqlite3_schema.h"
+#include "sqlite3_stats.h"
+
+static const char *TAG = "BENCH";
+
+/* Heap allocations, counted through the linker's --wrap (see CMakeLists.txt) */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static atomic_uint s_allocs;
+static atomic_ullong s_alloc_bytes;
+
+void *__wrap_malloc(size_t size)
+{
+	atomic_fetch_add(&s_allocs, 1);
+	atomic_fetch_add(&s_alloc_bytes, size);
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+	atomic_fetch_add(&s_allocs, 1);
+	atomic_fetch_add(&s_alloc_bytes, n * size);
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	atomic_fetch_add(&s_allocs, 1);
+	atomic_fetch_add(&s_alloc_bytes, size);
+	return __real_realloc(ptr, size);
+}
+
+typedef struct {
+	const char *name;
+	int count;
+	int failed;
+	int64_t *latency;       // us per request
+	int64_t started;
+	int64_t elapsed;
+	http_pool_counters_t counters;
+	unsigned int allocs;
+	unsigned long long alloc_bytes;
+	int rows;
+} bench_t;
+
+static int bench_env(const char *name, int value)
+{
+	const char *env = getenv(name);
+	return env ? atoi(env) : value;
+}
+
+static void bench_start(bench_t *bench, const char *name, int count)
+{
+	memset(bench, 0, sizeof(bench_t));
+	bench->name = name;
+	bench->latency = calloc(count, sizeof(int64_t));
+	http_pool_get_counters(&bench->counters);
+	bench->allocs = atomic_load(&s_allocs);
+	bench->alloc_bytes = atomic_load(&s_alloc_bytes);
+	bench->started = esp_timer_get_time();
+}
+
+static void bench_record(bench_t *bench, int64_t started, esp_err_t err)
+{
+	bench->latency[bench->count++] = esp_timer_get_time() - started;
+	if (err != ESP_OK) bench->failed++;
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void bench_report(bench_t *bench)
+{
+	bench->elapsed = esp_timer_get_time() - bench->started;
+	http_pool_counters_t counters;
+	http_pool_get_counters(&counters);
+	unsigned int allocs = atomic_load(&s_allocs) - bench->allocs;
+	unsigned long long alloc_bytes = atomic_load(&s_alloc_bytes) - bench->alloc_bytes;
+	uint64_t bytes = (counters.bytes_sent - bench->counters.bytes_sent) + (counters.bytes_received - bench->counters.bytes_received);
+	unsigned int connects = counters.connects - bench->counters.connects;
+	unsigned int http_requests = counters.requests - bench->counters.requests;
+	unsigned int hedges = counters.hedges - bench->counters.hedges;
+	unsigned int timeouts = counters.timeouts - bench->counters.timeouts;
+	unsigned int lookups = counters.lookups - bench->counters.lookups;
+
+	if (bench->count == 0) {
+		printf("%-8s no requests\n", bench->name);
+		free(bench->latency);
+		return;
+	}
+	int n = bench->count;
+	qsort(bench->latency, bench->count, sizeof(int64_t), bench_compare);
+	printf("%-8s %6d %6d %9.1f %9.2f %9.2f %10llu %8.1f %10llu %6u",
+		bench->name, bench->count, bench->failed,
+		bench->count * 1e6 / (bench->elapsed ? bench->elapsed : 1),
+		bench->latency[(bench->count - 1) * 50 / 100] / 1000.0,
+		bench->latency[(bench->count - 1) * 99 / 100] / 1000.0,
+		(unsigned long long)(bytes / n), (double)allocs / n, alloc_bytes / n, connects);
+	if (bench->rows) printf("  rows=%d", bench->rows);
+	if (http_requests != (unsigned int)bench->count) printf("  http=%u", http_requests);
+	if (hedges) printf("  hedged=%u", hedges);
+	if (timeouts) printf("  timeouts=%u", timeouts);
+	if (lookups) printf("  lookups=%u", lookups);
+	printf("\n");
+	free(bench->latency);
+}
+
+static esp_err_t bench_count_row(const cJSON *row, void *ctx)
+{
+	(*(int *)ctx)++;
+	return ESP_OK;
+}
+
+static esp_err_t bench_count_shared_row(const cJSON *row, void *ctx)
+{
+	atomic_fetch_add((atomic_int *)ctx, 1);
+	return ESP_OK;
+}
+
+typedef struct {
+	int id;
+	char name[32];
+	int gender;
+} bench_customer_t;
+
+static const sqlite3_column_t bench_customer_columns[] = {
+	SQLITE3_COLUMN(bench_customer_t, id, SQLITE3_COLUMN_INT),
+	SQLITE3_COLUMN(bench_customer_t, name, SQLITE3_COLUMN_TEXT),
+	SQLITE3_COLUMN(bench_customer_t, gender, SQLITE3_COLUMN_INT),
+};
+static const sqlite3_schema_t bench_customer_schema = SQLITE3_SCHEMA(bench_customer_t, bench_customer_columns);
+
+static esp_err_t bench_count_record(const void *record, void *ctx)
+{
+	(*(int *)ctx)++;
+	return ESP_OK;
+}
+
+static esp_err_t bench_count_key(int id, const cJSON *row, void *ctx)
+{
+	if (row) (*(int *)ctx)++;
+	return ESP_OK;
+}
+
+/* One "request" is a multi-get of keys ids apart, wrapping around the seeded rows */
+static void bench_multi(bench_t *bench, const char *name, int requests, int table_rows, int keys, int stride)
+{
+	int *key_set = calloc(keys, sizeof(int));
+	bench_start(bench, name, requests);
+	for (int i=0;i<requests;i++) {
+		int first = (i * keys * stride) % table_rows;
+		for (int j=0;j<keys;j++) key_set[j] = 1 + (first + j * stride) % table_rows;
+		int64_t started = esp_timer_get_time();
+		bench_record(bench, started, sqlite3_multi_get("customers", key_set, keys, bench_count_key, &bench->rows));
+	}
+	bench_report(bench);
+	free(key_set);
+}
+
+static void bench_task(void *pvParameters)
+{
+	int requests = bench_env("BENCH_REQUESTS", 200);
+	int scans = bench_env("BENCH_SCANS", 5);
+	int table_rows = bench_env("BENCH_TABLE_ROWS", 4);
+	char path[64];
+	char data[64];
+	int *ids = calloc(requests, sizeof(int));
+	bench_t bench;
+
+	printf("%-8s %6s %6s %9s %9s %9s %10s %8s %10s %6s\n",
+		"workload", "reqs", "failed", "req/s", "p50(ms)", "p99(ms)", "bytes/req", "allocs", "alloc B", "conns");
+
+	bench_start(&bench, "GET", requests);
+	for (int i=0;i<requests;i++) {
+		int rows = 0;
+		snprintf(path, sizeof(path), "customers/%d", 1 + i % table_rows);
+		int64_t started = esp_timer_get_time();
+		bench_record(&bench, started, sqlite3_client_get_rows(path, bench_count_row, &rows));
+		bench.rows += rows;
+	}
+	bench_report(&bench);
+
+	bench_start(&bench, "POST", requests);
+	for (int i=0;i<requests;i++) {
+		snprintf(data, sizeof(data), "{\"name\":\"bench%d\", \"gender\":%d}", i, 1 + i % 2);
+		int64_t started = esp_timer_get_time();
+		bench_record(&bench, started, sqlite3_client_create("customers", data, strlen(data), &ids[i], NULL));
+	}
+	bench_report(&bench);
+
+	bench_start(&bench, "PUT", requests);
+	for (int i=0;i<requests;i++) {
+		snprintf(path, sizeof(path), "customers/%d", ids[i]);
+		snprintf(data, sizeof(data), "{\"name\":\"put%d\", \"gender\":%d}", i, 2 - i % 2);
+		int64_t started = esp_timer_get_time();
+		bench_record(&bench, started, sqlite3_client_send(HTTP_METHOD_PUT, path, data, strlen(data)));
+	}
+	bench_report(&bench);
+
+	bench_start(&bench, "DELETE", requests);
+	for (int i=0;i<requests;i++) {
+		snprintf(path, sizeof(path), "customers/%d", ids[i]);
+		int64_t started = esp_timer_get_time();
+		bench_record(&bench, started, sqlite3_client_send(HTTP_METHOD_DELETE, path, NULL, 0));
+	}
+	bench_report(&bench);
+
+	// One "request" is a full walk over the table
+	bench_start(&bench, "SCAN", scans);
+	for (int i=0;i<scans;i++) {
+		sqlite3_cursor_config_t config = {
+			.table = "customers",
+		};
+		sqlite3_cursor_handle_t cursor;
+		int64_t started = esp_timer_get_time();
+		esp_err_t err = sqlite3_cursor_open(&config, &cursor);
+		if (err == ESP_OK) {
+			const cJSON *row;
+			while ((err = sqlite3_cursor_next(cursor, &row)) == ESP_OK) bench.rows++;
+			if (err == ESP_ERR_NOT_FOUND) err = ESP_OK;
+			sqlite3_cursor_close(cursor);
+		}
+		bench_record(&bench, started, err);
+	}
+	bench_report(&bench);
+
+	// The same walk in one request, decoded into structs (CSV when the server offers it)
+	bench_start(&bench, "EACH", scans);
+	for (int i=0;i<scans;i++) {
+		bench_customer_t customer;
+		int64_t started = esp_timer_get_time();
+		bench_record(&bench, started, sqlite3_client_get_each("customers", &bench_customer_schema, &customer, bench_count_record, &bench.rows));
+	}
+	bench_report(&bench);
+
+	// The same walk in one request as cJSON rows, reduced to two columns (compare with --padding)
+	bench_start(&bench, "SELECT", scans);
+	for (int i=0;i<scans;i++) {
+		sqlite3_query_t query;
+		sqlite3_query_init(&query, "customers");
+		sqlite3_query_select(&query, "id");
+		sqlite3_query_select(&query, "name");
+		int64_t started = esp_timer_get_time();
+		bench_record(&bench, started, sqlite3_client_query(&query, bench_count_row, &bench.rows));
+	}
+	bench_report(&bench);
+
+	// Bursts of the same read from several tasks at once, as when dashboards refresh together
+	int burst = bench_env("BENCH_BURST", 8);
+	sqlite3_async_handle_t *handles = calloc(burst, sizeof(sqlite3_async_handle_t));
+	atomic_int burst_rows = 0;
+	bench_start(&bench, "BURST", requests);
+	for (int i=0;i+burst<=requests;i+=burst) {
+		snprintf(path, sizeof(path), "customers/%d", 1 + (i / burst) % table_rows);
+		int64_t started = esp_timer_get_time();
+		for (int j=0;j<burst;j++) {
+			handles[j] = sqlite3_async_get_rows(path, bench_count_shared_row, &burst_rows, NULL, NULL);
+		}
+		for (int j=0;j<burst;j++) {
+			esp_err_t result = ESP_FAIL;
+			if (handles[j]) {
+				sqlite3_async_wait(handles[j], portMAX_DELAY, &result);
+				sqlite3_async_free(handles[j]);
+			}
+			bench_record(&bench, started, result);
+		}
+	}
+	bench.rows = atomic_load(&burst_rows);
+	bench_report(&bench);
+	free(handles);
+
+	// Key sets read with one range scan, and with point lookups spread over the workers
+	int multi_keys = bench_env("BENCH_MULTI_KEYS", 16);
+	int multi_gets = (requests + multi_keys - 1) / multi_keys;
+	bench_multi(&bench, "MDENSE", multi_gets, table_rows, multi_keys, 1);
+	bench_multi(&bench, "MSPARSE", multi_gets, table_rows, multi_keys, 7);
+
+	// Where the time went, phase by phase
+	esp_log_level_set("STATS", ESP_LOG_INFO);
+	sqlite3_stats_dump();
+
+	free(ids);
+	exit(0);
+}
+
+void app_main()
+{
+	const char *server = getenv("BENCH_SERVER");
+	int port = bench_env("BENCH_PORT", 8080);
+	ESP_ERROR_CHECK(json_arena_init());
+	ESP_ERROR_CHECK(http_pool_init(server ? server : "127.0.0.1", port));
+	ESP_ERROR_CHECK(sqlite3_flight_init());
+	ESP_ERROR_CHECK(sqlite3_async_init());
+	ESP_LOGW(TAG, "benchmarking %s:%d", server ? server : "127.0.0.1", port);
+	xTaskCreate(bench_task, "BENCH", 1024*16, NULL, 2, NULL);
+}
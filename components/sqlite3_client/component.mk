@@ -0,0 +1,24 @@
+#
+# Component Makefile
+#
+
+COMPONENT_ADD_INCLUDEDIRS := include
+
+ifndef CONFIG_ESP_BREAKER_ENABLE
+COMPONENT_OBJEXCLUDE += http_breaker.o
+endif
+ifndef CONFIG_ESP_RESOLVER_ENABLE
+COMPONENT_OBJEXCLUDE += http_resolver.o
+endif
+ifndef CONFIG_ESP_CACHE_ENABLE
+COMPONENT_OBJEXCLUDE += sqlite3_cache.o
+endif
+ifndef CONFIG_ESP_WAL_ENABLE
+COMPONENT_OBJEXCLUDE += sqlite3_wal.o
+endif
+ifndef CONFIG_ESP_COALESCE_ENABLE
+COMPONENT_OBJEXCLUDE += sqlite3_flight.o
+endif
+ifndef CONFIG_ESP_REPLICA_ENABLE
+COMPONENT_OBJEXCLUDE += sqlite3_replica.o
+endif
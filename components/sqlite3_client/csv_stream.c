@@ -0,0 +1,138 @@
+/* Streaming parser for the compact CSV response mode
+ *
+ * This sample code is in the public domain.
+ */
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "csv_stream.h"
+
+static const char *TAG = "CSV_STREAM";
+
+void csv_stream_init(csv_stream_t *stream, char *row_buffer, size_t row_size, csv_stream_row_cb_t callback, void *ctx)
+{
+	memset(stream, 0, sizeof(csv_stream_t));
+	stream->row = row_buffer;
+	stream->row_size = row_size;
+	stream->state = CSV_STREAM_FIELD_START;
+	stream->callback = callback;
+	stream->ctx = ctx;
+}
+
+static void csv_stream_put(csv_stream_t *stream, char c)
+{
+	// Keep room for the terminating NUL of the field
+	if (stream->row_len < stream->row_size - 1) {
+		stream->row[stream->row_len++] = c;
+	} else {
+		stream->overflow = true;
+	}
+}
+
+static void csv_stream_end_field(csv_stream_t *stream)
+{
+	if (stream->field_count < CSV_STREAM_MAX_FIELDS) {
+		bool null = !stream->quoted && stream->row_len == stream->field_start;
+		stream->offsets[stream->field_count] = null ? -1 : (int)stream->field_start;
+	} else {
+		stream->overflow = true;
+	}
+	stream->field_count++;
+	csv_stream_put(stream, 0);
+	stream->field_start = stream->row_len;
+	stream->quoted = false;
+	stream->state = CSV_STREAM_FIELD_START;
+}
+
+static esp_err_t csv_stream_end_row(csv_stream_t *stream)
+{
+	esp_err_t err = ESP_OK;
+	if (stream->overflow) {
+		ESP_LOGE(TAG, "row %d is larger than %d bytes or has more than %d fields",
+			stream->rows, (int)stream->row_size, CSV_STREAM_MAX_FIELDS);
+		err = ESP_ERR_INVALID_SIZE;
+	} else if (stream->name_count == 0) {
+		// The header stays where it is; rows are assembled behind it
+		for (int i=0;i<stream->field_count;i++) {
+			stream->names[i] = stream->offsets[i] < 0 ? "" : stream->row + stream->offsets[i];
+		}
+		stream->name_count = stream->field_count;
+		stream->header_len = stream->row_len;
+	} else {
+		const char *values[CSV_STREAM_MAX_FIELDS];
+		for (int i=0;i<stream->name_count;i++) {
+			values[i] = (i < stream->field_count && stream->offsets[i] >= 0) ? stream->row + stream->offsets[i] : NULL;
+		}
+		stream->rows++;
+		err = stream->callback(stream->names, values, stream->name_count, stream->ctx);
+	}
+	stream->row_len = stream->header_len;
+	stream->field_start = stream->row_len;
+	stream->field_count = 0;
+	return err;
+}
+
+esp_err_t csv_stream_feed(csv_stream_t *stream, const char *data, size_t len)
+{
+	for (size_t i=0;i<len;i++) {
+		char c = data[i];
+		switch (stream->state) {
+			case CSV_STREAM_FIELD_START:
+				if (c == '"') {
+					stream->quoted = true;
+					stream->state = CSV_STREAM_QUOTED;
+				} else if (c == ',') {
+					csv_stream_end_field(stream);
+				} else if (c == '\n') {
+					// A blank line is skipped, anything else ends with an empty last field
+					if (stream->field_count == 0) continue;
+					csv_stream_end_field(stream);
+					esp_err_t err = csv_stream_end_row(stream);
+					if (err != ESP_OK) return err;
+				} else if (c != '\r') {
+					csv_stream_put(stream, c);
+					stream->state = CSV_STREAM_UNQUOTED;
+				}
+				break;
+			case CSV_STREAM_UNQUOTED:
+			case CSV_STREAM_QUOTE:
+				if (c == '"' && stream->state == CSV_STREAM_QUOTE) {
+					csv_stream_put(stream, c);
+					stream->state = CSV_STREAM_QUOTED;
+				} else if (c == ',') {
+					csv_stream_end_field(stream);
+				} else if (c == '\n') {
+					csv_stream_end_field(stream);
+					esp_err_t err = csv_stream_end_row(stream);
+					if (err != ESP_OK) return err;
+				} else if (c != '\r') {
+					csv_stream_put(stream, c);
+					stream->state = CSV_STREAM_UNQUOTED;
+				}
+				break;
+			case CSV_STREAM_QUOTED:
+				if (c == '"') {
+					stream->state = CSV_STREAM_QUOTE;
+				} else {
+					csv_stream_put(stream, c);
+				}
+				break;
+		}
+	}
+	return ESP_OK;
+}
+
+esp_err_t csv_stream_finish(csv_stream_t *stream)
+{
+	if (stream->state == CSV_STREAM_QUOTED) {
+		ESP_LOGE(TAG, "truncated response after %d rows", stream->rows);
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+	// The last line may come without a line break
+	if (stream->field_count > 0 || stream->state != CSV_STREAM_FIELD_START) {
+		csv_stream_end_field(stream);
+		return csv_stream_end_row(stream);
+	}
+	return ESP_OK;
+}
@@ -0,0 +1,58 @@
+/* Circuit breaker for the remote sqlite3 client
+ *
+ * This sample code is in the public domain.
+ */
+#include <stdatomic.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "http_breaker.h"
+
+static const char *TAG = "BREAKER";
+
+static atomic_int s_failures;       // requests in a row that got no response
+static atomic_bool s_open;
+static http_breaker_probe_t s_probe;
+static TaskHandle_t s_probe_task;
+
+static void http_breaker_task(void *pvParameters)
+{
+	while (1) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		while (atomic_load(&s_open)) {
+			vTaskDelay(pdMS_TO_TICKS(CONFIG_ESP_BREAKER_PROBE_MS));
+			if (s_probe() != ESP_OK) continue;
+			atomic_store(&s_failures, 0);
+			atomic_store(&s_open, false);
+			ESP_LOGW(TAG, "server is answering again, breaker closed");
+		}
+	}
+}
+
+esp_err_t http_breaker_init(http_breaker_probe_t probe)
+{
+	s_probe = probe;
+	if (xTaskCreate(http_breaker_task, "BREAKER", CONFIG_ESP_SQLITE3_TASK_STACK, NULL, 2, &s_probe_task) != pdPASS) return ESP_ERR_NO_MEM;
+	return ESP_OK;
+}
+
+bool http_breaker_allow(void)
+{
+	return !atomic_load(&s_open);
+}
+
+void http_breaker_report(bool answered)
+{
+	if (answered) {
+		atomic_store(&s_failures, 0);
+		return;
+	}
+	if (atomic_fetch_add(&s_failures, 1) + 1 < CONFIG_ESP_BREAKER_FAILURES) return;
+	bool closed = false;
+	if (atomic_compare_exchange_strong(&s_open, &closed, true)) {
+		ESP_LOGW(TAG, "%d requests in a row got no response, breaker open", CONFIG_ESP_BREAKER_FAILURES);
+		xTaskNotifyGive(s_probe_task);
+	}
+}
@@ -0,0 +1,176 @@
+/* Size-classed I/O buffer pool with a memory budget
+ *
+ * This sample code is in the public domain.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#if CONFIG_ESP_BUFFER_PSRAM
+#include "esp_heap_caps.h"
+#endif
+
+#include "http_buffer.h"
+
+#define BUFFER_MIN_SHIFT 9          // the smallest class holds 512 bytes
+#define BUFFER_CLASSES 7            // up to 32 KB
+
+/* In front of every buffer; 16 bytes, so the buffer stays aligned for any use */
+typedef struct http_buffer_header {
+	struct http_buffer_header *next;    // kept buffers of the class
+	uint8_t cls;
+	bool pooled;                // false for a buffer beyond the budget, freed on put
+	uint8_t padding[16 - sizeof(void *) - 2];
+} http_buffer_header_t;
+
+static const char *TAG = "HTTP_BUFFER";
+
+static SemaphoreHandle_t s_mutex;
+static SemaphoreHandle_t s_released;    // given when a buffer comes back while tasks wait
+static http_buffer_header_t *s_kept[BUFFER_CLASSES];
+static int s_waiters;
+static http_buffer_stats_t s_stats;
+
+static size_t http_buffer_class_size(int cls)
+{
+	return (size_t)1 << (BUFFER_MIN_SHIFT + cls);
+}
+
+static int http_buffer_class(size_t size)
+{
+	for (int cls=0;cls<BUFFER_CLASSES;cls++) {
+		if (size <= http_buffer_class_size(cls)) return cls;
+	}
+	return -1;
+}
+
+static http_buffer_header_t *http_buffer_alloc(int cls)
+{
+	size_t size = sizeof(http_buffer_header_t) + http_buffer_class_size(cls);
+	http_buffer_header_t *header = NULL;
+#if CONFIG_ESP_BUFFER_PSRAM
+	header = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+#endif
+	if (header == NULL) header = malloc(size);
+	if (header) header->cls = cls;
+	return header;
+}
+
+/* Release kept buffers of other classes until size more bytes fit into the budget; called with s_mutex held */
+static bool http_buffer_make_room(size_t size)
+{
+	for (int cls=BUFFER_CLASSES-1;cls>=0 && s_stats.allocated + size > s_stats.budget;cls--) {
+		while (s_kept[cls] && s_stats.allocated + size > s_stats.budget) {
+			http_buffer_header_t *header = s_kept[cls];
+			s_kept[cls] = header->next;
+			s_stats.allocated -= http_buffer_class_size(cls);
+			free(header);
+		}
+	}
+	return s_stats.allocated + size <= s_stats.budget;
+}
+
+esp_err_t http_buffer_init(void)
+{
+	s_mutex = xSemaphoreCreateMutex();
+	s_released = xSemaphoreCreateCounting(INT16_MAX, 0);
+	if (s_mutex == NULL || s_released == NULL) return ESP_ERR_NO_MEM;
+	s_stats.budget = CONFIG_ESP_BUFFER_BUDGET;
+#if CONFIG_ESP_BUFFER_PSRAM
+	ESP_LOGI(TAG, "budget=%d bytes in PSRAM", CONFIG_ESP_BUFFER_BUDGET);
+#else
+	ESP_LOGI(TAG, "budget=%d bytes", CONFIG_ESP_BUFFER_BUDGET);
+#endif
+	return ESP_OK;
+}
+
+void *http_buffer_get(size_t size)
+{
+	int cls = http_buffer_class(size);
+	if (cls < 0) {
+		ESP_LOGE(TAG, "no buffer class holds %d bytes", (int)size);
+		return NULL;
+	}
+	size_t class_size = http_buffer_class_size(cls);
+	TickType_t started = xTaskGetTickCount();
+	TickType_t patience = pdMS_TO_TICKS(CONFIG_ESP_HTTP_TIMEOUT_MS);
+	bool waited = false;
+	http_buffer_header_t *header = NULL;
+
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	s_stats.gets++;
+	while (1) {
+		if (s_kept[cls]) {
+			header = s_kept[cls];
+			s_kept[cls] = header->next;
+			s_stats.reused++;
+			break;
+		}
+		if (http_buffer_make_room(class_size)) {
+			header = http_buffer_alloc(cls);
+			if (header == NULL) break;
+			s_stats.allocated += class_size;
+			if (s_stats.allocated > s_stats.peak_allocated) s_stats.peak_allocated = s_stats.allocated;
+			break;
+		}
+		// Every pooled byte is in use: wait for a buffer to come back
+		TickType_t elapsed = xTaskGetTickCount() - started;
+		if (elapsed >= patience || class_size > s_stats.budget) {
+			ESP_LOGW(TAG, "budget of %d bytes used up, %d bytes taken from the heap", (int)s_stats.budget, (int)class_size);
+			s_stats.over_budget++;
+			xSemaphoreGive(s_mutex);
+			header = http_buffer_alloc(cls);
+			if (header == NULL) return NULL;
+			header->pooled = false;
+			return header + 1;
+		}
+		if (!waited) s_stats.waits++;
+		waited = true;
+		s_waiters++;
+		xSemaphoreGive(s_mutex);
+		xSemaphoreTake(s_released, patience - elapsed);
+		xSemaphoreTake(s_mutex, portMAX_DELAY);
+		s_waiters--;
+	}
+	if (header) {
+		header->pooled = true;
+		s_stats.in_use += class_size;
+		if (s_stats.in_use > s_stats.peak_in_use) s_stats.peak_in_use = s_stats.in_use;
+	}
+	// What is left may do for another waiter
+	if (waited && s_waiters > 0) xSemaphoreGive(s_released);
+	xSemaphoreGive(s_mutex);
+	return header ? header + 1 : NULL;
+}
+
+void http_buffer_put(void *buffer)
+{
+	if (buffer == NULL) return;
+	http_buffer_header_t *header = (http_buffer_header_t *)buffer - 1;
+	if (!header->pooled) {
+		free(header);
+		return;
+	}
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	header->next = s_kept[header->cls];
+	s_kept[header->cls] = header;
+	s_stats.in_use -= http_buffer_class_size(header->cls);
+	if (s_waiters > 0) xSemaphoreGive(s_released);
+	xSemaphoreGive(s_mutex);
+}
+
+void http_buffer_get_stats(http_buffer_stats_t *stats)
+{
+	if (s_mutex == NULL) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	*stats = s_stats;
+	xSemaphoreGive(s_mutex);
+}
@@ -0,0 +1,686 @@
+/* Keep-alive connection pool for the remote sqlite3 client
+ *
+ * This sample code is in the public domain.
+ */
+#include <limits.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <strings.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#if CONFIG_ESP_HTTPS_ENABLE && CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+#include "esp_crt_bundle.h"
+#endif
+
+#include "http_breaker.h"
+#include "http_buffer.h"
+#include "http_pool.h"
+#include "http_resolver.h"
+
+#define MAX_HTTP_URL_LENGTH 320     // "https://" + server + port + SQLITE3_QUERY_MAX_PATH
+#define MAX_HTTP_HEADER_VALUE 64
+#define MAX_HTTP_REQUEST_HEADERS 4
+#define HEDGE_POLL_MS 10            // how long to listen on one connection before turning to the other
+#define HEDGE_MIN_SAMPLES 20        // GETs measured before their p95 is trusted as the hedge delay
+#define BACKGROUND_BURST_MS 1000    // background requests may come in a burst of one second's worth
+
+/* Response headers kept for http_pool_get_header() */
+static const char *s_captured_headers[] = { "ETag", "Last-Modified", "Location", "Content-Type", "Content-Encoding" };
+#define CAPTURED_HEADERS (int)(sizeof(s_captured_headers) / sizeof(s_captured_headers[0]))
+
+typedef struct {
+	esp_http_client_handle_t client;
+	bool in_use;
+	http_pool_priority_t priority;  // of the request that holds the slot
+	bool connected;     // a socket is open (set/cleared by the client events)
+	bool server_close;  // the last response carried "Connection: close"
+	char headers[CAPTURED_HEADERS][MAX_HTTP_HEADER_VALUE];
+	const char *request_headers[MAX_HTTP_REQUEST_HEADERS];  // set for one request only
+	const char *request_values[MAX_HTTP_REQUEST_HEADERS];
+	int timeout_ms;     // deadline of the next request, from http_pool_open() to the last byte read
+	int64_t deadline;
+	bool timed_out;
+	int64_t connected_at;
+	esp_err_t open_err;
+	sqlite3_stats_sample_t sample;
+} http_pool_slot_t;
+
+static const char *TAG = "HTTP_POOL";
+
+static char s_server[64];
+static int s_port;
+#if CONFIG_ESP_RESOLVER_ENABLE
+static char s_host_header[72];      // "server[:port]", sent when the URL carries the cached address
+#endif
+#if CONFIG_ESP_HTTPS_ENABLE
+static const char *s_server_cert;   // PEM, NULL to verify against the CA bundle
+#define HTTP_POOL_SCHEME "https"
+#define HTTP_POOL_DEFAULT_PORT 443
+#else
+#define HTTP_POOL_SCHEME "http"
+#define HTTP_POOL_DEFAULT_PORT 80
+#endif
+
+static atomic_uint s_requests;
+static atomic_uint s_connects;
+static atomic_uint s_hedges;
+static atomic_uint s_timeouts;
+static _Atomic uint64_t s_bytes_sent;
+static _Atomic uint64_t s_bytes_received;
+
+static http_pool_slot_t s_slots[CONFIG_ESP_HTTP_POOL_SIZE];
+static SemaphoreHandle_t s_mutex;   // guards the slots and the counts below
+static int s_in_use[HTTP_POOL_PRIORITIES];
+static int s_waiting[HTTP_POOL_PRIORITIES];
+static SemaphoreHandle_t s_wake[HTTP_POOL_PRIORITIES];  // given when a waiter of the class may get a slot
+static int64_t s_background_tat;    // token bucket of the background class, as its theoretical arrival time
+static int s_background_slots;
+
+static esp_err_t http_pool_event_handler(esp_http_client_event_t *evt)
+{
+	http_pool_slot_t *slot = evt->user_data;
+	switch(evt->event_id) {
+		case HTTP_EVENT_ON_CONNECTED:
+			ESP_LOGD(TAG, "slot %d connected", (int)(slot - s_slots));
+			slot->connected = true;
+			slot->connected_at = esp_timer_get_time();
+			atomic_fetch_add(&s_connects, 1);
+			break;
+		case HTTP_EVENT_DISCONNECTED:
+			ESP_LOGD(TAG, "slot %d disconnected", (int)(slot - s_slots));
+			slot->connected = false;
+			break;
+		case HTTP_EVENT_ON_DATA:
+			atomic_fetch_add(&s_bytes_received, evt->data_len);
+			slot->sample.bytes_received += evt->data_len;
+			break;
+		case HTTP_EVENT_ON_HEADER:
+			if (strcasecmp(evt->header_key, "Connection") == 0 && strcasecmp(evt->header_value, "close") == 0) {
+				slot->server_close = true;
+			}
+			for (int i=0;i<CAPTURED_HEADERS;i++) {
+				if (strcasecmp(evt->header_key, s_captured_headers[i]) == 0) {
+					strlcpy(slot->headers[i], evt->header_value, MAX_HTTP_HEADER_VALUE);
+				}
+			}
+			break;
+		default:
+			break;
+	}
+	return ESP_OK;
+}
+
+/* False when the URL does not fit */
+static bool http_pool_make_url(char *url, size_t url_size, const char *path)
+{
+	const char *host = s_server;
+#if CONFIG_ESP_RESOLVER_ENABLE
+	char address[HTTP_RESOLVER_ADDRESS_SIZE];
+	if (http_resolver_lookup(address, sizeof(address))) host = address;
+#endif
+	int url_length = snprintf(url, url_size, HTTP_POOL_SCHEME "://%s:%d/", host, s_port);
+	if (*path == '/') path++;
+	return strlcpy(url + url_length, path, url_size - url_length) < url_size - url_length;
+}
+
+
+#if CONFIG_ESP_HTTPS_ENABLE
+void http_pool_set_server_cert(const char *cert_pem)
+{
+	s_server_cert = cert_pem;
+}
+#endif
+
+esp_err_t http_pool_init(const char *server, int port)
+{
+	strlcpy(s_server, server, sizeof(s_server));
+	s_port = port;
+#if CONFIG_ESP_RESOLVER_ENABLE
+	if (s_port == HTTP_POOL_DEFAULT_PORT) {
+		strlcpy(s_host_header, s_server, sizeof(s_host_header));
+	} else {
+		snprintf(s_host_header, sizeof(s_host_header), "%s:%d", s_server, s_port);
+	}
+#endif
+	s_mutex = xSemaphoreCreateMutex();
+	if (s_mutex == NULL) return ESP_ERR_NO_MEM;
+	for (int i=0;i<HTTP_POOL_PRIORITIES;i++) {
+		s_wake[i] = xSemaphoreCreateCounting(CONFIG_ESP_HTTP_POOL_SIZE, 0);
+		if (s_wake[i] == NULL) return ESP_ERR_NO_MEM;
+	}
+	memset(s_slots, 0, sizeof(s_slots));
+	// With a single connection background requests cannot leave one to the interactive ones
+	s_background_slots = CONFIG_ESP_HTTP_BACKGROUND_SLOTS;
+	if (s_background_slots >= CONFIG_ESP_HTTP_POOL_SIZE) s_background_slots = CONFIG_ESP_HTTP_POOL_SIZE - 1;
+	if (s_background_slots < 1) s_background_slots = 1;
+	ESP_LOGI(TAG, "server=%s:%d pool size=%d (background %d, %d/s) timeout=%dms", s_server, s_port, CONFIG_ESP_HTTP_POOL_SIZE,
+		s_background_slots, CONFIG_ESP_HTTP_BACKGROUND_RATE, CONFIG_ESP_HTTP_TIMEOUT_MS);
+#if CONFIG_ESP_HTTPS_ENABLE
+#if !CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+	if (s_server_cert == NULL) {
+		ESP_LOGE(TAG, "HTTPS needs the server certificate or CONFIG_MBEDTLS_CERTIFICATE_BUNDLE");
+		return ESP_ERR_INVALID_STATE;
+	}
+#endif
+	ESP_LOGI(TAG, "HTTPS, server verified against %s", s_server_cert ? "its certificate" : "the CA bundle");
+#endif
+	esp_err_t err = http_buffer_init();
+	if (err != ESP_OK) return err;
+#if CONFIG_ESP_RESOLVER_ENABLE
+	err = http_resolver_init(s_server);
+	if (err != ESP_OK) return err;
+#endif
+#if CONFIG_ESP_BREAKER_ENABLE
+	return http_breaker_init(http_pool_ping);
+#else
+	return ESP_OK;
+#endif
+}
+
+static bool http_pool_slot_free(void)
+{
+	return s_in_use[HTTP_POOL_PRIORITY_INTERACTIVE] + s_in_use[HTTP_POOL_PRIORITY_BACKGROUND] < CONFIG_ESP_HTTP_POOL_SIZE;
+}
+
+/* Let one waiter recheck, interactive ones first; called with s_mutex held */
+static void http_pool_wake(void)
+{
+	if (!http_pool_slot_free()) return;
+	if (s_waiting[HTTP_POOL_PRIORITY_INTERACTIVE] > 0) {
+		xSemaphoreGive(s_wake[HTTP_POOL_PRIORITY_INTERACTIVE]);
+	} else if (s_waiting[HTTP_POOL_PRIORITY_BACKGROUND] > 0) {
+		xSemaphoreGive(s_wake[HTTP_POOL_PRIORITY_BACKGROUND]);
+	}
+}
+
+/*
+ * Whether a request of this class may take a slot now; called with s_mutex held.
+ * Returns 0 when it may, the milliseconds until the background rate allows it,
+ * or -1 when it has to wait for a slot to be released.
+ * Interactive requests take any free slot. Background ones only get a slot no interactive request
+ * is waiting for, hold at most s_background_slots, and are spread out to CONFIG_ESP_HTTP_BACKGROUND_RATE per second.
+ */
+static int http_pool_admit(http_pool_priority_t priority)
+{
+	if (!http_pool_slot_free()) return -1;
+	if (priority == HTTP_POOL_PRIORITY_BACKGROUND) {
+		if (s_waiting[HTTP_POOL_PRIORITY_INTERACTIVE] > 0 || s_in_use[HTTP_POOL_PRIORITY_BACKGROUND] >= s_background_slots) return -1;
+#if CONFIG_ESP_HTTP_BACKGROUND_RATE > 0
+		const int64_t interval = 1000000LL / CONFIG_ESP_HTTP_BACKGROUND_RATE;
+		int64_t now = esp_timer_get_time();
+		if (s_background_tat < now) s_background_tat = now;
+		int64_t early = s_background_tat - now - (BACKGROUND_BURST_MS * 1000LL - interval);
+		if (early > 0) return (int)((early + 999) / 1000);
+		s_background_tat += interval;
+#endif
+	}
+	s_in_use[priority]++;
+	return 0;
+}
+
+/* Hand a slot back and let the next waiter have it */
+static void http_pool_vacate(http_pool_slot_t *slot)
+{
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	slot->in_use = false;
+	s_in_use[slot->priority]--;
+	http_pool_wake();
+	xSemaphoreGive(s_mutex);
+}
+
+/* Take a free slot for a request of this class, waiting up to wait ticks for one; NULL when none became free */
+static http_pool_slot_t *http_pool_claim(TickType_t wait, http_pool_priority_t priority)
+{
+	TickType_t started = xTaskGetTickCount();
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	int delay_ms;
+	while ((delay_ms = http_pool_admit(priority)) != 0) {
+		TickType_t ticks = (delay_ms < 0) ? portMAX_DELAY : pdMS_TO_TICKS(delay_ms) + 1;
+		if (wait != portMAX_DELAY) {
+			TickType_t elapsed = xTaskGetTickCount() - started;
+			if (elapsed >= wait) {
+				xSemaphoreGive(s_mutex);
+				return NULL;
+			}
+			if (ticks > wait - elapsed) ticks = wait - elapsed;
+		}
+		s_waiting[priority]++;
+		xSemaphoreGive(s_mutex);
+		xSemaphoreTake(s_wake[priority], ticks);
+		xSemaphoreTake(s_mutex, portMAX_DELAY);
+		s_waiting[priority]--;
+	}
+	http_pool_slot_t *slot = NULL;
+	// Prefer a slot that still holds an open socket
+	for (int i=0;i<CONFIG_ESP_HTTP_POOL_SIZE;i++) {
+		if (s_slots[i].in_use) continue;
+		if (slot == NULL || (s_slots[i].connected && !slot->connected)) slot = &s_slots[i];
+	}
+	slot->in_use = true;
+	slot->priority = priority;
+	slot->timeout_ms = CONFIG_ESP_HTTP_TIMEOUT_MS;
+	// Another waiter may fit into what is left
+	http_pool_wake();
+	xSemaphoreGive(s_mutex);
+
+	if (slot->client == NULL) {
+		char url[MAX_HTTP_URL_LENGTH];
+		http_pool_make_url(url, sizeof(url), "");
+		esp_http_client_config_t config = {
+			.url = url,
+			.keep_alive_enable = true,
+			.timeout_ms = CONFIG_ESP_HTTP_TIMEOUT_MS,
+			.event_handler = http_pool_event_handler,
+			.user_data = slot,
+#if CONFIG_ESP_HTTPS_ENABLE
+			.transport_type = HTTP_TRANSPORT_OVER_SSL,
+			// The URL may carry the cached address: check the certificate (and send SNI) for the name
+			.common_name = s_server,
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+			// Reconnects resume the TLS session instead of a full handshake
+			.save_client_session = true,
+#endif
+#endif
+		};
+#if CONFIG_ESP_HTTPS_ENABLE
+		if (s_server_cert) {
+			config.cert_pem = s_server_cert;
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+		} else {
+			config.crt_bundle_attach = esp_crt_bundle_attach;
+#endif
+		}
+#endif
+		slot->client = esp_http_client_init(&config);
+		if (slot->client == NULL) {
+			ESP_LOGE(TAG, "Failed to initialise HTTP connection");
+			http_pool_vacate(slot);
+			return NULL;
+		}
+	}
+	return slot;
+}
+
+esp_http_client_handle_t http_pool_acquire(http_pool_priority_t priority)
+{
+	http_pool_slot_t *slot = http_pool_claim(portMAX_DELAY, priority);
+	return slot ? slot->client : NULL;
+}
+
+static http_pool_slot_t *http_pool_slot(esp_http_client_handle_t client)
+{
+	void *user_data = NULL;
+	esp_http_client_get_user_data(client, &user_data);
+	return user_data;
+}
+
+void http_pool_set_timeout(esp_http_client_handle_t client, int timeout_ms)
+{
+	http_pool_slot_t *slot = http_pool_slot(client);
+	slot->timeout_ms = (timeout_ms > 0) ? timeout_ms : CONFIG_ESP_HTTP_TIMEOUT_MS;
+}
+
+/* Milliseconds left until the deadline of the request, 0 once it passed */
+static int http_pool_remaining_ms(http_pool_slot_t *slot)
+{
+	int64_t remaining = slot->deadline - esp_timer_get_time();
+	return (remaining > 0) ? (int)((remaining + 999) / 1000) : 0;
+}
+
+/* Let the next blocking socket call wait at most max_ms, and never past the deadline; 0 when it passed */
+static int http_pool_arm(http_pool_slot_t *slot, int max_ms)
+{
+	int timeout_ms = http_pool_remaining_ms(slot);
+	if (timeout_ms > max_ms) timeout_ms = max_ms;
+	if (timeout_ms > 0) esp_http_client_set_timeout_ms(slot->client, timeout_ms);
+	return timeout_ms;
+}
+
+static esp_err_t http_pool_timed_out(http_pool_slot_t *slot)
+{
+	if (!slot->timed_out) {
+		ESP_LOGW(TAG, "slot %d: no complete answer within %dms", (int)(slot - s_slots), slot->timeout_ms);
+		atomic_fetch_add(&s_timeouts, 1);
+		slot->timed_out = true;
+	}
+	// The rest of the response may still arrive, so the socket cannot be reused
+	slot->server_close = true;
+	return ESP_ERR_TIMEOUT;
+}
+
+static void http_pool_prepare(http_pool_slot_t *slot, const char *url, esp_http_client_method_t method, int post_len)
+{
+	esp_http_client_set_url(slot->client, url);
+	esp_http_client_set_method(slot->client, method);
+	// Headers persist on the handle, so clear the ones a previous request may have set
+	if (post_len > 0) {
+		esp_http_client_set_header(slot->client, "Content-Type", "application/json");
+	} else {
+		esp_http_client_delete_header(slot->client, "Content-Type");
+	}
+#if CONFIG_ESP_RESOLVER_ENABLE
+	// The URL may carry the cached address, but virtual hosts and reverse proxies route on the name
+	esp_http_client_set_header(slot->client, "Host", s_host_header);
+#endif
+}
+
+/* Connect unless the socket is still open, and send the request line, headers and body */
+static esp_err_t http_pool_send(http_pool_slot_t *slot, const char *post_data, int post_len)
+{
+	slot->server_close = false;
+	memset(slot->headers, 0, sizeof(slot->headers));
+	int64_t started = esp_timer_get_time();
+	slot->connected_at = started;
+	if (http_pool_arm(slot, INT_MAX) == 0) return http_pool_timed_out(slot);
+	esp_err_t err = esp_http_client_open(slot->client, post_len);
+	if (err == ESP_OK && post_len > 0) {
+		int wlen = esp_http_client_write(slot->client, post_data, post_len);
+		if (wlen < 0) {
+			ESP_LOGE(TAG, "HTTP client write failed");
+			err = ESP_FAIL;
+		} else {
+			atomic_fetch_add(&s_bytes_sent, wlen);
+			slot->sample.bytes_sent += wlen;
+		}
+	}
+	slot->sample.phase_us[SQLITE3_STATS_CONNECT] += slot->connected_at - started;
+	slot->sample.phase_us[SQLITE3_STATS_WRITE] += esp_timer_get_time() - slot->connected_at;
+	return err;
+}
+
+/* Wait up to wait_ms for the response headers; ESP_ERR_TIMEOUT when they did not come in that time */
+static esp_err_t http_pool_wait(http_pool_slot_t *slot, int wait_ms, int64_t *content_length)
+{
+	if (http_pool_arm(slot, wait_ms) == 0) return ESP_ERR_TIMEOUT;
+	// After a timeout the client keeps what it parsed so far, and the next call carries on
+	*content_length = esp_http_client_fetch_headers(slot->client);
+	if (*content_length >= 0) return ESP_OK;
+	if (*content_length == -ESP_ERR_HTTP_EAGAIN) return ESP_ERR_TIMEOUT;
+	ESP_LOGE(TAG, "HTTP client fetch headers failed");
+	return ESP_FAIL;
+}
+
+#if CONFIG_ESP_HEDGE_ENABLE
+/*
+ * The p95 time to the response headers of the GETs measured so far, but at least CONFIG_ESP_HEDGE_DELAY_MS.
+ * Not the whole latency: it is compared with the wait for the headers, and a scan reading a long body
+ * would push the p95 past any header wait.
+ */
+static int http_pool_hedge_delay_ms(void)
+{
+	sqlite3_stats_t stats;
+	sqlite3_stats_get_method(HTTP_METHOD_GET, &stats);
+	uint32_t answered = 0;
+	for (int i=0;i<SQLITE3_STATS_BUCKETS;i++) answered += stats.headers_histogram[i];
+	if (answered < HEDGE_MIN_SAMPLES) return CONFIG_ESP_HEDGE_DELAY_MS;
+	int p95 = sqlite3_stats_headers_percentile(&stats, 95);
+	return (p95 > CONFIG_ESP_HEDGE_DELAY_MS) ? p95 : CONFIG_ESP_HEDGE_DELAY_MS;
+}
+
+/*
+ * Wait for the headers of a GET. When they are later than the hedge delay, the same request
+ * is sent on a second connection, if one is free, and the two are listened to in turn.
+ * The slot that answered first is handed back in *primary, the other connection is closed.
+ */
+static esp_err_t http_pool_hedge(http_pool_slot_t **primary, const char *url, int64_t *content_length)
+{
+	http_pool_slot_t *slot = *primary;
+	int delay_ms = http_pool_hedge_delay_ms();
+	esp_err_t err = http_pool_wait(slot, delay_ms, content_length);
+	if (err != ESP_ERR_TIMEOUT || http_pool_remaining_ms(slot) == 0) return err;
+	http_pool_slot_t *hedge = http_pool_claim(0, slot->priority);
+	if (hedge == NULL) return http_pool_wait(slot, INT_MAX, content_length);
+
+	ESP_LOGW(TAG, "slot %d: no answer after %dms, sending the request again on slot %d",
+		(int)(slot - s_slots), delay_ms, (int)(hedge - s_slots));
+	http_pool_prepare(hedge, url, HTTP_METHOD_GET, 0);
+	for (int i=0;i<MAX_HTTP_REQUEST_HEADERS && slot->request_headers[i];i++) {
+		http_pool_set_header(hedge->client, slot->request_headers[i], slot->request_values[i]);
+	}
+	hedge->deadline = slot->deadline;
+	slot->sample.hedges++;
+	atomic_fetch_add(&s_hedges, 1);
+	atomic_fetch_add(&s_requests, 1);
+
+	http_pool_slot_t *racers[2] = { slot, hedge };
+	bool waiting[2] = { true, http_pool_send(hedge, NULL, 0) == ESP_OK };
+	int64_t lengths[2];
+	int winner = -1;
+	while (winner < 0 && (waiting[0] || waiting[1]) && http_pool_remaining_ms(slot) > 0) {
+		for (int i=0;i<2 && winner<0;i++) {
+			if (!waiting[i]) continue;
+			// Once one of them failed there is no need to take turns
+			err = http_pool_wait(racers[i], waiting[!i] ? HEDGE_POLL_MS : INT_MAX, &lengths[i]);
+			if (err == ESP_OK) {
+				winner = i;
+			} else if (err != ESP_ERR_TIMEOUT) {
+				waiting[i] = false;
+			}
+		}
+	}
+	if (winner >= 0) *content_length = lengths[winner];
+	http_pool_slot_t *loser = hedge;
+	if (winner == 1) {
+		// The caller goes on with the hedge, which takes over the request's stats sample
+		ESP_LOGI(TAG, "slot %d answered first", (int)(hedge - s_slots));
+		hedge->sample = slot->sample;
+		slot->sample.active = false;
+		loser = slot;
+		*primary = hedge;
+	}
+	loser->server_close = true;
+	http_pool_release(loser->client);
+	return err;
+}
+#endif
+
+/* Wait for the response headers, hedging GETs when enabled */
+static esp_err_t http_pool_wait_headers(http_pool_slot_t **slot, esp_http_client_method_t method, const char *url, int64_t *content_length)
+{
+#if CONFIG_ESP_HEDGE_ENABLE
+	if (method == HTTP_METHOD_GET) return http_pool_hedge(slot, url, content_length);
+#endif
+	return http_pool_wait(*slot, INT_MAX, content_length);
+}
+
+#if CONFIG_ESP_RESOLVER_ENABLE
+/*
+ * The connect failed: the cached address may be stale, so the server is looked up again.
+ * True when it moved, then the request is prepared for the new address.
+ * Changing the host of the URL closes the socket of a client, so no connection to the old one is reused.
+ */
+static bool http_pool_readdress(http_pool_slot_t *slot, char *url, size_t url_size, const char *path, esp_http_client_method_t method, int post_len)
+{
+	http_resolver_invalidate();
+	char moved[MAX_HTTP_URL_LENGTH];
+	if (!http_pool_make_url(moved, sizeof(moved), path) || strcmp(moved, url) == 0) return false;
+	ESP_LOGW(TAG, "server moved, url=[%s]", moved);
+	strlcpy(url, moved, url_size);
+	http_pool_prepare(slot, url, method, post_len);
+	return true;
+}
+#endif
+
+/*
+ * Send one request on a pooled connection and read the response headers.
+ * When a kept-alive socket turns out to be closed by the server (it timed out
+ * while idle), the request is sent once more on a fresh connection, and so it is
+ * when the connect failed and a fresh lookup of the server gave another address.
+ * Every blocking step only waits for what is left of the request's deadline.
+ */
+esp_err_t http_pool_open(esp_http_client_handle_t *client, esp_http_client_method_t method, const char *path, const char *post_data, int post_len, int64_t *content_length)
+{
+	if (*client == NULL) return ESP_ERR_INVALID_ARG;
+	http_pool_slot_t *slot = http_pool_slot(*client);
+
+	char url[MAX_HTTP_URL_LENGTH];
+	if (!http_pool_make_url(url, sizeof(url), path)) {
+		ESP_LOGE(TAG, "path is too long: %s", path);
+		return ESP_ERR_INVALID_SIZE;
+	}
+	ESP_LOGI(TAG, "url=[%s]",url);
+	http_pool_prepare(slot, url, method, post_len);
+
+	sqlite3_stats_begin(&slot->sample, method, path);
+	slot->deadline = slot->sample.started + slot->timeout_ms * 1000LL;
+	slot->timed_out = false;
+	esp_err_t err = ESP_FAIL;
+	for (int attempt=0;attempt<2;attempt++) {
+#if CONFIG_ESP_BREAKER_ENABLE
+		// The server is down: fail at once, the breaker probes it in the background
+		if (!http_breaker_allow()) {
+			err = ESP_ERR_NOT_ALLOWED;
+			break;
+		}
+#endif
+		bool reused = slot->connected;
+		err = http_pool_send(slot, post_data, post_len);
+		if (err == ESP_OK) {
+			int64_t written = esp_timer_get_time();
+			err = http_pool_wait_headers(&slot, method, url, content_length);
+			int64_t waited = esp_timer_get_time() - written;
+			slot->sample.phase_us[SQLITE3_STATS_WAIT] += waited;
+			if (err == ESP_OK) slot->sample.headers_us = waited;
+		}
+		atomic_fetch_add(&s_requests, 1);
+		if (err != ESP_OK && http_pool_remaining_ms(slot) == 0) err = http_pool_timed_out(slot);
+		if (err == ESP_OK || err == ESP_ERR_TIMEOUT) break;
+#if CONFIG_ESP_RESOLVER_ENABLE
+		if (err == ESP_ERR_HTTP_CONNECT && http_pool_readdress(slot, url, sizeof(url), path, method, post_len)) {
+			slot->sample.retries++;
+			continue;
+		}
+#endif
+		if (!reused) break;
+		ESP_LOGW(TAG, "kept-alive connection was closed by the server, reconnecting");
+		esp_http_client_close(slot->client);
+		slot->connected = false;
+		slot->sample.retries++;
+	}
+#if CONFIG_ESP_BREAKER_ENABLE
+	if (err != ESP_ERR_NOT_ALLOWED) http_breaker_report(err == ESP_OK);
+#endif
+	if (err == ESP_OK) slot->sample.status = esp_http_client_get_status_code(slot->client);
+	sqlite3_stats_heap(&slot->sample);
+	slot->open_err = err;
+	*client = slot->client;
+	return err;
+}
+
+esp_err_t http_pool_read(esp_http_client_handle_t client, char *buffer, int len, int *read)
+{
+	http_pool_slot_t *slot = http_pool_slot(client);
+	*read = 0;
+	if (http_pool_arm(slot, INT_MAX) == 0) return http_pool_timed_out(slot);
+	int rlen = esp_http_client_read(client, buffer, len);
+	// A read cut short by the socket timeout can look like the end of the body
+	if (http_pool_remaining_ms(slot) == 0 && (rlen < 0 || (rlen == 0 && !esp_http_client_is_complete_data_received(client)))) {
+		return http_pool_timed_out(slot);
+	}
+	if (rlen < 0) return ESP_FAIL;
+	*read = rlen;
+	return ESP_OK;
+}
+
+esp_err_t http_pool_read_response(esp_http_client_handle_t client, char *buffer, int len, int *read)
+{
+	*read = 0;
+	while (*read < len) {
+		int rlen;
+		esp_err_t err = http_pool_read(client, buffer + *read, len - *read, &rlen);
+		if (err != ESP_OK) return err;
+		if (rlen == 0) break;
+		*read += rlen;
+		if (esp_http_client_is_complete_data_received(client)) break;
+	}
+	return ESP_OK;
+}
+
+sqlite3_stats_sample_t *http_pool_sample(esp_http_client_handle_t client)
+{
+	return &http_pool_slot(client)->sample;
+}
+
+esp_err_t http_pool_set_header(esp_http_client_handle_t client, const char *key, const char *value)
+{
+	http_pool_slot_t *slot = http_pool_slot(client);
+	for (int i=0;i<MAX_HTTP_REQUEST_HEADERS;i++) {
+		if (slot->request_headers[i] == NULL || strcasecmp(slot->request_headers[i], key) == 0) {
+			slot->request_headers[i] = key;
+			slot->request_values[i] = value;
+			return esp_http_client_set_header(client, key, value);
+		}
+	}
+	return ESP_ERR_NO_MEM;
+}
+
+const char *http_pool_get_header(esp_http_client_handle_t client, const char *key)
+{
+	http_pool_slot_t *slot = http_pool_slot(client);
+	for (int i=0;i<CAPTURED_HEADERS;i++) {
+		if (strcasecmp(key, s_captured_headers[i]) == 0) {
+			return slot->headers[i][0] ? slot->headers[i] : NULL;
+		}
+	}
+	return NULL;
+}
+
+void http_pool_release(esp_http_client_handle_t client)
+{
+	if (client == NULL) return;
+	http_pool_slot_t *slot = http_pool_slot(client);
+	for (int i=0;i<MAX_HTTP_REQUEST_HEADERS && slot->request_headers[i];i++) {
+		esp_http_client_delete_header(client, slot->request_headers[i]);
+		slot->request_headers[i] = NULL;
+		slot->request_values[i] = NULL;
+	}
+	sqlite3_stats_end(&slot->sample, slot->open_err);
+	// A socket can only be reused when the whole response has been consumed
+	if (slot->server_close || !esp_http_client_is_complete_data_received(client)) {
+		esp_http_client_close(client);
+		slot->connected = false;
+	}
+	http_pool_vacate(slot);
+}
+
+/* Any answer to "GET /", whatever its status, shows that the server is back */
+esp_err_t http_pool_ping(void)
+{
+	http_pool_slot_t *slot = http_pool_claim(portMAX_DELAY, HTTP_POOL_PRIORITY_INTERACTIVE);
+	if (slot == NULL) return ESP_ERR_NO_MEM;
+	char url[MAX_HTTP_URL_LENGTH];
+	http_pool_make_url(url, sizeof(url), "");
+	http_pool_prepare(slot, url, HTTP_METHOD_GET, 0);
+	slot->deadline = esp_timer_get_time() + slot->timeout_ms * 1000LL;
+	slot->timed_out = false;
+	int64_t content_length;
+	esp_err_t err = http_pool_send(slot, NULL, 0);
+	if (err == ESP_OK) err = http_pool_wait(slot, INT_MAX, &content_length);
+	if (err == ESP_OK) esp_http_client_flush_response(slot->client, NULL);
+#if CONFIG_ESP_RESOLVER_ENABLE
+	// The server may have come back under another address
+	if (err == ESP_ERR_HTTP_CONNECT) http_resolver_invalidate();
+#endif
+	ESP_LOGI(TAG, "ping: %s", esp_err_to_name(err));
+	http_pool_release(slot->client);
+	return err;
+}
+
+void http_pool_get_counters(http_pool_counters_t *counters)
+{
+	counters->requests = atomic_load(&s_requests);
+	counters->connects = atomic_load(&s_connects);
+	counters->hedges = atomic_load(&s_hedges);
+	counters->timeouts = atomic_load(&s_timeouts);
+	counters->bytes_sent = atomic_load(&s_bytes_sent);
+	counters->bytes_received = atomic_load(&s_bytes_received);
+#if CONFIG_ESP_RESOLVER_ENABLE
+	counters->lookups = http_resolver_lookups();
+#else
+	counters->lookups = 0;
+#endif
+}
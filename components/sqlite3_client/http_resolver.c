@@ -0,0 +1,150 @@
+/* Resolved-address cache for the remote sqlite3 client
+ *
+ * This sample code is in the public domain.
+ */
+#include <stdatomic.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+
+#include "http_resolver.h"
+
+#define RESOLVER_REFRESH_SHARE 5    // the address is looked up again in the last fifth of its TTL
+#define RESOLVER_RETRY_MS 5000      // after a failed lookup the host name is used for this long
+
+static const char *TAG = "RESOLVER";
+
+static char s_host[64];
+static bool s_literal;              // the host is an address, there is nothing to look up
+static char s_address[HTTP_RESOLVER_ADDRESS_SIZE];
+static int64_t s_expires;           // 0 while no address is cached
+static int64_t s_retry_at;
+static atomic_uint s_lookups;
+static SemaphoreHandle_t s_mutex;   // guards the cached address
+static SemaphoreHandle_t s_lookup_mutex;    // one lookup at a time, concurrent misses wait for it
+static TaskHandle_t s_task;
+
+static esp_err_t http_resolver_resolve(char *address, size_t size)
+{
+	struct addrinfo hints = {
+		.ai_family = AF_INET,
+		.ai_socktype = SOCK_STREAM,
+	};
+	struct addrinfo *res = NULL;
+	int64_t started = esp_timer_get_time();
+	atomic_fetch_add(&s_lookups, 1);
+	int err = getaddrinfo(s_host, NULL, &hints, &res);
+	if (err != 0 || res == NULL) {
+		ESP_LOGW(TAG, "%s: lookup failed (%d)", s_host, err);
+		return ESP_FAIL;
+	}
+	inet_ntop(AF_INET, &((struct sockaddr_in *)res->ai_addr)->sin_addr, address, size);
+	freeaddrinfo(res);
+	ESP_LOGI(TAG, "%s is %s, looked up in %dms", s_host, address, (int)((esp_timer_get_time() - started) / 1000));
+	return ESP_OK;
+}
+
+/*
+ * Look the host up unless the cached address stays valid until stale_before, which another task
+ * may have seen to while this one waited. False when there is no valid address afterwards.
+ */
+static bool http_resolver_refresh(int64_t stale_before, char *address, size_t size)
+{
+	xSemaphoreTake(s_lookup_mutex, portMAX_DELAY);
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	bool fresh = s_expires > stale_before;
+	if (fresh) strlcpy(address, s_address, size);
+	xSemaphoreGive(s_mutex);
+
+	if (!fresh) {
+		char resolved[HTTP_RESOLVER_ADDRESS_SIZE];
+		esp_err_t err = http_resolver_resolve(resolved, sizeof(resolved));
+		int64_t now = esp_timer_get_time();
+		xSemaphoreTake(s_mutex, portMAX_DELAY);
+		if (err == ESP_OK) {
+			strlcpy(s_address, resolved, sizeof(s_address));
+			s_expires = now + CONFIG_ESP_RESOLVER_TTL_MS * 1000LL;
+			s_retry_at = 0;
+		} else {
+			// An address that is still valid is kept, the next try comes after RESOLVER_RETRY_MS
+			s_retry_at = now + RESOLVER_RETRY_MS * 1000LL;
+		}
+		fresh = s_expires > now;
+		if (fresh) strlcpy(address, s_address, size);
+		xSemaphoreGive(s_mutex);
+	}
+	xSemaphoreGive(s_lookup_mutex);
+	return fresh;
+}
+
+/* Look the address up again before it expires, and right away once it was invalidated */
+static void http_resolver_task(void *pvParameters)
+{
+	const int64_t margin = CONFIG_ESP_RESOLVER_TTL_MS * 1000LL / RESOLVER_REFRESH_SHARE;
+	while (1) {
+		xSemaphoreTake(s_mutex, portMAX_DELAY);
+		int64_t refresh_at = (s_expires > 0) ? s_expires - margin : 0;
+		if (refresh_at > 0 && s_retry_at > refresh_at) refresh_at = s_retry_at;
+		xSemaphoreGive(s_mutex);
+
+		TickType_t wait = portMAX_DELAY;
+		if (refresh_at > 0) {
+			int64_t remaining = refresh_at - esp_timer_get_time();
+			wait = (remaining > 0) ? pdMS_TO_TICKS((remaining + 999) / 1000) : 0;
+		}
+		ulTaskNotifyTake(pdTRUE, wait);
+		char address[HTTP_RESOLVER_ADDRESS_SIZE];
+		http_resolver_refresh(esp_timer_get_time() + margin, address, sizeof(address));
+	}
+}
+
+esp_err_t http_resolver_init(const char *host)
+{
+	strlcpy(s_host, host, sizeof(s_host));
+	struct in_addr addr;
+	s_literal = inet_pton(AF_INET, s_host, &addr) == 1;
+	if (s_literal) return ESP_OK;
+	s_mutex = xSemaphoreCreateMutex();
+	s_lookup_mutex = xSemaphoreCreateMutex();
+	if (s_mutex == NULL || s_lookup_mutex == NULL) return ESP_ERR_NO_MEM;
+	if (xTaskCreate(http_resolver_task, "RESOLVER", 1024*4, NULL, 2, &s_task) != pdPASS) return ESP_ERR_NO_MEM;
+	ESP_LOGI(TAG, "caching the address of %s for %dms", s_host, CONFIG_ESP_RESOLVER_TTL_MS);
+	return ESP_OK;
+}
+
+bool http_resolver_lookup(char *address, size_t size)
+{
+	if (s_literal) return false;
+	int64_t now = esp_timer_get_time();
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	bool cached = s_expires > now;
+	if (cached) strlcpy(address, s_address, size);
+	bool retry = now >= s_retry_at;
+	xSemaphoreGive(s_mutex);
+	if (cached) return true;
+	if (!retry) return false;
+	return http_resolver_refresh(now, address, size);
+}
+
+void http_resolver_invalidate(void)
+{
+	// Not initialised yet, e.g. a Wi-Fi event before http_pool_init(): there is nothing to forget
+	if (s_literal || s_mutex == NULL) return;
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	if (s_expires > 0) ESP_LOGW(TAG, "%s: forgetting %s", s_host, s_address);
+	s_address[0] = 0;
+	s_expires = 0;
+	xSemaphoreGive(s_mutex);
+	if (s_task) xTaskNotifyGive(s_task);
+}
+
+unsigned int http_resolver_lookups(void)
+{
+	return atomic_load(&s_lookups);
+}
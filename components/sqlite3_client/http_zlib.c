@@ -0,0 +1,145 @@
+/* gzip/deflate bodies for the remote sqlite3 client
+ *
+ * This sample code is in the public domain.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "esp_log.h"
+#include "zlib.h"
+
+#include "http_zlib.h"
+
+#define MAX_INFLATE_OUTPUT 512
+#define INFLATE_WINDOW_BITS 15      // what a sender may use; gzip and zlib are told apart by the header (+32)
+#define DEFLATE_WINDOW_BITS 10
+#define DEFLATE_MEM_LEVEL 4
+
+static const char *TAG = "HTTP_ZLIB";
+
+struct http_zlib_inflate {
+	z_stream stream;
+	bool started;
+	bool done;
+	http_zlib_output_cb_t output;
+	void *ctx;
+	unsigned char out[MAX_INFLATE_OUTPUT];
+};
+
+bool http_zlib_supported(const char *content_encoding)
+{
+	if (content_encoding == NULL) return false;
+	return strcasecmp(content_encoding, "gzip") == 0 || strcasecmp(content_encoding, "deflate") == 0;
+}
+
+http_zlib_inflate_handle_t http_zlib_inflate_create(http_zlib_output_cb_t output, void *ctx)
+{
+	http_zlib_inflate_handle_t decoder = calloc(1, sizeof(struct http_zlib_inflate));
+	if (decoder == NULL) return NULL;
+	if (inflateInit2(&decoder->stream, INFLATE_WINDOW_BITS + 32) != Z_OK) {
+		ESP_LOGE(TAG, "inflateInit2 failed");
+		free(decoder);
+		return NULL;
+	}
+	decoder->output = output;
+	decoder->ctx = ctx;
+	return decoder;
+}
+
+/* "Content-Encoding: deflate" is meant to be zlib format, but some servers send raw deflate */
+static bool http_zlib_has_header(const unsigned char *data, size_t len)
+{
+	if (len < 2) return true;
+	if (data[0] == 0x1f && data[1] == 0x8b) return true;
+	return (data[0] & 0x0f) == Z_DEFLATED && ((data[0] << 8) | data[1]) % 31 == 0;
+}
+
+esp_err_t http_zlib_inflate_feed(http_zlib_inflate_handle_t decoder, const char *data, size_t len)
+{
+	z_stream *stream = &decoder->stream;
+	if (!decoder->started) {
+		decoder->started = true;
+		if (!http_zlib_has_header((const unsigned char *)data, len)) inflateReset2(stream, -INFLATE_WINDOW_BITS);
+	}
+	if (decoder->done) return ESP_OK;
+
+	stream->next_in = (unsigned char *)data;
+	stream->avail_in = len;
+	do {
+		stream->next_out = decoder->out;
+		stream->avail_out = sizeof(decoder->out);
+		int ret = inflate(stream, Z_NO_FLUSH);
+		if (ret == Z_STREAM_END) {
+			decoder->done = true;
+		} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+			ESP_LOGE(TAG, "inflate failed: %s", stream->msg ? stream->msg : "corrupt data");
+			return ESP_ERR_INVALID_RESPONSE;
+		}
+		size_t out_len = sizeof(decoder->out) - stream->avail_out;
+		if (out_len > 0) {
+			esp_err_t err = decoder->output((const char *)decoder->out, out_len, decoder->ctx);
+			if (err != ESP_OK) return err;
+		}
+		// A full output buffer may mean more output is pending even without new input
+	} while (!decoder->done && (stream->avail_in > 0 || stream->avail_out == 0));
+	return ESP_OK;
+}
+
+esp_err_t http_zlib_inflate_finish(http_zlib_inflate_handle_t decoder)
+{
+	if (!decoder->done) {
+		ESP_LOGE(TAG, "truncated compressed response after %lu bytes", decoder->stream.total_out);
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+	ESP_LOGD(TAG, "inflated %lu bytes to %lu", decoder->stream.total_in, decoder->stream.total_out);
+	return ESP_OK;
+}
+
+void http_zlib_inflate_delete(http_zlib_inflate_handle_t decoder)
+{
+	if (decoder == NULL) return;
+	inflateEnd(&decoder->stream);
+	free(decoder);
+}
+
+esp_err_t http_zlib_deflate(const char *data, size_t len, char **out, size_t *out_len)
+{
+	z_stream stream = {0};
+	// Raw deflate with a small window, wrapped in a zlib header of our own:
+	// the header then reads 0x78 0x9c, which is what ArrestDB looks for, and a stream
+	// that only refers back 1 KB is valid for any decoder with a larger window
+	if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -DEFLATE_WINDOW_BITS, DEFLATE_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+		ESP_LOGE(TAG, "deflateInit2 failed");
+		return ESP_ERR_NO_MEM;
+	}
+	size_t size = deflateBound(&stream, len) + 6;
+	unsigned char *buffer = malloc(size);
+	if (buffer == NULL) {
+		deflateEnd(&stream);
+		return ESP_ERR_NO_MEM;
+	}
+	buffer[0] = 0x78;
+	buffer[1] = 0x9c;
+	stream.next_in = (unsigned char *)data;
+	stream.avail_in = len;
+	stream.next_out = buffer + 2;
+	stream.avail_out = size - 6;
+	int ret = deflate(&stream, Z_FINISH);
+	size_t compressed = stream.total_out;
+	deflateEnd(&stream);
+	if (ret != Z_STREAM_END || compressed + 6 >= len) {
+		free(buffer);
+		return ESP_ERR_INVALID_SIZE;
+	}
+	uLong adler = adler32(adler32(0L, Z_NULL, 0), (const unsigned char *)data, len);
+	unsigned char *trailer = buffer + 2 + compressed;
+	trailer[0] = adler >> 24;
+	trailer[1] = adler >> 16;
+	trailer[2] = adler >> 8;
+	trailer[3] = adler;
+	*out = (char *)buffer;
+	*out_len = compressed + 6;
+	ESP_LOGD(TAG, "deflated %u bytes to %u", (unsigned int)len, (unsigned int)*out_len);
+	return ESP_OK;
+}
@@ -0,0 +1,49 @@
+#ifndef CSV_STREAM_H_
+#define CSV_STREAM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/*
+ * Incremental parser for the compact CSV response mode:
+ * a header row with the column names, then one line per row (RFC 4180 quoting, "" for a quote).
+ * An empty unquoted field is NULL, "" is an empty string.
+ * Fields are unquoted and NUL terminated in place in the caller's row buffer as the bytes arrive,
+ * so every row is tokenized in a single pass without allocating.
+ * The header stays at the front of the buffer, so the names are valid for the whole response.
+ */
+#define CSV_STREAM_MAX_FIELDS 32
+
+typedef esp_err_t (*csv_stream_row_cb_t)(const char * const *names, const char * const *values, int count, void *ctx);
+
+typedef enum {
+	CSV_STREAM_FIELD_START,
+	CSV_STREAM_UNQUOTED,
+	CSV_STREAM_QUOTED,
+	CSV_STREAM_QUOTE,       // a quote inside a quoted field: the closing one, or the first of ""
+} csv_stream_state_t;
+
+typedef struct {
+	char *row;          // caller supplied buffer: the header, followed by the row being assembled
+	size_t row_size;
+	size_t row_len;
+	size_t header_len;
+	size_t field_start;
+	int offsets[CSV_STREAM_MAX_FIELDS];     // start of each field in row, -1 for NULL
+	int field_count;
+	const char *names[CSV_STREAM_MAX_FIELDS];
+	int name_count;     // 0 until the header was read
+	csv_stream_state_t state;
+	bool quoted;
+	bool overflow;
+	int rows;           // number of rows handed to the callback
+	csv_stream_row_cb_t callback;
+	void *ctx;
+} csv_stream_t;
+
+void csv_stream_init(csv_stream_t *stream, char *row_buffer, size_t row_size, csv_stream_row_cb_t callback, void *ctx);
+esp_err_t csv_stream_feed(csv_stream_t *stream, const char *data, size_t len);
+esp_err_t csv_stream_finish(csv_stream_t *stream);
+
+#endif /* CSV_STREAM_H_ */
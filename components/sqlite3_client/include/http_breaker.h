@@ -0,0 +1,23 @@
+#ifndef HTTP_BREAKER_H_
+#define HTTP_BREAKER_H_
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+ * Circuit breaker for the connection to the server.
+ * After CONFIG_ESP_BREAKER_FAILURES requests in a row did not get any response (connect errors, timeouts)
+ * the breaker opens: requests fail at once with ESP_ERR_NOT_ALLOWED instead of each waiting for its deadline,
+ * and a background task probes the server every CONFIG_ESP_BREAKER_PROBE_MS until it answers again.
+ * Callers then fall back on local state: writes are journaled, cached rows are served.
+ */
+typedef esp_err_t (*http_breaker_probe_t)(void);
+
+esp_err_t http_breaker_init(http_breaker_probe_t probe);
+
+/* False while the breaker is open */
+bool http_breaker_allow(void);
+/* Report the outcome of a request: answered is true when the server sent a response, whatever its status */
+void http_breaker_report(bool answered);
+
+#endif /* HTTP_BREAKER_H_ */
@@ -0,0 +1,38 @@
+#ifndef HTTP_BUFFER_H_
+#define HTTP_BUFFER_H_
+
+#include <stddef.h>
+#include "esp_err.h"
+
+/*
+ * Pool of reusable I/O buffers for the requests.
+ * Buffers come in power of two size classes from 512 bytes to 32 KB. A buffer handed back with http_buffer_put()
+ * is kept for the next request of its class, so after warming up requests no longer allocate.
+ * All pooled buffers, in use or kept, stay within CONFIG_ESP_BUFFER_BUDGET bytes: when a request would exceed it,
+ * kept buffers of other classes are released, and if that is not enough the request waits until another one
+ * hands its buffer back. After waiting CONFIG_ESP_HTTP_TIMEOUT_MS it gets a buffer from the heap beyond the budget,
+ * so that a task that already holds a buffer cannot block the others for good.
+ * With CONFIG_ESP_BUFFER_PSRAM the buffers are allocated in external RAM when there is any.
+ */
+esp_err_t http_buffer_init(void);
+
+/* A buffer of at least size bytes; NULL when size is beyond the largest class or memory ran out */
+void *http_buffer_get(size_t size);
+void http_buffer_put(void *buffer);
+
+/* Bytes and counts since boot, for benchmarks and the stats dump */
+typedef struct {
+	size_t budget;
+	size_t allocated;       // pooled buffers, in use or kept
+	size_t in_use;
+	size_t peak_allocated;  // high-water marks
+	size_t peak_in_use;
+	unsigned int gets;
+	unsigned int reused;    // gets served by a kept buffer
+	unsigned int waits;     // gets that had to wait for the budget
+	unsigned int over_budget;   // gets that waited too long and took heap memory
+} http_buffer_stats_t;
+
+void http_buffer_get_stats(http_buffer_stats_t *stats);
+
+#endif /* HTTP_BUFFER_H_ */
@@ -0,0 +1,89 @@
+#ifndef HTTP_POOL_H_
+#define HTTP_POOL_H_
+
+#include "esp_http_client.h"
+#include "sqlite3_stats.h"
+
+/*
+ * Small pool of persistent (HTTP/1.1 keep-alive) connections to the ArrestDB server given to http_pool_init().
+ * A connection is checked out with http_pool_acquire(), used for exactly one request
+ * with http_pool_open(), and handed back with http_pool_release().
+ * The socket stays open between requests unless the server asked to close it.
+ *
+ * Every request has a deadline, CONFIG_ESP_HTTP_TIMEOUT_MS from http_pool_open() to the last byte read
+ * with http_pool_read(); a request that misses it fails with ESP_ERR_TIMEOUT and its connection is closed.
+ * With CONFIG_ESP_HEDGE_ENABLE a GET whose headers are later than the p95 latency of the GETs so far
+ * is sent again on a second connection, and http_pool_open() replaces *client with the one that answered first.
+ * With CONFIG_ESP_BREAKER_ENABLE requests fail with ESP_ERR_NOT_ALLOWED while the server is down (see http_breaker.h).
+ * With CONFIG_ESP_RESOLVER_ENABLE connections go to the cached address of the server (see http_resolver.h);
+ * a connect failure makes it look the server up again.
+ *
+ * With CONFIG_ESP_HTTPS_ENABLE connections are TLS. As they are kept alive, a handshake is only made when a
+ * connection is opened, and with CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS each connection keeps its TLS session
+ * (ticket or session ID), so reopening it, also after a Wi-Fi reconnect, resumes the session instead of
+ * a full handshake. The certificate is checked for the name given to http_pool_init(), not the cached address.
+ *
+ * Connections are handed out by priority class. Interactive requests take any free connection, and
+ * waiting ones are served before background ones. Background requests (uploads, replays, syncs) hold at most
+ * CONFIG_ESP_HTTP_BACKGROUND_SLOTS connections, so one is left for interactive reads unless the pool has only one,
+ * and are limited to CONFIG_ESP_HTTP_BACKGROUND_RATE per second, in bursts of up to one second's worth.
+ */
+typedef enum {
+	HTTP_POOL_PRIORITY_INTERACTIVE,
+	HTTP_POOL_PRIORITY_BACKGROUND,
+	HTTP_POOL_PRIORITIES,
+} http_pool_priority_t;
+
+esp_err_t http_pool_init(const char *server, int port);
+
+#if CONFIG_ESP_HTTPS_ENABLE
+/*
+ * PEM certificate the server's certificate must be signed with (or be), e.g. a self-signed one embedded
+ * in the application; it must stay valid. Without one the server is verified against the CA bundle.
+ * Call before http_pool_init().
+ */
+void http_pool_set_server_cert(const char *cert_pem);
+#endif
+esp_http_client_handle_t http_pool_acquire(http_pool_priority_t priority);
+esp_err_t http_pool_open(esp_http_client_handle_t *client, esp_http_client_method_t method, const char *path, const char *post_data, int post_len, int64_t *content_length);
+void http_pool_release(esp_http_client_handle_t client);
+
+/* Send "GET /" past the breaker: ESP_OK when the server answered, whatever the status */
+esp_err_t http_pool_ping(void);
+
+/* Deadline of the next request on this connection; 0 restores CONFIG_ESP_HTTP_TIMEOUT_MS */
+void http_pool_set_timeout(esp_http_client_handle_t client, int timeout_ms);
+
+/*
+ * esp_http_client_read() and esp_http_client_read_response() bounded by the request's deadline.
+ * *read is 0 at the end of the body; ESP_ERR_TIMEOUT once the deadline passed.
+ */
+esp_err_t http_pool_read(esp_http_client_handle_t client, char *buffer, int len, int *read);
+esp_err_t http_pool_read_response(esp_http_client_handle_t client, char *buffer, int len, int *read);
+
+/*
+ * Add a request header for the next request only; it is removed again by http_pool_release().
+ * key must be a string literal, and value must stay valid until http_pool_open() returned.
+ */
+esp_err_t http_pool_set_header(esp_http_client_handle_t client, const char *key, const char *value);
+
+/* Value of a response header of the current request (ETag, Last-Modified, Location, Content-Type, Content-Encoding), NULL when absent */
+const char *http_pool_get_header(esp_http_client_handle_t client, const char *key);
+
+/* Timing and counters of the current request; the caller adds the read and decode phases */
+sqlite3_stats_sample_t *http_pool_sample(esp_http_client_handle_t client);
+
+/* Totals since boot, for benchmarks: connections opened, hedged and timed out requests, body bytes sent and received, server lookups */
+typedef struct {
+	unsigned int requests;
+	unsigned int connects;
+	unsigned int hedges;
+	unsigned int timeouts;
+	uint64_t bytes_sent;
+	uint64_t bytes_received;
+	unsigned int lookups;
+} http_pool_counters_t;
+
+void http_pool_get_counters(http_pool_counters_t *counters);
+
+#endif /* HTTP_POOL_H_ */
@@ -0,0 +1,34 @@
+#ifndef HTTP_RESOLVER_H_
+#define HTTP_RESOLVER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define HTTP_RESOLVER_ADDRESS_SIZE 16   // "255.255.255.255"
+
+/*
+ * Cache of the server's IPv4 address, so that requests do not pay for a DNS or mDNS lookup
+ * ("httpserver.local") every time a connection is opened.
+ * The address is looked up on first use and kept for CONFIG_ESP_RESOLVER_TTL_MS. A background task
+ * looks it up again shortly before it expires, so requests keep using the old address meanwhile.
+ * When the host given to http_resolver_init() already is an address, nothing is cached.
+ *
+ * The URLs then carry the address, while http_pool keeps the name in the Host header for virtual hosts
+ * and reverse proxies in front of ArrestDB.
+ */
+esp_err_t http_resolver_init(const char *host);
+
+/*
+ * Copy the address of the host into address, looking it up when none is cached.
+ * False when the host is an address itself or could not be resolved; the caller then uses the host name.
+ */
+bool http_resolver_lookup(char *address, size_t size);
+
+/* Forget the cached address and look it up again in the background, e.g. after a connect failure or a Wi-Fi reconnect */
+void http_resolver_invalidate(void);
+
+/* Lookups since boot, for benchmarks */
+unsigned int http_resolver_lookups(void);
+
+#endif /* HTTP_RESOLVER_H_ */
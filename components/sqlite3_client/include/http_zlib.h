@@ -0,0 +1,36 @@
+#ifndef HTTP_ZLIB_H_
+#define HTTP_ZLIB_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/*
+ * Compressed bodies.
+ * A response with "Content-Encoding: gzip" or "deflate" is inflated chunk by chunk:
+ * every chunk read from the socket goes in, and the decoded bytes come out to the callback
+ * in pieces of a fixed size, so the row parsers see the same small chunks as for a plain body.
+ * Inflating needs the 32 KB window the sender may refer back to, plus about 7 KB of state.
+ */
+typedef esp_err_t (*http_zlib_output_cb_t)(const char *data, size_t len, void *ctx);
+
+typedef struct http_zlib_inflate *http_zlib_inflate_handle_t;
+
+/* True when a response with this Content-Encoding can be inflated */
+bool http_zlib_supported(const char *content_encoding);
+
+http_zlib_inflate_handle_t http_zlib_inflate_create(http_zlib_output_cb_t output, void *ctx);
+esp_err_t http_zlib_inflate_feed(http_zlib_inflate_handle_t decoder, const char *data, size_t len);
+/* ESP_ERR_INVALID_RESPONSE when the compressed stream was cut short */
+esp_err_t http_zlib_inflate_finish(http_zlib_inflate_handle_t decoder);
+void http_zlib_inflate_delete(http_zlib_inflate_handle_t decoder);
+
+/*
+ * Compress a request body into zlib format, which ArrestDB inflates on its own
+ * (it checks for the zlib header, no Content-Encoding is needed).
+ * A 1 KB window keeps the encoder at about 18 KB of heap.
+ * *out is allocated and must be freed; ESP_ERR_INVALID_SIZE when the result would not be smaller.
+ */
+esp_err_t http_zlib_deflate(const char *data, size_t len, char **out, size_t *out_len);
+
+#endif /* HTTP_ZLIB_H_ */
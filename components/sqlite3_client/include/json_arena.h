@@ -0,0 +1,27 @@
+#ifndef JSON_ARENA_H_
+#define JSON_ARENA_H_
+
+#include <stddef.h>
+#include "esp_err.h"
+
+/*
+ * Bump allocator for cJSON trees.
+ * json_arena_init() installs cJSON hooks once. Between json_arena_begin() and json_arena_end()
+ * the calling task takes cJSON nodes from the arena; other tasks are not affected.
+ * cJSON_Delete() on arena nodes costs nothing, and json_arena_reset() releases them all at once.
+ * When an arena is full, nodes come from the heap as usual; cJSON_Delete() frees those,
+ * so a tree must still be deleted, between begin and end, before the arena is reset.
+ */
+typedef struct json_arena json_arena_t;
+
+esp_err_t json_arena_init(void);
+
+/* NULL when out of memory; all functions below accept NULL and then leave allocation to the heap */
+json_arena_t *json_arena_create(size_t size);
+void json_arena_delete(json_arena_t *arena);
+
+void json_arena_begin(json_arena_t *arena);
+void json_arena_end(json_arena_t *arena);
+void json_arena_reset(json_arena_t *arena);
+
+#endif /* JSON_ARENA_H_ */
@@ -0,0 +1,50 @@
+#ifndef JSON_STREAM_H_
+#define JSON_STREAM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/*
+ * Incremental splitter for ArrestDB responses.
+ * The body is fed chunk by chunk and every top level object, either the elements of
+ * "[ {...}, {...} ]" or a single "{...}", is handed to the callback as compact JSON text.
+ * Only one row is held in memory at a time.
+ */
+typedef esp_err_t (*json_stream_row_cb_t)(const char *row, size_t row_len, void *ctx);
+/* Projection: true to keep the member of a row whose key is the first key_len bytes of key (not NUL terminated) */
+typedef bool (*json_stream_key_cb_t)(const char *key, size_t key_len, void *ctx);
+
+typedef struct {
+	char *row;          // caller supplied buffer for the row being assembled
+	size_t row_size;
+	size_t row_len;
+	int row_depth;      // nesting depth at which rows start, -1 until the first token is seen
+	int depth;
+	bool in_string;
+	bool escape;
+	bool capturing;
+	bool overflow;
+	int rows;           // number of rows handed to the callback
+	json_stream_row_cb_t callback;
+	void *ctx;
+	json_stream_key_cb_t keep;  // NULL keeps every member
+	void *keep_ctx;
+	bool expect_key;    // the next string at member level is a key
+	bool in_key;
+	bool skipping;      // the member being read is dropped
+	size_t member_start;
+	int members;        // members kept in the current row
+} json_stream_t;
+
+void json_stream_init(json_stream_t *stream, char *row_buffer, size_t row_size, json_stream_row_cb_t callback, void *ctx);
+/*
+ * Drop the members of every row whose key keep() rejects, while the row is assembled:
+ * they take no room in the row buffer, so rows with large unwanted columns still fit.
+ * Only the top level members of a row are filtered.
+ */
+void json_stream_project(json_stream_t *stream, json_stream_key_cb_t keep, void *ctx);
+esp_err_t json_stream_feed(json_stream_t *stream, const char *data, size_t len);
+esp_err_t json_stream_finish(json_stream_t *stream);
+
+#endif /* JSON_STREAM_H_ */
@@ -0,0 +1,83 @@
+#ifndef SQLITE3_AGGREGATE_H_
+#define SQLITE3_AGGREGATE_H_
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+/*
+ * Streaming aggregates: count, sum, min, max and avg, optionally grouped by a column.
+ * Rows are folded into one accumulator per group as they arrive and dropped right away, so memory
+ * grows with the number of groups, never with the number of rows:
+ *
+ *   static const sqlite3_aggregate_column_t columns[] = {
+ *       { SQLITE3_AGGREGATE_COUNT, NULL },      // count(*)
+ *       { SQLITE3_AGGREGATE_MAX, "id" },
+ *   };
+ *   sqlite3_aggregate_config_t config = {
+ *       .table = "customers",
+ *       .group_by = "gender",
+ *       .columns = columns,
+ *       .column_count = 2,
+ *   };
+ *   sqlite3_aggregate(&config, callback, ctx);
+ *
+ * sqlite3_aggregate_scan() reads the table in pages ordered by id, CONFIG_ESP_CURSOR_PAGE_SIZE rows per request,
+ * projected to the columns it needs. Rows added or deleted by others during the scan may be missed or
+ * counted twice, as with sqlite3_cursor.
+ *
+ * As in SQL, null and missing values are left out: count(column) counts the rows that have a value,
+ * and sum, min, max and avg only take numbers (also numbers sent as strings). An aggregate without
+ * any value is NAN. Rows whose group column is null or missing form one group, named NULL.
+ */
+#define SQLITE3_AGGREGATE_MAX_COLUMNS 6
+
+typedef enum {
+	SQLITE3_AGGREGATE_COUNT,
+	SQLITE3_AGGREGATE_SUM,
+	SQLITE3_AGGREGATE_MIN,
+	SQLITE3_AGGREGATE_MAX,
+	SQLITE3_AGGREGATE_AVG,
+} sqlite3_aggregate_op_t;
+
+typedef struct {
+	sqlite3_aggregate_op_t op;
+	const char *column;     // NULL only for SQLITE3_AGGREGATE_COUNT, to count rows
+} sqlite3_aggregate_column_t;
+
+/* The strings and the columns array must stay valid as long as the aggregate is used */
+typedef struct {
+	const char *table;      // table name, e.g. "customers"
+	const char *where;      // optional filter column, e.g. "day"
+	const char *equals;     // its value, e.g. "2024-05-01"
+	const char *group_by;   // column to group by, NULL for one group over all rows
+	const sqlite3_aggregate_column_t *columns;
+	int column_count;       // up to SQLITE3_AGGREGATE_MAX_COLUMNS
+	int page_size;          // rows per request, 0 for CONFIG_ESP_CURSOR_PAGE_SIZE
+	int max_groups;         // 0 for CONFIG_ESP_AGGREGATE_MAX_GROUPS
+} sqlite3_aggregate_config_t;
+
+typedef struct sqlite3_aggregate *sqlite3_aggregate_handle_t;
+
+/* One call per group, in ascending order of the group names (NULL first); values[i] is the result of columns[i] */
+typedef esp_err_t (*sqlite3_aggregate_cb_t)(const char *group, int rows, const double *values, void *ctx);
+
+esp_err_t sqlite3_aggregate_create(const sqlite3_aggregate_config_t *config, sqlite3_aggregate_handle_t *aggregate);
+
+/*
+ * Fold one row in; a sqlite3_client_row_cb_t, so any read can feed the aggregate:
+ *   sqlite3_client_get_rows("customers/gender/2", sqlite3_aggregate_row, aggregate);
+ * Fails with ESP_ERR_INVALID_SIZE when the row would start a group beyond max_groups.
+ */
+esp_err_t sqlite3_aggregate_row(const cJSON *row, void *aggregate);
+
+/* Fold in every row of the table that matches the filter, page by page */
+esp_err_t sqlite3_aggregate_scan(sqlite3_aggregate_handle_t aggregate);
+
+/* Hand the current results to the callback; more rows can be folded in afterwards */
+esp_err_t sqlite3_aggregate_results(sqlite3_aggregate_handle_t aggregate, sqlite3_aggregate_cb_t callback, void *ctx);
+void sqlite3_aggregate_delete(sqlite3_aggregate_handle_t aggregate);
+
+/* Create, scan, hand over the results and delete */
+esp_err_t sqlite3_aggregate(const sqlite3_aggregate_config_t *config, sqlite3_aggregate_cb_t callback, void *ctx);
+
+#endif /* SQLITE3_AGGREGATE_H_ */
@@ -0,0 +1,47 @@
+#ifndef SQLITE3_ASYNC_H_
+#define SQLITE3_ASYNC_H_
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "esp_http_client.h"
+#include "cJSON.h"
+
+#include "sqlite3_client.h"
+
+/*
+ * Asynchronous requests.
+ * A request is queued and run by one of CONFIG_ESP_ASYNC_WORKERS worker tasks, so a caller
+ * can keep several requests in flight. Each submit function copies its arguments and returns
+ * a handle, or NULL when the queue is full or memory ran out. It never blocks.
+ *
+ * A request runs with the priority class of the task that submitted it (sqlite3_client_set_priority()).
+ * Interactive requests are run before queued background ones, and with more than one worker
+ * the first worker only runs interactive requests.
+ *
+ * With a done callback the handle is freed after the callback returns.
+ * Without one the handle is a future: wait for it with sqlite3_async_wait(),
+ * then free it with sqlite3_async_free().
+ */
+typedef struct sqlite3_async_request *sqlite3_async_handle_t;
+
+/* Runs in the worker task. The result getters below may be used on the handle. */
+typedef void (*sqlite3_async_done_cb_t)(sqlite3_async_handle_t handle, esp_err_t result, void *ctx);
+
+esp_err_t sqlite3_async_init(void);
+
+/* sqlite3_client_get_rows(); row_callback runs in the worker task */
+sqlite3_async_handle_t sqlite3_async_get_rows(const char * path, sqlite3_client_row_cb_t row_callback, void *row_ctx, sqlite3_async_done_cb_t done, void *ctx);
+/* sqlite3_client_send() */
+sqlite3_async_handle_t sqlite3_async_send(esp_http_client_method_t method, const char * path, const char * data, int data_len, sqlite3_async_done_cb_t done, void *ctx);
+/* sqlite3_client_create(); the id and the row are read back with the getters below */
+sqlite3_async_handle_t sqlite3_async_create(const char * table, const char * data, int data_len, sqlite3_async_done_cb_t done, void *ctx);
+
+/* Wait until the request finished and store its result; ESP_ERR_TIMEOUT if it did not finish in time */
+esp_err_t sqlite3_async_wait(sqlite3_async_handle_t handle, TickType_t timeout, esp_err_t *result);
+void sqlite3_async_free(sqlite3_async_handle_t handle);
+
+/* Result of sqlite3_async_create(): the new id (-1 if none), and the row, which the caller then owns */
+int sqlite3_async_id(sqlite3_async_handle_t handle);
+cJSON *sqlite3_async_take_row(sqlite3_async_handle_t handle);
+
+#endif /* SQLITE3_ASYNC_H_ */
@@ -0,0 +1,43 @@
+#ifndef SQLITE3_CACHE_H_
+#define SQLITE3_CACHE_H_
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "cJSON.h"
+
+/*
+ * Bounded LRU cache of decoded rows, keyed by table and primary key ("customers/3").
+ * An entry is served without a request until its table's TTL expires; after that it is
+ * revalidated with If-None-Match / If-Modified-Since when the server sent ETag / Last-Modified.
+ */
+#define SQLITE3_CACHE_MAX_VALIDATOR 64
+
+typedef struct sqlite3_cache_row *sqlite3_cache_row_handle_t;
+
+esp_err_t sqlite3_cache_init(void);
+void sqlite3_cache_set_ttl(const char *table, int ttl_ms);
+
+/* Split a point lookup path "table/id" into its key. Returns false for any other path. */
+bool sqlite3_cache_key(const char *path, char *table, size_t table_size, int *id);
+
+/*
+ * Look a row up. On a hit the row is referenced until sqlite3_cache_release(),
+ * *fresh tells whether the TTL is still running, and the validators are copied
+ * (empty strings when the server sent none).
+ * Expired rows are returned too, so that they can be served while the server is unreachable;
+ * an entry only goes away when it is stored again, invalidated or evicted.
+ */
+sqlite3_cache_row_handle_t sqlite3_cache_lookup(const char *table, int id, bool *fresh, char *etag, char *last_modified);
+const cJSON *sqlite3_cache_row(sqlite3_cache_row_handle_t row);
+void sqlite3_cache_release(sqlite3_cache_row_handle_t row);
+
+/* Store a row; the cache takes ownership of the cJSON tree. Validators may be NULL. */
+void sqlite3_cache_store(const char *table, int id, cJSON *row, const char *etag, const char *last_modified);
+
+/* Restart the TTL after the server answered 304 Not Modified */
+void sqlite3_cache_touch(const char *table, int id);
+
+/* Drop one row, or all rows of the table when id < 0 */
+void sqlite3_cache_invalidate(const char *table, int id);
+
+#endif /* SQLITE3_CACHE_H_ */
@@ -0,0 +1,115 @@
+#ifndef SQLITE3_CLIENT_H_
+#define SQLITE3_CLIENT_H_
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_http_client.h"
+#include "cJSON.h"
+
+#include "http_pool.h"
+#include "json_stream.h"
+#include "sqlite3_query.h"
+#include "sqlite3_schema.h"
+
+typedef esp_err_t (*sqlite3_client_row_cb_t)(const cJSON *row, void *ctx);
+
+void JSON_Record(const cJSON * const array);
+char *JSON_Types(int type);
+void JSON_Print(const cJSON * const root);
+void JSON_Analyze(const cJSON * const root);
+
+/*
+ * Stream the rows of a GET response.
+ * sqlite3_client_get_raw() hands every row to the callback as compact JSON text,
+ * sqlite3_client_get_rows() parses each row before calling the callback.
+ * Both return ESP_ERR_NOT_FOUND when ArrestDB answers 404.
+ * With CONFIG_ESP_COALESCE_ENABLE, sqlite3_client_get_rows() calls for a path that is already
+ * being read by another task wait for that request and get its rows (see sqlite3_flight.h).
+ * With CONFIG_ESP_REPLICA_ENABLE, every read of a mirrored table that the replica can answer,
+ * typed reads and queries included, is served locally (see sqlite3_replica.h).
+ */
+esp_err_t sqlite3_client_get_raw(const char * path, json_stream_row_cb_t callback, void *ctx);
+esp_err_t sqlite3_client_get_rows(const char * path, sqlite3_client_row_cb_t callback, void *ctx);
+
+/*
+ * sqlite3_client_get_rows() on a path made with the query builder (sqlite3_query.h).
+ * With a projection only the selected columns reach the callback; such a read always goes
+ * to the server, since the row cache and coalesced reads hold whole rows.
+ * Returns the builder's error when the query could not be built.
+ */
+esp_err_t sqlite3_client_query(const sqlite3_query_t *query, sqlite3_client_row_cb_t callback, void *ctx);
+
+/*
+ * Read rows straight into structs described by schema, without cJSON.
+ * sqlite3_client_get_records() fills an array of up to max_records records and sets *count;
+ * rows beyond max_records are read and dropped.
+ * sqlite3_client_get_each() decodes every row into the one record and calls the callback with it.
+ * With CONFIG_ESP_CSV_ENABLE they ask for the compact CSV response mode (Accept: text/csv)
+ * and fall back to JSON when the server does not support it.
+ * JSON rows are reduced to the columns of the schema while they are read, so only those count
+ * against CONFIG_ESP_JSON_MAX_ROW_SIZE.
+ */
+typedef esp_err_t (*sqlite3_client_record_cb_t)(const void *record, void *ctx);
+
+esp_err_t sqlite3_client_get_records(const char * path, const sqlite3_schema_t *schema, void *records, int max_records, int *count);
+esp_err_t sqlite3_client_get_each(const char * path, const sqlite3_schema_t *schema, void *record, sqlite3_client_record_cb_t callback, void *ctx);
+
+/*
+ * Send a request with an optional JSON body (POST/PUT/DELETE).
+ * A JSON array posted to a table inserts all rows in one transaction.
+ * sqlite3_client_send() journals the write when the server is unreachable and returns ESP_ERR_NOT_FINISHED,
+ * sqlite3_client_request() always goes to the server.
+ * sqlite3_client_send() also applies PUT and DELETE to the local replica of the table, if there is one.
+ */
+esp_err_t sqlite3_client_send(esp_http_client_method_t method, const char * path, const char * data, int data_len);
+esp_err_t sqlite3_client_request(esp_http_client_method_t method, const char * path, const char * data, int data_len);
+
+/*
+ * Called by the write-ahead queue once the server answered a journaled write with err:
+ * drops the cached rows it changed, has the replica fetch replayed inserts, and copies a mirrored table
+ * again when a write it took was rejected.
+ */
+void sqlite3_client_replayed(esp_http_client_method_t method, const char * path, const char * data, int data_len, esp_err_t err);
+
+/*
+ * Insert one row (a JSON object) into table and return its primary key in *id.
+ * The id is taken from the insert response ({"id": 5} or the stored row) or from a Location header;
+ * only when the server sends neither is the row looked up by its posted values.
+ * When row is not NULL it receives the new row, to be freed with cJSON_Delete();
+ * if the server did not return it, it holds the posted columns and the id.
+ * Returns ESP_ERR_NOT_FINISHED, with *id = -1, when the insert was journaled for replay.
+ */
+esp_err_t sqlite3_client_create(const char * table, const char * data, int data_len, int *id, cJSON **row);
+
+/*
+ * True when err means that the server could not be reached, as opposed to an error answered by ArrestDB:
+ * a transport error, ESP_ERR_TIMEOUT when the request missed its deadline,
+ * or ESP_ERR_NOT_ALLOWED while the circuit breaker is open.
+ */
+bool sqlite3_client_unreachable(esp_err_t err);
+
+/*
+ * Deadline of every request the calling task sends from now on, from sending it to the last byte of the answer.
+ * 0 restores CONFIG_ESP_HTTP_TIMEOUT_MS.
+ */
+void sqlite3_client_set_timeout(int timeout_ms);
+
+/*
+ * Priority class of every request the calling task sends from now on, HTTP_POOL_PRIORITY_INTERACTIVE by default.
+ * The write-ahead queue, the replica and bulk inserts send theirs as HTTP_POOL_PRIORITY_BACKGROUND (see http_pool.h).
+ */
+void sqlite3_client_set_priority(http_pool_priority_t priority);
+http_pool_priority_t sqlite3_client_get_priority(void);
+
+esp_err_t sqlite3_client_get(char * path);
+esp_err_t sqlite3_client_post(char * path, char * name, int gender);
+esp_err_t sqlite3_client_put(char * path, char * name, int gender);
+esp_err_t sqlite3_client_delete(char * path);
+
+/* The primary key of a row, given as a JSON number or as a numeric string; -1 when it has none */
+int sqlite3_client_row_id(const cJSON *row);
+
+/* Largest id in the table. Another client may insert in between, use sqlite3_client_create() to learn a new row's id. */
+int sqlite3_client_get_maxid(char * path);
+
+#endif /* SQLITE3_CLIENT_H_ */
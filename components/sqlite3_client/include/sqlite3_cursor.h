@@ -0,0 +1,31 @@
+#ifndef SQLITE3_CURSOR_H_
+#define SQLITE3_CURSOR_H_
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+/*
+ * Walk a table page by page with ArrestDB's limit/offset/by/order parameters.
+ * While the application works on page N, a background task already fetches page N+1.
+ */
+typedef struct sqlite3_cursor *sqlite3_cursor_handle_t;
+
+typedef struct {
+	const char *table;      // table name, e.g. "customers"
+	const char *by;         // column to order by, NULL for "id"
+	const char *order;      // "asc" or "desc", NULL for "asc"
+	int page_size;          // rows per request, 0 for CONFIG_ESP_CURSOR_PAGE_SIZE
+} sqlite3_cursor_config_t;
+
+esp_err_t sqlite3_cursor_open(const sqlite3_cursor_config_t *config, sqlite3_cursor_handle_t *cursor);
+
+/*
+ * Return the next row in *row. The row is owned by the cursor and stays valid until the next call.
+ * Returns ESP_ERR_NOT_FOUND after the last row.
+ * When a page could not be read its error is returned; the page is requested again,
+ * so calling again retries it without skipping any rows.
+ */
+esp_err_t sqlite3_cursor_next(sqlite3_cursor_handle_t cursor, const cJSON **row);
+void sqlite3_cursor_close(sqlite3_cursor_handle_t cursor);
+
+#endif /* SQLITE3_CURSOR_H_ */
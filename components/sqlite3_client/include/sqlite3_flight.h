@@ -0,0 +1,41 @@
+#ifndef SQLITE3_FLIGHT_H_
+#define SQLITE3_FLIGHT_H_
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "cJSON.h"
+
+/*
+ * Request coalescing ("single flight") for reads.
+ * While a GET for a path is in flight, the same GET from other tasks joins it instead of
+ * going to the server: the leader keeps a copy of the rows it decodes, and the followers
+ * are handed that shared result when it completes. The result is reference counted and
+ * freed by whoever lets go of it last.
+ * Results over CONFIG_ESP_COALESCE_MAX_ROWS rows are not kept; the followers then send their own request.
+ */
+typedef struct sqlite3_flight *sqlite3_flight_handle_t;
+
+esp_err_t sqlite3_flight_init(void);
+
+/*
+ * Join the flight for path, or start one when none is in the air (*leader is then true).
+ * The path is normalized first, so "/customers/" and "customers" share a flight.
+ * NULL when the request cannot be coalesced (path too long, all flights taken, no memory).
+ */
+sqlite3_flight_handle_t sqlite3_flight_join(const char *path, bool *leader);
+
+/* Leader: keep a copy of a decoded row for the followers */
+void sqlite3_flight_add_row(sqlite3_flight_handle_t flight, const cJSON *row);
+/* Leader: land the flight with the request's result; complete is false when not all rows were read */
+void sqlite3_flight_complete(sqlite3_flight_handle_t flight, esp_err_t err, bool complete);
+
+/*
+ * Follower: wait for the leader and get the shared rows (a cJSON array, valid until release).
+ * Returns the leader's error, or ESP_ERR_INVALID_STATE when its rows were not kept.
+ */
+esp_err_t sqlite3_flight_wait(sqlite3_flight_handle_t flight, const cJSON **rows);
+
+/* Leader and followers: let go of the flight */
+void sqlite3_flight_release(sqlite3_flight_handle_t flight);
+
+#endif /* SQLITE3_FLIGHT_H_ */
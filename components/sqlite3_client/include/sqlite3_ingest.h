@@ -0,0 +1,29 @@
+#ifndef SQLITE3_INGEST_H_
+#define SQLITE3_INGEST_H_
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+/*
+ * Buffered bulk inserts.
+ * Any task, or an ISR, queues rows (one JSON object each) into a ring buffer without blocking.
+ * A flusher task drains the ring and inserts the rows as one JSON array per POST,
+ * as soon as batch_rows rows are queued or flush_ms after the oldest queued row.
+ * The POSTs are background requests, so they do not hold up interactive reads (see http_pool.h).
+ */
+typedef struct sqlite3_ingest *sqlite3_ingest_handle_t;
+
+typedef struct {
+	const char *table;      // table to insert into, e.g. "customers"
+	size_t ring_size;       // bytes, 0 for CONFIG_ESP_INGEST_RING_SIZE
+	int batch_rows;         // rows per POST, 0 for CONFIG_ESP_INGEST_BATCH_ROWS
+	int flush_ms;           // deadline for a partial batch, 0 for CONFIG_ESP_INGEST_FLUSH_MS
+} sqlite3_ingest_config_t;
+
+esp_err_t sqlite3_ingest_create(const sqlite3_ingest_config_t *config, sqlite3_ingest_handle_t *ingest);
+
+/* Returns ESP_ERR_NO_MEM when the ring is full. Never blocks. */
+esp_err_t sqlite3_ingest_put(sqlite3_ingest_handle_t ingest, const char *row);
+esp_err_t sqlite3_ingest_put_from_isr(sqlite3_ingest_handle_t ingest, const char *row, BaseType_t *higher_priority_task_woken);
+
+#endif /* SQLITE3_INGEST_H_ */
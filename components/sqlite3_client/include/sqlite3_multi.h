@@ -0,0 +1,25 @@
+#ifndef SQLITE3_MULTI_H_
+#define SQLITE3_MULTI_H_
+
+#include "esp_err.h"
+#include "cJSON.h"
+
+/*
+ * Read a set of rows by primary key.
+ * The keys are sorted and each is handed to the callback once, in ascending order,
+ * with its row, or with NULL when the table has no such row.
+ *
+ * A dense key set (the keys span at most twice as many ids as there are keys) is read with one
+ * ordered range scan, "table?by=id&order=asc&limit=<span>&offset=<first key - 1>", which lands on the first key
+ * as long as no rows below it were deleted. Keys the scan did not reach, and sparse key sets, are read
+ * with point lookups, CONFIG_ESP_MULTI_CONCURRENCY of them at a time on the sqlite3_async workers
+ * (sqlite3_async_init() must have been called), so they can be served by the row cache and the replica.
+ *
+ * The callback runs in the calling task. Rows of a point lookup, and of a range scan that did not start
+ * at the first key, are held until their turn comes.
+ */
+typedef esp_err_t (*sqlite3_multi_row_cb_t)(int id, const cJSON *row, void *ctx);
+
+esp_err_t sqlite3_multi_get(const char * table, const int *ids, int count, sqlite3_multi_row_cb_t callback, void *ctx);
+
+#endif /* SQLITE3_MULTI_H_ */
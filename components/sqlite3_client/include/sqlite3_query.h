@@ -0,0 +1,69 @@
+#ifndef SQLITE3_QUERY_H_
+#define SQLITE3_QUERY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/*
+ * Query builder for ArrestDB paths.
+ * ArrestDB filters on one column ("table/column/value", or "table/id" by primary key), and sorts and pages
+ * with the by, order, limit and offset parameters. The builder writes them into a fixed buffer,
+ * percent-encoding every name and value, and the calls must come in this order:
+ *
+ *   sqlite3_query_t query;
+ *   sqlite3_query_init(&query, "customers");
+ *   sqlite3_query_where(&query, "name", "Tom & Jerry");
+ *   sqlite3_query_order(&query, "id", true);
+ *   sqlite3_query_limit(&query, 10, 0);
+ *   sqlite3_query_select(&query, "id");
+ *   sqlite3_query_select(&query, "name");
+ *   sqlite3_client_query(&query, callback, ctx);
+ *
+ * reads "customers/name/Tom%20%26%20Jerry?by=id&order=desc&limit=10" and hands over rows with only id and name.
+ * Errors stick: after a failed call the later ones do nothing and sqlite3_query_path() returns NULL,
+ * so a chain of calls can be checked once at the end.
+ *
+ * ArrestDB always sends whole rows, so the projection (sqlite3_query_select) is applied on the device:
+ * other columns are dropped while the response is split into rows, before they take room
+ * in the row buffer or become cJSON nodes.
+ */
+#define SQLITE3_QUERY_MAX_PATH 192
+#define SQLITE3_QUERY_MAX_COLUMNS 8
+
+typedef struct {
+	char path[SQLITE3_QUERY_MAX_PATH];
+	size_t len;
+	bool filtered;          // a column or id filter was added
+	bool parameters;        // the '?' was written
+	esp_err_t err;
+	const char *columns[SQLITE3_QUERY_MAX_COLUMNS];
+	int column_count;       // 0 reads all columns
+} sqlite3_query_t;
+
+esp_err_t sqlite3_query_init(sqlite3_query_t *query, const char *table);
+
+/* One filter at most, before any parameter: ESP_ERR_NOT_SUPPORTED for a second one, ESP_ERR_INVALID_STATE after a parameter */
+esp_err_t sqlite3_query_id(sqlite3_query_t *query, int id);
+esp_err_t sqlite3_query_where(sqlite3_query_t *query, const char *column, const char *value);
+esp_err_t sqlite3_query_where_int(sqlite3_query_t *query, const char *column, long value);
+
+esp_err_t sqlite3_query_order(sqlite3_query_t *query, const char *by, bool descending);
+/* ArrestDB only honours an offset together with a limit; 0 leaves either out */
+esp_err_t sqlite3_query_limit(sqlite3_query_t *query, int limit, int offset);
+
+/* Read only this column; column must stay valid as long as the query is used */
+esp_err_t sqlite3_query_select(sqlite3_query_t *query, const char *column);
+
+/* The path to request, NULL when a call failed */
+const char *sqlite3_query_path(const sqlite3_query_t *query);
+/* ESP_ERR_INVALID_SIZE when the path did not fit, or the error of the first call that failed */
+esp_err_t sqlite3_query_error(const sqlite3_query_t *query);
+
+/* True when the query reads the column named by the first key_len bytes of key (json_stream_key_cb_t) */
+bool sqlite3_query_selects(const char *key, size_t key_len, void *query);
+
+/* Percent-encode in as one path segment or parameter value; false when it does not fit */
+bool sqlite3_query_escape(char *out, size_t out_size, const char *in);
+
+#endif /* SQLITE3_QUERY_H_ */
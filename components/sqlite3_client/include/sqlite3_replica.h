@@ -0,0 +1,55 @@
+#ifndef SQLITE3_REPLICA_H_
+#define SQLITE3_REPLICA_H_
+
+#include "esp_err.h"
+#include "esp_http_client.h"
+
+#include "json_stream.h"
+
+/*
+ * Local replica of read-mostly tables.
+ * Tables added with sqlite3_replica_add() are mirrored into one file each under CONFIG_ESP_REPLICA_BASE_PATH
+ * (a FAT partition on the device, any directory on a host build), with an index of the rows in RAM.
+ * The first sync copies the whole table. After that a sync only fetches the rows above the high-water mark,
+ * the largest id of the last completed sync: ArrestDB cannot filter on id > mark, so the table is read
+ * newest first in pages of CONFIG_ESP_REPLICA_PAGE_SIZE until a page reaches the mark.
+ *
+ * Once a table was synced, point lookups ("table/id") and whole-table reads ("table") are answered from
+ * the replica without a request, also while the server is down. Ids above the mark, filtered and paged
+ * reads still go to the server. PUT and DELETE through sqlite3_client_send() update the replica, and a POST
+ * starts a sync; a whole-table read after it waits for that sync, so that it has the new rows, and goes
+ * to the server when the sync fails while the server answers.
+ * Rows changed or deleted by other clients are only seen after sqlite3_replica_reset().
+ * The sync task sends background requests (see http_pool.h).
+ */
+esp_err_t sqlite3_replica_init(void);
+
+/* Mirror table; it is synced in the background and served locally once the first sync completed */
+esp_err_t sqlite3_replica_add(const char *table);
+
+/* Fetch the new rows of table, or of every mirrored table when table is NULL */
+esp_err_t sqlite3_replica_sync(const char *table);
+
+/* Drop the local rows of table and copy it again with the next sync */
+esp_err_t sqlite3_replica_reset(const char *table);
+
+/* Wake the sync task, e.g. when the network came back */
+void sqlite3_replica_kick(void);
+
+/*
+ * Hand the rows a GET of path would return to the callback as compact JSON text, in id order.
+ * Returns ESP_ERR_NOT_SUPPORTED when the path cannot be answered locally and has to go to the server,
+ * and ESP_ERR_NOT_FOUND, like ArrestDB, for an id at or below the mark that is not in the table.
+ */
+esp_err_t sqlite3_replica_read(const char *path, json_stream_row_cb_t callback, void *ctx);
+
+/* Apply a write that was sent or journaled to the mirrored rows */
+void sqlite3_replica_apply(esp_http_client_method_t method, const char *path, const char *data, int data_len);
+
+/*
+ * A journaled write to path, applied when it was journaled, was rejected on replay:
+ * the local rows no longer match the server's, so the table is copied again.
+ */
+void sqlite3_replica_rejected(const char *path);
+
+#endif /* SQLITE3_REPLICA_H_ */
@@ -0,0 +1,62 @@
+#ifndef SQLITE3_SCHEMA_H_
+#define SQLITE3_SCHEMA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * Typed row binding.
+ * A table is described once by a static array of columns, and rows are decoded from
+ * their JSON text straight into the caller's struct, without building a cJSON tree.
+ *
+ *   typedef struct { int id; char name[32]; int gender; } customer_t;
+ *   static const sqlite3_column_t customer_columns[] = {
+ *       SQLITE3_COLUMN(customer_t, id, SQLITE3_COLUMN_INT),
+ *       SQLITE3_COLUMN(customer_t, name, SQLITE3_COLUMN_TEXT),
+ *       SQLITE3_COLUMN(customer_t, gender, SQLITE3_COLUMN_INT),
+ *   };
+ *   static const sqlite3_schema_t customer_schema = SQLITE3_SCHEMA(customer_t, customer_columns);
+ */
+#define SQLITE3_SCHEMA_MAX_COLUMNS 32
+
+typedef enum {
+	SQLITE3_COLUMN_INT,     // int8_t .. int64_t, chosen by the size of the member
+	SQLITE3_COLUMN_DOUBLE,  // float or double
+	SQLITE3_COLUMN_BOOL,    // bool
+	SQLITE3_COLUMN_TEXT,    // char array, truncated to fit and always NUL terminated
+} sqlite3_column_type_t;
+
+typedef struct {
+	const char *name;
+	sqlite3_column_type_t type;
+	size_t offset;
+	size_t size;
+} sqlite3_column_t;
+
+typedef struct {
+	const sqlite3_column_t *columns;
+	int column_count;
+	size_t record_size;
+} sqlite3_schema_t;
+
+#define SQLITE3_COLUMN(record, member, type) \
+	{ #member, type, offsetof(record, member), sizeof(((record *)0)->member) }
+#define SQLITE3_SCHEMA(record, columns) \
+	{ columns, sizeof(columns) / sizeof(columns[0]), sizeof(record) }
+
+/*
+ * Decode one row, a flat JSON object, into record.
+ * Values are converted to the column type: ArrestDB may send numbers as strings and the other way round.
+ * Columns missing from the row, or null, are left zero; unknown keys are skipped.
+ * *present, when not NULL, gets a bit set for each column found (bit n for columns[n]).
+ */
+esp_err_t sqlite3_schema_decode(const sqlite3_schema_t *schema, const char *row, size_t row_len, void *record, uint32_t *present);
+
+/*
+ * Decode one row of the CSV response mode: names[i] is the column of values[i], NULL values are left zero.
+ * The same conversions and *present bits as sqlite3_schema_decode() apply.
+ */
+esp_err_t sqlite3_schema_decode_fields(const sqlite3_schema_t *schema, const char * const *names, const char * const *values, int count, void *record, uint32_t *present);
+
+#endif /* SQLITE3_SCHEMA_H_ */
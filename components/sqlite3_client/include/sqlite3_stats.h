@@ -0,0 +1,78 @@
+#ifndef SQLITE3_STATS_H_
+#define SQLITE3_STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_client.h"
+
+/*
+ * Request statistics, per method and per table.
+ * Every request is timed phase by phase: connect (DNS and TCP, zero on a kept-alive socket),
+ * write (request line, headers and body), wait (until the response headers arrived: the server's share),
+ * read (body transfer) and decode (JSON splitting and parsing, without the application's row callbacks).
+ * Counters are updated without locks and can be read at any time.
+ */
+#define SQLITE3_STATS_BUCKETS 16    // latency histogram: < 1 ms, < 2 ms, < 4 ms, ... , >= 16 s
+
+typedef enum {
+	SQLITE3_STATS_CONNECT,
+	SQLITE3_STATS_WRITE,
+	SQLITE3_STATS_WAIT,
+	SQLITE3_STATS_READ,
+	SQLITE3_STATS_DECODE,
+	SQLITE3_STATS_PHASES,
+} sqlite3_stats_phase_t;
+
+/* One request, filled in by http_pool and sqlite3_client while it runs */
+typedef struct {
+	bool active;
+	esp_http_client_method_t method;
+	char table[32];
+	int64_t started;
+	int64_t phase_us[SQLITE3_STATS_PHASES];
+	int64_t headers_us;         // from the request written to its response headers, 0 when none arrived
+	int status;                 // HTTP status, 0 when no response arrived
+	int retries;
+	int hedges;                 // duplicate requests sent because the first one was slow
+	uint32_t bytes_sent;
+	uint32_t bytes_received;
+	uint32_t heap_free;         // free heap when the request started
+	uint32_t heap_min;          // lowest free heap seen while it ran
+} sqlite3_stats_sample_t;
+
+/* Snapshot of the counters of one method or table; times are sums in microseconds */
+typedef struct {
+	uint32_t requests;
+	uint32_t failures;          // the server could not be reached
+	uint32_t http_errors;       // the server answered with status >= 400
+	uint32_t retries;
+	uint32_t hedges;
+	uint64_t bytes_sent;
+	uint64_t bytes_received;
+	uint64_t total_us;
+	uint64_t phase_us[SQLITE3_STATS_PHASES];
+	uint32_t heap_peak;         // most heap used by a single request (approximate: other tasks allocate too)
+	uint32_t histogram[SQLITE3_STATS_BUCKETS];
+	uint32_t headers_histogram[SQLITE3_STATS_BUCKETS];  // of the time to the response headers
+} sqlite3_stats_t;
+
+void sqlite3_stats_begin(sqlite3_stats_sample_t *sample, esp_http_client_method_t method, const char *path);
+void sqlite3_stats_heap(sqlite3_stats_sample_t *sample);
+void sqlite3_stats_end(sqlite3_stats_sample_t *sample, esp_err_t err);
+
+/* Counters of a method, or of a table ("customers"); ESP_ERR_NOT_FOUND for a table never requested */
+esp_err_t sqlite3_stats_get_method(esp_http_client_method_t method, sqlite3_stats_t *stats);
+esp_err_t sqlite3_stats_get_table(const char *table, sqlite3_stats_t *stats);
+
+/* Upper bound of the latency below which pct percent of the requests finished, in milliseconds */
+uint32_t sqlite3_stats_percentile(const sqlite3_stats_t *stats, int pct);
+/* The same for the time from a request written to its response headers, of the requests that got them */
+uint32_t sqlite3_stats_headers_percentile(const sqlite3_stats_t *stats, int pct);
+
+/* Log one compact line per method and table */
+void sqlite3_stats_dump(void);
+/* Dump every interval_ms from a background task */
+esp_err_t sqlite3_stats_start_dump(int interval_ms);
+
+#endif /* SQLITE3_STATS_H_ */
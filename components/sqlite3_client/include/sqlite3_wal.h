@@ -0,0 +1,28 @@
+#ifndef SQLITE3_WAL_H_
+#define SQLITE3_WAL_H_
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_http_client.h"
+
+/*
+ * Write-ahead queue for offline operation.
+ * Writes that cannot reach the server are appended to segment files under CONFIG_ESP_WAL_BASE_PATH
+ * as compact binary records, and replayed in order by a background task once the server is back.
+ * While records are pending, new writes are queued behind them so that the order is kept.
+ * The replay sends background requests, so a backlog does not hold up interactive reads (see http_pool.h).
+ */
+esp_err_t sqlite3_wal_init(void);
+
+/* True while journaled writes are waiting for replay */
+bool sqlite3_wal_pending(void);
+
+esp_err_t sqlite3_wal_append(esp_http_client_method_t method, const char *path, const char *data, int data_len);
+
+/* Wake the replay task, e.g. when the network came back */
+void sqlite3_wal_kick(void);
+
+/* True when the last replay found the server unreachable; it is retried every CONFIG_ESP_WAL_RETRY_MS */
+bool sqlite3_wal_offline(void);
+
+#endif /* SQLITE3_WAL_H_ */
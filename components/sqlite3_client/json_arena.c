@@ -0,0 +1,115 @@
+/* Per request arena for cJSON nodes
+ *
+ * This sample code is in the public domain.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "esp_log.h"
+#if CONFIG_ESP_JSON_ARENA_PSRAM
+#include "esp_heap_caps.h"
+#endif
+#include "cJSON.h"
+
+#include "json_arena.h"
+
+#define ARENA_ALIGN 8
+
+struct json_arena {
+	char *base;
+	size_t size;
+	size_t used;
+	size_t peak;
+	int overflows;              // allocations that did not fit and came from the heap
+	struct json_arena *next;    // arenas begun by the same task, most recent first
+};
+
+static const char *TAG = "JSON_ARENA";
+
+/* Arenas the current task is inside of */
+static __thread json_arena_t *s_arenas;
+
+static void *json_arena_malloc(size_t size)
+{
+	json_arena_t *arena = s_arenas;
+	if (arena) {
+		size_t used = (arena->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+		if (used + size <= arena->size) {
+			arena->used = used + size;
+			if (arena->used > arena->peak) arena->peak = arena->used;
+			return arena->base + used;
+		}
+		arena->overflows++;
+	}
+	return malloc(size);
+}
+
+static void json_arena_free(void *ptr)
+{
+	for (json_arena_t *arena = s_arenas; arena; arena = arena->next) {
+		if ((char *)ptr >= arena->base && (char *)ptr < arena->base + arena->size) return;
+	}
+	free(ptr);
+}
+
+esp_err_t json_arena_init(void)
+{
+	cJSON_Hooks hooks = {
+		.malloc_fn = json_arena_malloc,
+		.free_fn = json_arena_free,
+	};
+	cJSON_InitHooks(&hooks);
+	return ESP_OK;
+}
+
+json_arena_t *json_arena_create(size_t size)
+{
+	json_arena_t *arena = calloc(1, sizeof(json_arena_t));
+	if (arena == NULL) return NULL;
+#if CONFIG_ESP_JSON_ARENA_PSRAM
+	arena->base = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+#endif
+	if (arena->base == NULL) arena->base = malloc(size);
+	if (arena->base == NULL) {
+		free(arena);
+		return NULL;
+	}
+	arena->size = size;
+	return arena;
+}
+
+void json_arena_delete(json_arena_t *arena)
+{
+	if (arena == NULL) return;
+	json_arena_end(arena);
+	if (arena->overflows) {
+		ESP_LOGW(TAG, "%d allocations did not fit in the arena (%d bytes, peak %d)",
+			arena->overflows, (int)arena->size, (int)arena->peak);
+	}
+	free(arena->base);
+	free(arena);
+}
+
+void json_arena_begin(json_arena_t *arena)
+{
+	if (arena == NULL) return;
+	arena->next = s_arenas;
+	s_arenas = arena;
+}
+
+void json_arena_end(json_arena_t *arena)
+{
+	for (json_arena_t **link = &s_arenas; *link; link = &(*link)->next) {
+		if (*link == arena) {
+			*link = arena->next;
+			arena->next = NULL;
+			return;
+		}
+	}
+}
+
+void json_arena_reset(json_arena_t *arena)
+{
+	if (arena) arena->used = 0;
+}
@@ -0,0 +1,151 @@
+/* Streaming row splitter for ArrestDB JSON responses
+ *
+ * This sample code is in the public domain.
+ */
+#include <ctype.h>
+
+#include "esp_log.h"
+
+#include "json_stream.h"
+
+static const char *TAG = "JSON_STREAM";
+
+void json_stream_init(json_stream_t *stream, char *row_buffer, size_t row_size, json_stream_row_cb_t callback, void *ctx)
+{
+	stream->row = row_buffer;
+	stream->row_size = row_size;
+	stream->row_len = 0;
+	stream->row_depth = -1;
+	stream->depth = 0;
+	stream->in_string = false;
+	stream->escape = false;
+	stream->capturing = false;
+	stream->overflow = false;
+	stream->rows = 0;
+	stream->callback = callback;
+	stream->ctx = ctx;
+	stream->keep = NULL;
+	stream->keep_ctx = NULL;
+}
+
+void json_stream_project(json_stream_t *stream, json_stream_key_cb_t keep, void *ctx)
+{
+	stream->keep = keep;
+	stream->keep_ctx = ctx;
+}
+
+static void json_stream_put(json_stream_t *stream, char c)
+{
+	if (stream->row_len < stream->row_size - 1) {
+		stream->row[stream->row_len++] = c;
+	} else {
+		stream->overflow = true;
+	}
+}
+
+esp_err_t json_stream_feed(json_stream_t *stream, const char *data, size_t len)
+{
+	for (size_t i=0;i<len;i++) {
+		char c = data[i];
+		if (stream->row_depth < 0) {
+			// The first token tells whether this is a result set or a single row
+			if (isspace((unsigned char)c)) continue;
+			if (c == '[') {
+				stream->row_depth = 1;
+			} else if (c == '{') {
+				stream->row_depth = 0;
+			} else {
+				ESP_LOGE(TAG, "unexpected character 0x%02x", c);
+				return ESP_ERR_INVALID_RESPONSE;
+			}
+		}
+
+		if (!stream->in_string && c == '{' && stream->depth == stream->row_depth) {
+			stream->capturing = true;
+			stream->overflow = false;
+			stream->row_len = 0;
+			stream->expect_key = true;
+			stream->skipping = false;
+			stream->members = 0;
+		}
+		if (stream->keep && stream->capturing && !stream->in_string && stream->depth == stream->row_depth + 1) {
+			// A separator is only written ahead of the next member that is kept
+			if (c == ',') {
+				stream->expect_key = true;
+				stream->skipping = false;
+				continue;
+			}
+			if (c == '}') stream->skipping = false;
+			if (c == '"' && stream->expect_key) {
+				stream->expect_key = false;
+				stream->in_key = true;
+				stream->skipping = false;
+				stream->member_start = stream->row_len;
+				if (stream->members > 0) json_stream_put(stream, ',');
+			}
+		}
+		// Whitespace between tokens is dropped, so pretty printed rows take no extra room
+		if (stream->capturing && !stream->skipping && (stream->in_string || !isspace((unsigned char)c))) {
+			json_stream_put(stream, c);
+		}
+
+		if (stream->in_string) {
+			if (stream->escape) {
+				stream->escape = false;
+			} else if (c == '\\') {
+				stream->escape = true;
+			} else if (c == '"') {
+				stream->in_string = false;
+				if (stream->in_key) {
+					// The key is in the row buffer: keep the member or take it back out
+					stream->in_key = false;
+					size_t key_start = stream->member_start + (stream->members > 0 ? 2 : 1);
+					if (!stream->overflow && stream->keep(stream->row + key_start, stream->row_len - 1 - key_start, stream->keep_ctx)) {
+						stream->members++;
+					} else {
+						stream->row_len = stream->member_start;
+						stream->skipping = true;
+					}
+				}
+			}
+			continue;
+		}
+
+		switch(c) {
+			case '"':
+				stream->in_string = true;
+				break;
+			case '{':
+			case '[':
+				stream->depth++;
+				break;
+			case '}':
+			case ']':
+				stream->depth--;
+				if (stream->capturing && stream->depth == stream->row_depth) {
+					stream->capturing = false;
+					if (stream->overflow) {
+						ESP_LOGE(TAG, "row %d is larger than %d bytes", stream->rows, (int)stream->row_size);
+						return ESP_ERR_INVALID_SIZE;
+					}
+					stream->row[stream->row_len] = 0;
+					stream->rows++;
+					esp_err_t err = stream->callback(stream->row, stream->row_len, stream->ctx);
+					if (err != ESP_OK) return err;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	return ESP_OK;
+}
+
+esp_err_t json_stream_finish(json_stream_t *stream)
+{
+	if (stream->row_depth < 0 || stream->depth != 0 || stream->in_string) {
+		ESP_LOGE(TAG, "truncated response after %d rows", stream->rows);
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+	return ESP_OK;
+}
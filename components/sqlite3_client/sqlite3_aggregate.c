@@ -0,0 +1,259 @@
+/* Streaming aggregates over paged table scans
+ *
+ * This sample code is in the public domain.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "sqlite3_aggregate.h"
+#include "sqlite3_client.h"
+#include "sqlite3_query.h"
+
+#define AGGREGATE_KEY_SIZE 32       // a number printed as a group name
+
+typedef struct {
+	int values;             // non-null values seen (numbers only, except for count)
+	double sum;
+	double min;
+	double max;
+} sqlite3_aggregate_acc_t;
+
+typedef struct {
+	char *name;             // NULL for the rows without a value in the group column
+	int rows;
+	sqlite3_aggregate_acc_t acc[];
+} sqlite3_aggregate_group_t;
+
+struct sqlite3_aggregate {
+	sqlite3_aggregate_config_t config;
+	int page_size;
+	int max_groups;
+	sqlite3_aggregate_group_t **groups;     // sorted by name
+	int group_count;
+	int group_size;
+	int rows;
+};
+
+static const char *TAG = "AGGREGATE";
+
+/* The name of the group of a group column value, NULL for null */
+static const char *sqlite3_aggregate_key(const cJSON *item, char *buffer, size_t size)
+{
+	if (cJSON_IsString(item)) return item->valuestring;
+	if (cJSON_IsNumber(item)) {
+		snprintf(buffer, size, "%.15g", item->valuedouble);
+		return buffer;
+	}
+	if (cJSON_IsBool(item)) return cJSON_IsTrue(item) ? "true" : "false";
+	return NULL;
+}
+
+/* ArrestDB may send numbers as strings */
+static bool sqlite3_aggregate_number(const cJSON *item, double *value)
+{
+	if (cJSON_IsNumber(item)) {
+		*value = item->valuedouble;
+		return true;
+	}
+	if (cJSON_IsString(item) && item->valuestring[0]) {
+		char *end;
+		*value = strtod(item->valuestring, &end);
+		return *end == 0;
+	}
+	if (cJSON_IsBool(item)) {
+		*value = cJSON_IsTrue(item) ? 1 : 0;
+		return true;
+	}
+	return false;
+}
+
+static int sqlite3_aggregate_compare(const char *a, const char *b)
+{
+	if (a == NULL || b == NULL) return (a != NULL) - (b != NULL);
+	return strcmp(a, b);
+}
+
+/* The group named name, created when it is new; NULL when there is no room for it */
+static sqlite3_aggregate_group_t *sqlite3_aggregate_group(sqlite3_aggregate_handle_t aggregate, const char *name)
+{
+	int lo = 0;
+	int hi = aggregate->group_count;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		int cmp = sqlite3_aggregate_compare(aggregate->groups[mid]->name, name);
+		if (cmp == 0) return aggregate->groups[mid];
+		if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (aggregate->group_count >= aggregate->max_groups) {
+		ESP_LOGE(TAG, "%s: more than %d groups", aggregate->config.table, aggregate->max_groups);
+		return NULL;
+	}
+	if (aggregate->group_count == aggregate->group_size) {
+		int size = aggregate->group_size ? aggregate->group_size * 2 : 8;
+		if (size > aggregate->max_groups) size = aggregate->max_groups;
+		sqlite3_aggregate_group_t **groups = realloc(aggregate->groups, size * sizeof(sqlite3_aggregate_group_t *));
+		if (groups == NULL) return NULL;
+		aggregate->groups = groups;
+		aggregate->group_size = size;
+	}
+	size_t acc_size = aggregate->config.column_count * sizeof(sqlite3_aggregate_acc_t);
+	size_t name_size = name ? strlen(name) + 1 : 0;
+	sqlite3_aggregate_group_t *group = calloc(1, sizeof(sqlite3_aggregate_group_t) + acc_size + name_size);
+	if (group == NULL) return NULL;
+	if (name) {
+		group->name = (char *)group->acc + acc_size;
+		memcpy(group->name, name, name_size);
+	}
+	memmove(&aggregate->groups[lo+1], &aggregate->groups[lo], (aggregate->group_count - lo) * sizeof(sqlite3_aggregate_group_t *));
+	aggregate->groups[lo] = group;
+	aggregate->group_count++;
+	return group;
+}
+
+esp_err_t sqlite3_aggregate_create(const sqlite3_aggregate_config_t *config, sqlite3_aggregate_handle_t *aggregate)
+{
+	if (config->column_count < 0 || config->column_count > SQLITE3_AGGREGATE_MAX_COLUMNS) return ESP_ERR_INVALID_ARG;
+	for (int i=0;i<config->column_count;i++) {
+		if (config->columns[i].op > SQLITE3_AGGREGATE_AVG) return ESP_ERR_INVALID_ARG;
+		if (config->columns[i].column == NULL && config->columns[i].op != SQLITE3_AGGREGATE_COUNT) return ESP_ERR_INVALID_ARG;
+	}
+	sqlite3_aggregate_handle_t _aggregate = calloc(1, sizeof(struct sqlite3_aggregate));
+	if (_aggregate == NULL) return ESP_ERR_NO_MEM;
+	_aggregate->config = *config;
+	_aggregate->page_size = config->page_size > 0 ? config->page_size : CONFIG_ESP_CURSOR_PAGE_SIZE;
+	_aggregate->max_groups = config->max_groups > 0 ? config->max_groups : CONFIG_ESP_AGGREGATE_MAX_GROUPS;
+	*aggregate = _aggregate;
+	return ESP_OK;
+}
+
+esp_err_t sqlite3_aggregate_row(const cJSON *row, void *ctx)
+{
+	sqlite3_aggregate_handle_t aggregate = ctx;
+	const sqlite3_aggregate_config_t *config = &aggregate->config;
+	char buffer[AGGREGATE_KEY_SIZE];
+	const char *name = config->group_by ? sqlite3_aggregate_key(cJSON_GetObjectItem(row, config->group_by), buffer, sizeof(buffer)) : NULL;
+	sqlite3_aggregate_group_t *group = sqlite3_aggregate_group(aggregate, name);
+	if (group == NULL) return (aggregate->group_count >= aggregate->max_groups) ? ESP_ERR_INVALID_SIZE : ESP_ERR_NO_MEM;
+	aggregate->rows++;
+	group->rows++;
+
+	for (int i=0;i<config->column_count;i++) {
+		if (config->columns[i].column == NULL) continue;
+		const cJSON *item = cJSON_GetObjectItem(row, config->columns[i].column);
+		if (item == NULL || cJSON_IsNull(item)) continue;
+		sqlite3_aggregate_acc_t *acc = &group->acc[i];
+		double value;
+		if (config->columns[i].op == SQLITE3_AGGREGATE_COUNT) {
+			acc->values++;
+		} else if (sqlite3_aggregate_number(item, &value)) {
+			if (acc->values == 0 || value < acc->min) acc->min = value;
+			if (acc->values == 0 || value > acc->max) acc->max = value;
+			acc->sum += value;
+			acc->values++;
+		}
+	}
+	return ESP_OK;
+}
+
+/* Read only the group column and the aggregated ones, and at least the id: no projection would mean all columns */
+static void sqlite3_aggregate_select(const sqlite3_aggregate_config_t *config, sqlite3_query_t *query)
+{
+	const char *columns[SQLITE3_AGGREGATE_MAX_COLUMNS + 1];
+	int count = 0;
+	if (config->group_by) columns[count++] = config->group_by;
+	for (int i=0;i<config->column_count;i++) {
+		const char *column = config->columns[i].column;
+		bool selected = (column == NULL);
+		for (int j=0;j<count && !selected;j++) selected = strcmp(columns[j], column) == 0;
+		if (!selected) columns[count++] = column;
+	}
+	if (count == 0) columns[count++] = "id";
+	for (int i=0;i<count;i++) sqlite3_query_select(query, columns[i]);
+}
+
+esp_err_t sqlite3_aggregate_scan(sqlite3_aggregate_handle_t aggregate)
+{
+	const sqlite3_aggregate_config_t *config = &aggregate->config;
+	int pages = 0;
+	int rows = aggregate->rows;
+	for (int offset=0;;offset+=aggregate->page_size) {
+		sqlite3_query_t query;
+		sqlite3_query_init(&query, config->table);
+		if (config->where) sqlite3_query_where(&query, config->where, config->equals ? config->equals : "");
+		sqlite3_query_order(&query, "id", false);
+		sqlite3_query_limit(&query, aggregate->page_size, offset);
+		sqlite3_aggregate_select(config, &query);
+		int before = aggregate->rows;
+		esp_err_t err = sqlite3_client_query(&query, sqlite3_aggregate_row, aggregate);
+		// ArrestDB answers 404 when the offset is past the last row, or no row matches the filter
+		if (err == ESP_ERR_NOT_FOUND) err = ESP_OK;
+		if (err != ESP_OK) {
+			ESP_LOGE(TAG, "%s: page at offset %d failed: %s", config->table, offset, esp_err_to_name(err));
+			return err;
+		}
+		pages++;
+		// A short page is the last one
+		if (aggregate->rows - before < aggregate->page_size) break;
+	}
+	ESP_LOGI(TAG, "%s: %d rows in %d pages, %d groups", config->table, aggregate->rows - rows, pages, aggregate->group_count);
+	return ESP_OK;
+}
+
+esp_err_t sqlite3_aggregate_results(sqlite3_aggregate_handle_t aggregate, sqlite3_aggregate_cb_t callback, void *ctx)
+{
+	const sqlite3_aggregate_config_t *config = &aggregate->config;
+	for (int g=0;g<aggregate->group_count;g++) {
+		const sqlite3_aggregate_group_t *group = aggregate->groups[g];
+		double values[SQLITE3_AGGREGATE_MAX_COLUMNS];
+		for (int i=0;i<config->column_count;i++) {
+			const sqlite3_aggregate_acc_t *acc = &group->acc[i];
+			switch (config->columns[i].op) {
+				case SQLITE3_AGGREGATE_COUNT:
+					values[i] = config->columns[i].column ? acc->values : group->rows;
+					break;
+				case SQLITE3_AGGREGATE_SUM:
+					values[i] = acc->values ? acc->sum : NAN;
+					break;
+				case SQLITE3_AGGREGATE_MIN:
+					values[i] = acc->values ? acc->min : NAN;
+					break;
+				case SQLITE3_AGGREGATE_MAX:
+					values[i] = acc->values ? acc->max : NAN;
+					break;
+				case SQLITE3_AGGREGATE_AVG:
+					values[i] = acc->values ? acc->sum / acc->values : NAN;
+					break;
+			}
+		}
+		esp_err_t err = callback(group->name, group->rows, values, ctx);
+		if (err != ESP_OK) return err;
+	}
+	return ESP_OK;
+}
+
+void sqlite3_aggregate_delete(sqlite3_aggregate_handle_t aggregate)
+{
+	if (aggregate == NULL) return;
+	for (int g=0;g<aggregate->group_count;g++) free(aggregate->groups[g]);
+	free(aggregate->groups);
+	free(aggregate);
+}
+
+esp_err_t sqlite3_aggregate(const sqlite3_aggregate_config_t *config, sqlite3_aggregate_cb_t callback, void *ctx)
+{
+	sqlite3_aggregate_handle_t aggregate;
+	esp_err_t err = sqlite3_aggregate_create(config, &aggregate);
+	if (err != ESP_OK) return err;
+	err = sqlite3_aggregate_scan(aggregate);
+	if (err == ESP_OK) err = sqlite3_aggregate_results(aggregate, callback, ctx);
+	sqlite3_aggregate_delete(aggregate);
+	return err;
+}
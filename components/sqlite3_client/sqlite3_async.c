@@ -0,0 +1,215 @@
+/* Asynchronous request engine with a pool of worker tasks
+ *
+ * This sample code is in the public domain.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "sqlite3_async.h"
+
+typedef enum {
+	SQLITE3_ASYNC_GET_ROWS,
+	SQLITE3_ASYNC_SEND,
+	SQLITE3_ASYNC_CREATE,
+} sqlite3_async_op_t;
+
+struct sqlite3_async_request {
+	sqlite3_async_op_t op;
+	esp_http_client_method_t method;
+	char *path;
+	char *data;                 // copied behind the request, NULL without a body
+	int data_len;
+	sqlite3_client_row_cb_t row_callback;
+	void *row_ctx;
+	sqlite3_async_done_cb_t done;
+	void *ctx;
+	http_pool_priority_t priority;  // of the task that submitted it
+	SemaphoreHandle_t finished; // futures only, given when the result is set
+
+	esp_err_t result;
+	int id;
+	cJSON *row;
+};
+
+static const char *TAG = "ASYNC";
+
+static QueueHandle_t s_queues[HTTP_POOL_PRIORITIES];
+static SemaphoreHandle_t s_pending;     // given for every request queued, so that any worker wakes up
+
+/* The next request, interactive ones first; NULL when another worker was quicker */
+static sqlite3_async_handle_t sqlite3_async_next(bool interactive_only)
+{
+	sqlite3_async_handle_t request;
+	if (interactive_only) {
+		xQueueReceive(s_queues[HTTP_POOL_PRIORITY_INTERACTIVE], &request, portMAX_DELAY);
+		return request;
+	}
+	xSemaphoreTake(s_pending, portMAX_DELAY);
+	for (int i=0;i<HTTP_POOL_PRIORITIES;i++) {
+		if (xQueueReceive(s_queues[i], &request, 0) == pdTRUE) return request;
+	}
+	return NULL;
+}
+
+/*
+ * With more than one worker, the first one only runs interactive requests,
+ * so that they never wait behind a queue of background ones.
+ */
+static void sqlite3_async_task(void *pvParameters)
+{
+	bool interactive_only = (bool)(intptr_t)pvParameters;
+	sqlite3_async_handle_t request;
+	while (1) {
+		request = sqlite3_async_next(interactive_only);
+		if (request == NULL) continue;
+		ESP_LOGD(TAG, "run %s", request->path);
+		sqlite3_client_set_priority(request->priority);
+		switch (request->op) {
+			case SQLITE3_ASYNC_GET_ROWS:
+				request->result = sqlite3_client_get_rows(request->path, request->row_callback, request->row_ctx);
+				break;
+			case SQLITE3_ASYNC_SEND:
+				request->result = sqlite3_client_send(request->method, request->path, request->data, request->data_len);
+				break;
+			case SQLITE3_ASYNC_CREATE:
+				request->result = sqlite3_client_create(request->path, request->data, request->data_len, &request->id, &request->row);
+				break;
+		}
+		if (request->done) {
+			request->done(request, request->result, request->ctx);
+			sqlite3_async_free(request);
+		} else {
+			xSemaphoreGive(request->finished);
+		}
+	}
+}
+
+esp_err_t sqlite3_async_init(void)
+{
+	for (int i=0;i<HTTP_POOL_PRIORITIES;i++) {
+		s_queues[i] = xQueueCreate(CONFIG_ESP_ASYNC_QUEUE_LENGTH, sizeof(sqlite3_async_handle_t));
+		if (s_queues[i] == NULL) return ESP_ERR_NO_MEM;
+	}
+	s_pending = xSemaphoreCreateCounting(CONFIG_ESP_ASYNC_QUEUE_LENGTH * HTTP_POOL_PRIORITIES, 0);
+	if (s_pending == NULL) return ESP_ERR_NO_MEM;
+	for (int i=0;i<CONFIG_ESP_ASYNC_WORKERS;i++) {
+		bool interactive_only = (i == 0 && CONFIG_ESP_ASYNC_WORKERS > 1);
+#if CONFIG_ESP_ASYNC_PIN_WORKERS
+		BaseType_t core = i % portNUM_PROCESSORS;
+#else
+		BaseType_t core = tskNO_AFFINITY;
+#endif
+		if (xTaskCreatePinnedToCore(sqlite3_async_task, "ASYNC", 1024*8, (void *)(intptr_t)interactive_only, 2, NULL, core) != pdPASS) {
+			return ESP_ERR_NO_MEM;
+		}
+	}
+	ESP_LOGI(TAG, "workers=%d queue=%d", CONFIG_ESP_ASYNC_WORKERS, CONFIG_ESP_ASYNC_QUEUE_LENGTH);
+	return ESP_OK;
+}
+
+/* Copy the arguments into one allocation and queue it; the request belongs to the worker from then on */
+static sqlite3_async_handle_t sqlite3_async_submit(const struct sqlite3_async_request *args, const char * path, const char * data, int data_len)
+{
+	size_t path_size = strlen(path) + 1;
+	if (data == NULL) data_len = 0;
+	sqlite3_async_handle_t request = calloc(1, sizeof(struct sqlite3_async_request) + path_size + data_len);
+	if (request == NULL) return NULL;
+	*request = *args;
+	request->path = (char *)(request + 1);
+	memcpy(request->path, path, path_size);
+	if (data_len > 0) {
+		request->data = request->path + path_size;
+		memcpy(request->data, data, data_len);
+	}
+	request->data_len = data_len;
+	request->id = -1;
+	request->priority = sqlite3_client_get_priority();
+	if (request->done == NULL) {
+		request->finished = xSemaphoreCreateBinary();
+		if (request->finished == NULL) {
+			free(request);
+			return NULL;
+		}
+	}
+	if (xQueueSend(s_queues[request->priority], &request, 0) != pdTRUE) {
+		ESP_LOGW(TAG, "queue full, %s not submitted", path);
+		if (request->finished) vSemaphoreDelete(request->finished);
+		free(request);
+		return NULL;
+	}
+	xSemaphoreGive(s_pending);
+	return request;
+}
+
+sqlite3_async_handle_t sqlite3_async_get_rows(const char * path, sqlite3_client_row_cb_t row_callback, void *row_ctx, sqlite3_async_done_cb_t done, void *ctx)
+{
+	struct sqlite3_async_request args = {
+		.op = SQLITE3_ASYNC_GET_ROWS,
+		.method = HTTP_METHOD_GET,
+		.row_callback = row_callback,
+		.row_ctx = row_ctx,
+		.done = done,
+		.ctx = ctx,
+	};
+	return sqlite3_async_submit(&args, path, NULL, 0);
+}
+
+sqlite3_async_handle_t sqlite3_async_send(esp_http_client_method_t method, const char * path, const char * data, int data_len, sqlite3_async_done_cb_t done, void *ctx)
+{
+	struct sqlite3_async_request args = {
+		.op = SQLITE3_ASYNC_SEND,
+		.method = method,
+		.done = done,
+		.ctx = ctx,
+	};
+	return sqlite3_async_submit(&args, path, data, data_len);
+}
+
+sqlite3_async_handle_t sqlite3_async_create(const char * table, const char * data, int data_len, sqlite3_async_done_cb_t done, void *ctx)
+{
+	struct sqlite3_async_request args = {
+		.op = SQLITE3_ASYNC_CREATE,
+		.method = HTTP_METHOD_POST,
+		.done = done,
+		.ctx = ctx,
+	};
+	return sqlite3_async_submit(&args, table, data, data_len);
+}
+
+esp_err_t sqlite3_async_wait(sqlite3_async_handle_t handle, TickType_t timeout, esp_err_t *result)
+{
+	if (handle == NULL || handle->finished == NULL) return ESP_ERR_INVALID_ARG;
+	if (xSemaphoreTake(handle->finished, timeout) != pdTRUE) return ESP_ERR_TIMEOUT;
+	// Leave it given, so that waiting again returns at once
+	xSemaphoreGive(handle->finished);
+	if (result) *result = handle->result;
+	return ESP_OK;
+}
+
+/* A future must have finished before it is freed */
+void sqlite3_async_free(sqlite3_async_handle_t handle)
+{
+	if (handle == NULL) return;
+	if (handle->finished) vSemaphoreDelete(handle->finished);
+	cJSON_Delete(handle->row);
+	free(handle);
+}
+
+int sqlite3_async_id(sqlite3_async_handle_t handle)
+{
+	return handle->id;
+}
+
+cJSON *sqlite3_async_take_row(sqlite3_async_handle_t handle)
+{
+	cJSON *row = handle->row;
+	handle->row = NULL;
+	return row;
+}
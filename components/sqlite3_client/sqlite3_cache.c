@@ -0,0 +1,196 @@
+/* LRU row cache with TTL and conditional revalidation
+ *
+ * This sample code is in the public domain.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "sqlite3_cache.h"
+
+#define MAX_CACHE_TABLE 32
+#define MAX_CACHE_TTL_TABLES 8
+
+/* A decoded row, freed when neither the cache nor a reader holds it */
+struct sqlite3_cache_row {
+	cJSON *json;
+	int refs;
+};
+
+typedef struct {
+	char table[MAX_CACHE_TABLE];
+	int id;
+	struct sqlite3_cache_row *row;  // NULL for a free entry
+	TickType_t expires;
+	uint32_t used;                  // LRU stamp
+	char etag[SQLITE3_CACHE_MAX_VALIDATOR];
+	char last_modified[SQLITE3_CACHE_MAX_VALIDATOR];
+} sqlite3_cache_entry_t;
+
+typedef struct {
+	char table[MAX_CACHE_TABLE];
+	TickType_t ttl;
+} sqlite3_cache_ttl_t;
+
+static const char *TAG = "CACHE";
+
+static sqlite3_cache_entry_t s_entries[CONFIG_ESP_CACHE_ENTRIES];
+static sqlite3_cache_ttl_t s_ttls[MAX_CACHE_TTL_TABLES];
+static uint32_t s_clock;
+static SemaphoreHandle_t s_mutex;
+
+static void sqlite3_cache_unref(struct sqlite3_cache_row *row)
+{
+	if (--row->refs == 0) {
+		cJSON_Delete(row->json);
+		free(row);
+	}
+}
+
+static void sqlite3_cache_drop(sqlite3_cache_entry_t *entry)
+{
+	sqlite3_cache_unref(entry->row);
+	entry->row = NULL;
+}
+
+static TickType_t sqlite3_cache_ttl(const char *table)
+{
+	for (int i=0;i<MAX_CACHE_TTL_TABLES;i++) {
+		if (strcmp(s_ttls[i].table, table) == 0) return s_ttls[i].ttl;
+	}
+	return pdMS_TO_TICKS(CONFIG_ESP_CACHE_TTL_MS);
+}
+
+static sqlite3_cache_entry_t *sqlite3_cache_find(const char *table, int id)
+{
+	for (int i=0;i<CONFIG_ESP_CACHE_ENTRIES;i++) {
+		sqlite3_cache_entry_t *entry = &s_entries[i];
+		if (entry->row && entry->id == id && strcmp(entry->table, table) == 0) return entry;
+	}
+	return NULL;
+}
+
+esp_err_t sqlite3_cache_init(void)
+{
+	s_mutex = xSemaphoreCreateMutex();
+	if (s_mutex == NULL) return ESP_ERR_NO_MEM;
+	return ESP_OK;
+}
+
+void sqlite3_cache_set_ttl(const char *table, int ttl_ms)
+{
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	for (int i=0;i<MAX_CACHE_TTL_TABLES;i++) {
+		if (s_ttls[i].table[0] == 0 || strcmp(s_ttls[i].table, table) == 0) {
+			strlcpy(s_ttls[i].table, table, MAX_CACHE_TABLE);
+			s_ttls[i].ttl = pdMS_TO_TICKS(ttl_ms);
+			break;
+		}
+	}
+	xSemaphoreGive(s_mutex);
+}
+
+bool sqlite3_cache_key(const char *path, char *table, size_t table_size, int *id)
+{
+	if (*path == '/') path++;
+	const char *slash = strchr(path, '/');
+	if (slash == NULL || slash == path || (size_t)(slash - path) >= table_size) return false;
+	char *end;
+	long value = strtol(slash + 1, &end, 10);
+	if (end == slash + 1 || *end != 0) return false;
+	memcpy(table, path, slash - path);
+	table[slash - path] = 0;
+	*id = value;
+	return true;
+}
+
+sqlite3_cache_row_handle_t sqlite3_cache_lookup(const char *table, int id, bool *fresh, char *etag, char *last_modified)
+{
+	struct sqlite3_cache_row *row = NULL;
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	sqlite3_cache_entry_t *entry = sqlite3_cache_find(table, id);
+	if (entry) {
+		/*
+		 * An expired row is kept, also without validators: it is replaced when the row is fetched
+		 * again, and served meanwhile if the server cannot be reached.
+		 */
+		*fresh = (int32_t)(entry->expires - xTaskGetTickCount()) > 0;
+		strlcpy(etag, entry->etag, SQLITE3_CACHE_MAX_VALIDATOR);
+		strlcpy(last_modified, entry->last_modified, SQLITE3_CACHE_MAX_VALIDATOR);
+		entry->used = ++s_clock;
+		row = entry->row;
+		row->refs++;
+	}
+	xSemaphoreGive(s_mutex);
+	ESP_LOGD(TAG, "%s/%d %s", table, id, row ? (*fresh ? "hit" : "stale") : "miss");
+	return row;
+}
+
+const cJSON *sqlite3_cache_row(sqlite3_cache_row_handle_t row)
+{
+	return row->json;
+}
+
+void sqlite3_cache_release(sqlite3_cache_row_handle_t row)
+{
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	sqlite3_cache_unref(row);
+	xSemaphoreGive(s_mutex);
+}
+
+void sqlite3_cache_store(const char *table, int id, cJSON *json, const char *etag, const char *last_modified)
+{
+	struct sqlite3_cache_row *row = malloc(sizeof(struct sqlite3_cache_row));
+	if (row == NULL) {
+		cJSON_Delete(json);
+		return;
+	}
+	row->json = json;
+	row->refs = 1;
+
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	sqlite3_cache_entry_t *entry = sqlite3_cache_find(table, id);
+	if (entry == NULL) {
+		// Take a free entry, otherwise evict the least recently used one
+		entry = &s_entries[0];
+		for (int i=0;i<CONFIG_ESP_CACHE_ENTRIES;i++) {
+			if (s_entries[i].row == NULL) {
+				entry = &s_entries[i];
+				break;
+			}
+			if (s_entries[i].used < entry->used) entry = &s_entries[i];
+		}
+	}
+	if (entry->row) sqlite3_cache_drop(entry);
+	strlcpy(entry->table, table, MAX_CACHE_TABLE);
+	entry->id = id;
+	entry->row = row;
+	entry->used = ++s_clock;
+	entry->expires = xTaskGetTickCount() + sqlite3_cache_ttl(table);
+	strlcpy(entry->etag, etag ? etag : "", SQLITE3_CACHE_MAX_VALIDATOR);
+	strlcpy(entry->last_modified, last_modified ? last_modified : "", SQLITE3_CACHE_MAX_VALIDATOR);
+	xSemaphoreGive(s_mutex);
+}
+
+void sqlite3_cache_touch(const char *table, int id)
+{
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	sqlite3_cache_entry_t *entry = sqlite3_cache_find(table, id);
+	if (entry) entry->expires = xTaskGetTickCount() + sqlite3_cache_ttl(table);
+	xSemaphoreGive(s_mutex);
+}
+
+void sqlite3_cache_invalidate(const char *table, int id)
+{
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	for (int i=0;i<CONFIG_ESP_CACHE_ENTRIES;i++) {
+		sqlite3_cache_entry_t *entry = &s_entries[i];
+		if (entry->row == NULL || strcmp(entry->table, table) != 0) continue;
+		if (id < 0 || entry->id == id) sqlite3_cache_drop(entry);
+	}
+	xSemaphoreGive(s_mutex);
+}
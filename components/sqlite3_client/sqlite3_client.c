@@ -0,0 +1,1031 @@
+/* Remote sqlite3 client for ArrestDB
+ *
+ * This sample code is in the public domain.
+ */
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "esp_http_client.h" 
+#include "cJSON.h"
+
+#include "csv_stream.h"
+#include "http_buffer.h"
+#include "http_pool.h"
+#include "http_zlib.h"
+#include "json_arena.h"
+#include "json_stream.h"
+#include "sqlite3_cache.h"
+#include "sqlite3_client.h"
+#include "sqlite3_flight.h"
+#include "sqlite3_query.h"
+#include "sqlite3_replica.h"
+#include "sqlite3_wal.h"
+
+static const char *TAG = "SQLITE";
+
+void JSON_Record(const cJSON * const array) {
+	// A missing column prints as 0 or "(null)" instead of dereferencing NULL
+	const cJSON *_id = cJSON_GetObjectItem(array,"id");
+	const cJSON *_gender = cJSON_GetObjectItem(array,"gender");
+	int id = _id ? _id->valueint : 0;
+	char *name = cJSON_GetStringValue(cJSON_GetObjectItem(array,"name"));
+	int gender = _gender ? _gender->valueint : 0;
+	ESP_LOGI(TAG, "%d\t%s\t%d", id, name, gender);
+}
+
+char *JSON_Types(int type) {
+	if (type == cJSON_Invalid) return ("cJSON_Invalid");
+	if (type == cJSON_False) return ("cJSON_False");
+	if (type == cJSON_True) return ("cJSON_True");
+	if (type == cJSON_NULL) return ("cJSON_NULL");
+	if (type == cJSON_Number) return ("cJSON_Number");
+	if (type == cJSON_String) return ("cJSON_String");
+	if (type == cJSON_Array) return ("cJSON_Array");
+	if (type == cJSON_Object) return ("cJSON_Object");
+	if (type == cJSON_Raw) return ("cJSON_Raw");
+	return NULL;
+}
+
+void JSON_Print(const cJSON * const root) {
+	ESP_LOGI(TAG, "-----------------------------------------");
+	ESP_LOGD(TAG, "root->type=%s", JSON_Types(root->type));
+	if (cJSON_IsArray(root)) {
+		ESP_LOGD(TAG, "root->type is Array");
+		int root_array_size = cJSON_GetArraySize(root); 
+		for (int i=0;i<root_array_size;i++) {
+			cJSON *record = cJSON_GetArrayItem(root,i);
+			JSON_Record(record);
+		}
+	} else {
+		ESP_LOGD(TAG, "root->type is Object");
+		JSON_Record(root);
+	}
+	ESP_LOGI(TAG, "-----------------------------------------");
+}
+
+void JSON_Analyze(const cJSON * const root) {
+	//ESP_LOGI(TAG, "root->type=%s", JSON_Types(root->type));
+	cJSON *current_element = NULL;
+	//ESP_LOGI(TAG, "root->child=%p", root->child);
+	//ESP_LOGI(TAG, "root->next =%p", root->next);
+	cJSON_ArrayForEach(current_element, root) {
+		//ESP_LOGI(TAG, "type=%s", JSON_Types(current_element->type));
+		//ESP_LOGI(TAG, "current_element->string=%p", current_element->string);
+		if (current_element->string) {
+			const char* string = current_element->string;
+			ESP_LOGI(TAG, "[%s]", string);
+		}
+		if (cJSON_IsInvalid(current_element)) {
+			ESP_LOGI(TAG, "Invalid");
+		} else if (cJSON_IsFalse(current_element)) {
+			ESP_LOGI(TAG, "False");
+		} else if (cJSON_IsTrue(current_element)) {
+			ESP_LOGI(TAG, "True");
+		} else if (cJSON_IsNull(current_element)) {
+			ESP_LOGI(TAG, "Null");
+		} else if (cJSON_IsNumber(current_element)) {
+			int valueint = current_element->valueint;
+			double valuedouble = current_element->valuedouble;
+			ESP_LOGI(TAG, "int=%d double=%f", valueint, valuedouble);
+		} else if (cJSON_IsString(current_element)) {
+			const char* valuestring = current_element->valuestring;
+			ESP_LOGI(TAG, "%s", valuestring);
+		} else if (cJSON_IsArray(current_element)) {
+			ESP_LOGD(TAG, "Array");
+			JSON_Analyze(current_element);
+		} else if (cJSON_IsObject(current_element)) {
+			ESP_LOGD(TAG, "Object");
+			JSON_Analyze(current_element);
+		} else if (cJSON_IsRaw(current_element)) {
+			ESP_LOGI(TAG, "Raw(Not support)");
+		}
+	}
+}
+
+#define MAX_HTTP_OUTPUT_BUFFER 2048
+#define MAX_HTTP_RECV_BUFFER 512
+
+typedef struct {
+	sqlite3_client_row_cb_t callback;
+	void *ctx;
+	bool keep;          // keep the first decoded row for the cache instead of freeing it
+	cJSON *kept;
+	json_arena_t *arena;    // rows are decoded into it and released at once after the callback
+	sqlite3_flight_handle_t flight;     // followers waiting for these rows, NULL when not coalesced
+	bool aborted;           // the callback stopped the read early
+} sqlite3_client_rows_t;
+
+/* Conditional GET: request validators in, status code and response validators out */
+typedef struct {
+	const char *if_none_match;
+	const char *if_modified_since;
+	int status_code;
+	char etag[SQLITE3_CACHE_MAX_VALIDATOR];
+	char last_modified[SQLITE3_CACHE_MAX_VALIDATOR];
+	csv_stream_row_cb_t csv_callback;   // ask for the CSV response mode and parse it with this
+	json_stream_key_cb_t keep;          // projection of JSON rows, NULL for all columns
+	void *keep_ctx;
+} sqlite3_client_get_options_t;
+
+/* Time spent in the application's row callbacks on this task, kept out of the decode phase */
+static __thread int64_t s_callback_us;
+/* Deadline of the requests of this task, 0 for CONFIG_ESP_HTTP_TIMEOUT_MS */
+static __thread int s_timeout_ms;
+/* Priority class of the requests of this task */
+static __thread http_pool_priority_t s_priority;
+
+void sqlite3_client_set_timeout(int timeout_ms)
+{
+	s_timeout_ms = timeout_ms;
+}
+
+void sqlite3_client_set_priority(http_pool_priority_t priority)
+{
+	s_priority = priority;
+}
+
+http_pool_priority_t sqlite3_client_get_priority(void)
+{
+	return s_priority;
+}
+
+/* A pooled connection with the deadline and priority class of the calling task */
+static esp_http_client_handle_t sqlite3_client_acquire(void)
+{
+	esp_http_client_handle_t client = http_pool_acquire(s_priority);
+	if (client && s_timeout_ms > 0) http_pool_set_timeout(client, s_timeout_ms);
+	return client;
+}
+
+/* Add the time since *mark to a phase of the request and move the mark */
+static void sqlite3_client_phase(sqlite3_stats_sample_t *sample, sqlite3_stats_phase_t phase, int64_t *mark)
+{
+	int64_t now = esp_timer_get_time();
+	sample->phase_us[phase] += now - *mark;
+	*mark = now;
+}
+
+static esp_err_t sqlite3_client_parse_row(const char *row, size_t row_len, void *ctx)
+{
+	sqlite3_client_rows_t *rows = ctx;
+	json_arena_begin(rows->arena);
+	cJSON *record = cJSON_ParseWithLength(row, row_len);
+	json_arena_end(rows->arena);
+	if (record == NULL) {
+		ESP_LOGE(TAG, "cJSON_Parse failed [%s]", row);
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+#if CONFIG_ESP_COALESCE_ENABLE
+	if (rows->flight) sqlite3_flight_add_row(rows->flight, record);
+#endif
+	int64_t started = esp_timer_get_time();
+	esp_err_t err = rows->callback(record, rows->ctx);
+	s_callback_us += esp_timer_get_time() - started;
+	if (err != ESP_OK) rows->aborted = true;
+	if (rows->keep && rows->kept == NULL) {
+		// The cache outlives the arena, so it gets a copy on the heap
+		rows->kept = rows->arena ? cJSON_Duplicate(record, true) : record;
+		if (rows->kept == record) return err;
+	}
+	json_arena_begin(rows->arena);
+	cJSON_Delete(record);
+	json_arena_end(rows->arena);
+	json_arena_reset(rows->arena);
+	return err;
+}
+
+/* The row parser a response body is fed to */
+typedef struct {
+	bool csv;
+	json_stream_t json;
+	csv_stream_t csv_stream;
+} sqlite3_client_body_t;
+
+static esp_err_t sqlite3_client_body_feed(const char *data, size_t len, void *ctx)
+{
+	sqlite3_client_body_t *body = ctx;
+	return body->csv ? csv_stream_feed(&body->csv_stream, data, len) : json_stream_feed(&body->json, data, len);
+}
+
+#if CONFIG_ESP_REPLICA_ENABLE
+static esp_err_t sqlite3_client_replica_row(const char *row, size_t row_len, void *ctx)
+{
+	return json_stream_feed(ctx, row, row_len);
+}
+
+/*
+ * Rows of a mirrored table are read from the local replica. They go through the same splitter
+ * as a response body, so the projection and the callbacks see no difference.
+ * Returns ESP_ERR_NOT_SUPPORTED when the path has to go to the server.
+ */
+static esp_err_t sqlite3_client_get_local(const char * path, char *row_buffer, json_stream_row_cb_t callback, void *ctx, sqlite3_client_get_options_t *options)
+{
+	json_stream_t stream;
+	json_stream_init(&stream, row_buffer, CONFIG_ESP_JSON_MAX_ROW_SIZE, callback, ctx);
+	if (options && options->keep) json_stream_project(&stream, options->keep, options->keep_ctx);
+	esp_err_t err = sqlite3_replica_read(path, sqlite3_client_replica_row, &stream);
+	if (err == ESP_ERR_NOT_SUPPORTED) return err;
+	if (err == ESP_OK && stream.rows > 0) err = json_stream_finish(&stream);
+	if (options) {
+		options->status_code = (err == ESP_ERR_NOT_FOUND) ? 404 : (stream.rows > 0) ? 200 : 204;
+		options->etag[0] = 0;
+		options->last_modified[0] = 0;
+	}
+	ESP_LOGI(TAG, "rows = %d (replica)", stream.rows);
+	return err;
+}
+#endif
+
+/*
+ * http_native_request() demonstrates use of low level APIs to connect to a server,
+ * make a http request and read response.
+ * The connection is borrowed from http_pool, so the socket is kept open between requests.
+ * Note: This approach should only be used in case use of low level APIs is required.
+ * By default, PHP's built-in web server does not automatically send a Content-Length header for dynamic content.
+ *
+ * The response body is read chunk by chunk and every row is handed to the callback as compact JSON text.
+ * Peak memory is one receive chunk plus the largest single row (CONFIG_ESP_JSON_MAX_ROW_SIZE),
+ * no matter how many rows the table has.
+ * With options->csv_callback the server is asked for CSV, which it may ignore: stock ArrestDB always answers JSON.
+ * A gzip or deflate encoded body is inflated on the way to the row parser.
+ * Reading and decoding are timed into the request's stats sample; time spent in
+ * the row callbacks is subtracted from the decode phase.
+ */
+static esp_err_t sqlite3_client_get_ex(const char * path, json_stream_row_cb_t callback, void *ctx, sqlite3_client_get_options_t *options)
+{
+	ESP_LOGI(TAG, "sqlite3_client_get_raw path=%s",path);
+	// One pooled buffer holds the row being assembled and the received bytes behind it
+	char *row_buffer = http_buffer_get(CONFIG_ESP_JSON_MAX_ROW_SIZE + MAX_HTTP_RECV_BUFFER);
+	if (row_buffer == NULL) return ESP_ERR_NO_MEM;
+	char *recv_buffer = row_buffer + CONFIG_ESP_JSON_MAX_ROW_SIZE;
+#if CONFIG_ESP_REPLICA_ENABLE
+	esp_err_t local = sqlite3_client_get_local(path, row_buffer, callback, ctx, options);
+	if (local != ESP_ERR_NOT_SUPPORTED) {
+		http_buffer_put(row_buffer);
+		return local;
+	}
+#endif
+	esp_http_client_handle_t client = sqlite3_client_acquire();
+
+	// GET Request
+	esp_err_t ret = ESP_FAIL;
+	int64_t content_length;
+	if (client && options && options->if_none_match) http_pool_set_header(client, "If-None-Match", options->if_none_match);
+	if (client && options && options->if_modified_since) http_pool_set_header(client, "If-Modified-Since", options->if_modified_since);
+	if (client && options && options->csv_callback) http_pool_set_header(client, "Accept", "text/csv, application/json;q=0.5");
+#if CONFIG_ESP_HTTP_ACCEPT_ENCODING
+	if (client) http_pool_set_header(client, "Accept-Encoding", "gzip, deflate");
+#endif
+	esp_err_t err = http_pool_open(&client, HTTP_METHOD_GET, path, NULL, 0, &content_length);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
+		ret = err;
+	} else {
+		ESP_LOGI(TAG, "HTTP GET content_length = %"PRId64, content_length);
+		int status_code = esp_http_client_get_status_code(client);
+		if (options) {
+			const char *etag = http_pool_get_header(client, "ETag");
+			const char *last_modified = http_pool_get_header(client, "Last-Modified");
+			options->status_code = status_code;
+			strlcpy(options->etag, etag ? etag : "", SQLITE3_CACHE_MAX_VALIDATOR);
+			strlcpy(options->last_modified, last_modified ? last_modified : "", SQLITE3_CACHE_MAX_VALIDATOR);
+		}
+		if (status_code == 304) {
+			// The cached row is still current
+			ESP_LOGI(TAG, "HTTP GET Status = %d", status_code);
+			esp_http_client_flush_response(client, NULL);
+			ret = ESP_OK;
+		} else if (status_code == 204) {
+			// ArrestDB answers an empty result set with "No Content"
+			ret = ESP_OK;
+		} else if (status_code >= 400) {
+			// ArrestDB answers {"error": {"code": 404, "status": "Not Found"}}
+			ESP_LOGW(TAG, "HTTP GET Status = %d", status_code);
+			esp_http_client_flush_response(client, NULL);
+			ret = (status_code == 404) ? ESP_ERR_NOT_FOUND : ESP_FAIL;
+		} else {
+			const char *content_type = http_pool_get_header(client, "Content-Type");
+			const char *content_encoding = http_pool_get_header(client, "Content-Encoding");
+			sqlite3_client_body_t body;
+			body.csv = options && options->csv_callback && content_type && strncasecmp(content_type, "text/csv", 8) == 0;
+			if (body.csv) {
+				csv_stream_init(&body.csv_stream, row_buffer, CONFIG_ESP_JSON_MAX_ROW_SIZE, options->csv_callback, ctx);
+			} else {
+				json_stream_init(&body.json, row_buffer, CONFIG_ESP_JSON_MAX_ROW_SIZE, callback, ctx);
+				if (options && options->keep) json_stream_project(&body.json, options->keep, options->keep_ctx);
+			}
+			http_zlib_inflate_handle_t decoder = NULL;
+			ret = ESP_OK;
+			if (content_encoding && strcasecmp(content_encoding, "identity") != 0) {
+				if (http_zlib_supported(content_encoding)) decoder = http_zlib_inflate_create(sqlite3_client_body_feed, &body);
+				if (decoder == NULL) {
+					ESP_LOGE(TAG, "cannot decode Content-Encoding: %s", content_encoding);
+					esp_http_client_flush_response(client, NULL);
+					ret = ESP_ERR_NOT_SUPPORTED;
+				}
+			}
+			int data_read = 0;
+			sqlite3_stats_sample_t *sample = http_pool_sample(client);
+			int64_t callback_us = s_callback_us;
+			int64_t mark = esp_timer_get_time();
+			while (ret == ESP_OK) {
+				int len;
+				ret = http_pool_read(client, recv_buffer, MAX_HTTP_RECV_BUFFER, &len);
+				sqlite3_client_phase(sample, SQLITE3_STATS_READ, &mark);
+				if (ret != ESP_OK) {
+					ESP_LOGE(TAG, "HTTP client read response failed: %s", esp_err_to_name(ret));
+				} else if (len == 0) {
+					if (decoder) ret = http_zlib_inflate_finish(decoder);
+					if (ret == ESP_OK) ret = body.csv ? csv_stream_finish(&body.csv_stream) : json_stream_finish(&body.json);
+					break;
+				} else {
+					ESP_LOG_BUFFER_HEXDUMP(TAG, recv_buffer, len, ESP_LOG_DEBUG);
+					data_read += len;
+					ret = decoder ? http_zlib_inflate_feed(decoder, recv_buffer, len) : sqlite3_client_body_feed(recv_buffer, len, &body);
+				}
+				sqlite3_client_phase(sample, SQLITE3_STATS_DECODE, &mark);
+				sqlite3_stats_heap(sample);
+			}
+			sample->phase_us[SQLITE3_STATS_DECODE] -= s_callback_us - callback_us;
+			ESP_LOGI(TAG, "HTTP GET Status = %d, data_read = %d, rows = %d%s%s",
+				status_code, data_read, body.csv ? body.csv_stream.rows : body.json.rows,
+				body.csv ? " (csv)" : "", decoder ? " (compressed)" : "");
+			http_zlib_inflate_delete(decoder);
+		}
+	}
+	http_pool_release(client);
+	http_buffer_put(row_buffer);
+	return ret;
+}
+
+typedef struct {
+	json_stream_row_cb_t callback;
+	void *ctx;
+} sqlite3_client_raw_t;
+
+static esp_err_t sqlite3_client_raw_row(const char *row, size_t row_len, void *ctx)
+{
+	sqlite3_client_raw_t *raw = ctx;
+	int64_t started = esp_timer_get_time();
+	esp_err_t err = raw->callback(row, row_len, raw->ctx);
+	s_callback_us += esp_timer_get_time() - started;
+	return err;
+}
+
+esp_err_t sqlite3_client_get_raw(const char * path, json_stream_row_cb_t callback, void *ctx)
+{
+	sqlite3_client_raw_t raw = {
+		.callback = callback,
+		.ctx = ctx,
+	};
+	return sqlite3_client_get_ex(path, sqlite3_client_raw_row, &raw, NULL);
+}
+
+#if CONFIG_ESP_CACHE_ENABLE
+/*
+ * Point lookups ("table/id") are served from the row cache while the TTL runs,
+ * and revalidated with a conditional GET once it expired.
+ * While the server cannot be reached, an expired row is served rather than nothing.
+ */
+static esp_err_t sqlite3_client_get_cached(const char * path, const char *table, int id, sqlite3_client_row_cb_t callback, void *ctx)
+{
+	sqlite3_client_get_options_t options = {0};
+	bool fresh = false;
+	sqlite3_cache_row_handle_t cached = sqlite3_cache_lookup(table, id, &fresh, options.etag, options.last_modified);
+	if (cached && fresh) {
+		esp_err_t err = callback(sqlite3_cache_row(cached), ctx);
+		sqlite3_cache_release(cached);
+		return err;
+	}
+
+	if (cached) {
+		if (options.etag[0]) options.if_none_match = options.etag;
+		if (options.last_modified[0]) options.if_modified_since = options.last_modified;
+	}
+	sqlite3_client_rows_t rows = {
+		.callback = callback,
+		.ctx = ctx,
+		.keep = true,
+		.arena = json_arena_create(CONFIG_ESP_JSON_ARENA_SIZE),
+	};
+	esp_err_t err = sqlite3_client_get_ex(path, sqlite3_client_parse_row, &rows, &options);
+	json_arena_delete(rows.arena);
+	if (err == ESP_OK && options.status_code == 304 && cached) {
+		sqlite3_cache_touch(table, id);
+		err = callback(sqlite3_cache_row(cached), ctx);
+	} else if (err == ESP_OK && rows.kept) {
+		sqlite3_cache_store(table, id, rows.kept, options.etag, options.last_modified);
+		rows.kept = NULL;
+	} else if (err == ESP_ERR_NOT_FOUND || (err == ESP_OK && cached)) {
+		// The row is gone, or the server answered without it: the expired copy must not be served later
+		sqlite3_cache_invalidate(table, id);
+	} else if (sqlite3_client_unreachable(err) && cached && rows.kept == NULL) {
+		ESP_LOGW(TAG, "%s: %s, serving the cached row", path, esp_err_to_name(err));
+		err = callback(sqlite3_cache_row(cached), ctx);
+	}
+	cJSON_Delete(rows.kept);
+	if (cached) sqlite3_cache_release(cached);
+	return err;
+}
+
+/* Drop the cached rows a write may change */
+static void sqlite3_client_invalidate(const char * path)
+{
+	char table[32];
+	int id;
+	if (sqlite3_cache_key(path, table, sizeof(table), &id)) {
+		sqlite3_cache_invalidate(table, id);
+		return;
+	}
+	if (*path == '/') path++;
+	size_t table_len = strcspn(path, "/?");
+	if (table_len == 0 || table_len >= sizeof(table)) return;
+	memcpy(table, path, table_len);
+	table[table_len] = 0;
+	sqlite3_cache_invalidate(table, -1);
+}
+#endif
+
+esp_err_t sqlite3_client_get_rows(const char * path, sqlite3_client_row_cb_t callback, void *ctx)
+{
+#if CONFIG_ESP_CACHE_ENABLE
+	char table[32];
+	int id;
+	if (sqlite3_cache_key(path, table, sizeof(table), &id)) {
+		return sqlite3_client_get_cached(path, table, id, callback, ctx);
+	}
+#endif
+	sqlite3_flight_handle_t flight = NULL;
+#if CONFIG_ESP_COALESCE_ENABLE
+	// The same read is already on its way: take its rows instead of asking again
+	bool leader = false;
+	flight = sqlite3_flight_join(path, &leader);
+	if (flight && !leader) {
+		const cJSON *shared;
+		const cJSON *row;
+		esp_err_t err = sqlite3_flight_wait(flight, &shared);
+		bool refetch = (err == ESP_ERR_INVALID_STATE);
+		if (err == ESP_OK) {
+			cJSON_ArrayForEach(row, shared) {
+				err = callback(row, ctx);
+				if (err != ESP_OK) break;
+			}
+		}
+		sqlite3_flight_release(flight);
+		if (!refetch) return err;
+		flight = NULL;
+	}
+#endif
+	sqlite3_client_rows_t rows = {
+		.callback = callback,
+		.ctx = ctx,
+		.arena = json_arena_create(CONFIG_ESP_JSON_ARENA_SIZE),
+		.flight = flight,
+	};
+	esp_err_t err = sqlite3_client_get_ex(path, sqlite3_client_parse_row, &rows, NULL);
+	json_arena_delete(rows.arena);
+#if CONFIG_ESP_COALESCE_ENABLE
+	if (flight) {
+		sqlite3_flight_complete(flight, err, !rows.aborted);
+		sqlite3_flight_release(flight);
+	}
+#endif
+	return err;
+}
+
+esp_err_t sqlite3_client_query(const sqlite3_query_t *query, sqlite3_client_row_cb_t callback, void *ctx)
+{
+	const char *path = sqlite3_query_path(query);
+	if (path == NULL) return sqlite3_query_error(query);
+	if (query->column_count == 0) return sqlite3_client_get_rows(path, callback, ctx);
+
+	// The row cache and coalesced reads hold whole rows, so a projection goes to the server
+	sqlite3_client_get_options_t options = {
+		.keep = sqlite3_query_selects,
+		.keep_ctx = (void *)query,
+	};
+	sqlite3_client_rows_t rows = {
+		.callback = callback,
+		.ctx = ctx,
+		.arena = json_arena_create(CONFIG_ESP_JSON_ARENA_SIZE),
+	};
+	esp_err_t err = sqlite3_client_get_ex(path, sqlite3_client_parse_row, &rows, &options);
+	json_arena_delete(rows.arena);
+	return err;
+}
+
+typedef struct {
+	const sqlite3_schema_t *schema;
+	char *records;
+	int max_records;
+	int count;
+	sqlite3_client_record_cb_t callback;
+	void *ctx;
+} sqlite3_client_records_t;
+
+/* The record the next row is decoded into, NULL when the array is full */
+static void *sqlite3_client_next_record(sqlite3_client_records_t *records)
+{
+	if (records->callback) return records->records;
+	if (records->count >= records->max_records) return NULL;
+	return records->records + records->count * records->schema->record_size;
+}
+
+static esp_err_t sqlite3_client_record_done(sqlite3_client_records_t *records)
+{
+	if (records->callback == NULL) {
+		records->count++;
+		return ESP_OK;
+	}
+	int64_t started = esp_timer_get_time();
+	esp_err_t err = records->callback(records->records, records->ctx);
+	s_callback_us += esp_timer_get_time() - started;
+	return err;
+}
+
+static esp_err_t sqlite3_client_decode_record(const char *row, size_t row_len, void *ctx)
+{
+	sqlite3_client_records_t *records = ctx;
+	void *record = sqlite3_client_next_record(records);
+	if (record == NULL) return ESP_OK;
+	esp_err_t err = sqlite3_schema_decode(records->schema, row, row_len, record, NULL);
+	if (err != ESP_OK) return err;
+	return sqlite3_client_record_done(records);
+}
+
+static esp_err_t sqlite3_client_decode_fields(const char * const *names, const char * const *values, int count, void *ctx)
+{
+	sqlite3_client_records_t *records = ctx;
+	void *record = sqlite3_client_next_record(records);
+	if (record == NULL) return ESP_OK;
+	esp_err_t err = sqlite3_schema_decode_fields(records->schema, names, values, count, record, NULL);
+	if (err != ESP_OK) return err;
+	return sqlite3_client_record_done(records);
+}
+
+/* A JSON member the schema has a column for */
+static bool sqlite3_client_schema_column(const char *key, size_t key_len, void *ctx)
+{
+	const sqlite3_schema_t *schema = ctx;
+	for (int i=0;i<schema->column_count;i++) {
+		const char *name = schema->columns[i].name;
+		if (strncmp(name, key, key_len) == 0 && name[key_len] == 0) return true;
+	}
+	return false;
+}
+
+/*
+ * Typed reads can take the compact CSV response mode, since no cJSON tree is needed.
+ * JSON rows are projected to the columns of the schema, so other columns take no room in the row buffer.
+ */
+static sqlite3_client_get_options_t *sqlite3_client_records_options(sqlite3_client_get_options_t *options, const sqlite3_schema_t *schema)
+{
+	memset(options, 0, sizeof(sqlite3_client_get_options_t));
+#if CONFIG_ESP_CSV_ENABLE
+	options->csv_callback = sqlite3_client_decode_fields;
+#endif
+	options->keep = sqlite3_client_schema_column;
+	options->keep_ctx = (void *)schema;
+	return options;
+}
+
+esp_err_t sqlite3_client_get_records(const char * path, const sqlite3_schema_t *schema, void *records, int max_records, int *count)
+{
+	sqlite3_client_records_t ctx = {
+		.schema = schema,
+		.records = records,
+		.max_records = max_records,
+	};
+	sqlite3_client_get_options_t options;
+	esp_err_t err = sqlite3_client_get_ex(path, sqlite3_client_decode_record, &ctx, sqlite3_client_records_options(&options, schema));
+	*count = ctx.count;
+	return err;
+}
+
+esp_err_t sqlite3_client_get_each(const char * path, const sqlite3_schema_t *schema, void *record, sqlite3_client_record_cb_t callback, void *ctx)
+{
+	sqlite3_client_records_t records = {
+		.schema = schema,
+		.records = record,
+		.callback = callback,
+		.ctx = ctx,
+	};
+	sqlite3_client_get_options_t options;
+	return sqlite3_client_get_ex(path, sqlite3_client_decode_record, &records, sqlite3_client_records_options(&options, schema));
+}
+
+static esp_err_t sqlite3_client_print_row(const cJSON *row, void *ctx)
+{
+	JSON_Record(row);
+	return ESP_OK;
+}
+
+esp_err_t sqlite3_client_get(char * path)
+{
+	ESP_LOGI(TAG, "sqlite3_client_get path=%s",path);
+	ESP_LOGI(TAG, "-----------------------------------------");
+	esp_err_t ret = sqlite3_client_get_rows(path, sqlite3_client_print_row, NULL);
+	ESP_LOGI(TAG, "-----------------------------------------");
+	return ret;
+}
+
+static const char *sqlite3_client_method_name(esp_http_client_method_t method)
+{
+	if (method == HTTP_METHOD_GET) return "GET";
+	if (method == HTTP_METHOD_POST) return "POST";
+	if (method == HTTP_METHOD_PUT) return "PUT";
+	if (method == HTTP_METHOD_DELETE) return "DELETE";
+	return "?";
+}
+
+/* What the server answered to a write, for the callers that need more than the status */
+typedef struct {
+	cJSON *body;            // parsed response body, NULL when empty or not JSON
+	char location[64];      // Location header, empty when absent
+} sqlite3_client_reply_t;
+
+/*
+ * Send a request with an optional JSON body and log ArrestDB's answer.
+ * Returns ESP_ERR_NOT_FOUND for 404, ESP_ERR_INVALID_RESPONSE when ArrestDB rejected the request
+ * (e.g. 409 Conflict), and ESP_FAIL or the transport error when the server could not be reached.
+ * With a reply the parsed body is handed to the caller, who frees it with cJSON_Delete().
+ */
+static esp_err_t sqlite3_client_request_ex(esp_http_client_method_t method, const char * path, const char * data, int data_len, sqlite3_client_reply_t *reply)
+{
+	const char *method_name = sqlite3_client_method_name(method);
+	ESP_LOGI(TAG, "sqlite3_client_request %s path=%s", method_name, path);
+	if (data_len > 0) ESP_LOGI(TAG, "post_data=[%.*s]", data_len, data);
+	// ArrestDB inflates a body that starts with a zlib header
+	char *compressed = NULL;
+	size_t compressed_len;
+	if (CONFIG_ESP_HTTP_COMPRESS_SIZE > 0 && data_len >= CONFIG_ESP_HTTP_COMPRESS_SIZE &&
+		http_zlib_deflate(data, data_len, &compressed, &compressed_len) == ESP_OK) {
+		ESP_LOGI(TAG, "post_data compressed from %d to %d bytes", data_len, (int)compressed_len);
+		data = compressed;
+		data_len = compressed_len;
+	}
+	char *output_buffer = http_buffer_get(MAX_HTTP_OUTPUT_BUFFER);
+	if (output_buffer == NULL) {
+		free(compressed);
+		return ESP_ERR_NO_MEM;
+	}
+	esp_http_client_handle_t client = sqlite3_client_acquire();
+	// The response is only logged unless the caller wants it, so it can live in an arena
+	json_arena_t *arena = reply ? NULL : json_arena_create(CONFIG_ESP_JSON_ARENA_SIZE);
+	json_arena_begin(arena);
+
+	esp_err_t ret = ESP_FAIL;
+	int64_t content_length;
+	esp_err_t err = http_pool_open(&client, method, path, data, data_len, &content_length);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
+		ret = err;
+	} else {
+		sqlite3_stats_sample_t *sample = http_pool_sample(client);
+		int64_t mark = esp_timer_get_time();
+		int data_read;
+		err = http_pool_read_response(client, output_buffer, MAX_HTTP_OUTPUT_BUFFER-1, &data_read);
+		sqlite3_client_phase(sample, SQLITE3_STATS_READ, &mark);
+		if (err == ESP_OK) {
+			int status_code = esp_http_client_get_status_code(client);
+			ESP_LOGI(TAG, "HTTP %s Status = %d, data_read=%d", method_name, status_code, data_read);
+			ESP_LOG_BUFFER_HEXDUMP(TAG, output_buffer, data_read, ESP_LOG_DEBUG);
+			output_buffer[data_read] = 0;
+			ESP_LOGD(TAG, "\n%s", output_buffer);
+			cJSON *root = cJSON_Parse(output_buffer);
+			char *response_string = cJSON_Print(root);
+			ESP_LOGI(TAG, "response_string\n%s",response_string);
+			cJSON_free(response_string);
+			sqlite3_client_phase(sample, SQLITE3_STATS_DECODE, &mark);
+			sqlite3_stats_heap(sample);
+			if (reply) {
+				const char *location = http_pool_get_header(client, "Location");
+				strlcpy(reply->location, location ? location : "", sizeof(reply->location));
+				reply->body = root;
+			} else {
+				cJSON_Delete(root);
+			}
+			if (status_code == 404) {
+				ret = ESP_ERR_NOT_FOUND;
+			} else if (status_code >= 400) {
+				ret = ESP_ERR_INVALID_RESPONSE;
+			} else {
+				ret = ESP_OK;
+			}
+		} else {
+			ESP_LOGE(TAG, "HTTP client read response failed: %s", esp_err_to_name(err));
+			ret = err;
+		}
+	}
+	json_arena_delete(arena);
+	http_pool_release(client);
+	http_buffer_put(output_buffer);
+	free(compressed);
+	return ret;
+}
+
+esp_err_t sqlite3_client_request(esp_http_client_method_t method, const char * path, const char * data, int data_len)
+{
+	return sqlite3_client_request_ex(method, path, data, data_len, NULL);
+}
+
+bool sqlite3_client_unreachable(esp_err_t err)
+{
+	return err != ESP_OK && err != ESP_ERR_NOT_FOUND && err != ESP_ERR_INVALID_RESPONSE;
+}
+
+/*
+ * Writes go through the write-ahead queue when the server cannot be reached,
+ * and also while older writes are still waiting there, so that the order is kept.
+ * ESP_ERR_NOT_FINISHED tells the caller that the write was journaled for replay.
+ */
+static esp_err_t sqlite3_client_send_ex(esp_http_client_method_t method, const char * path, const char * data, int data_len, sqlite3_client_reply_t *reply)
+{
+	esp_err_t ret;
+#if CONFIG_ESP_WAL_ENABLE
+	if (sqlite3_wal_pending()) {
+		ret = sqlite3_wal_append(method, path, data, data_len);
+		// While the server is down the replay waits for its next retry, not for every write
+		if (!sqlite3_wal_offline()) sqlite3_wal_kick();
+		if (ret == ESP_OK) ret = ESP_ERR_NOT_FINISHED;
+	} else {
+		ret = sqlite3_client_request_ex(method, path, data, data_len, reply);
+		if (sqlite3_client_unreachable(ret)) {
+			if (sqlite3_wal_append(method, path, data, data_len) == ESP_OK) ret = ESP_ERR_NOT_FINISHED;
+		}
+	}
+#else
+	ret = sqlite3_client_request_ex(method, path, data, data_len, reply);
+#endif
+#if CONFIG_ESP_CACHE_ENABLE
+	/*
+	 * Only once the write is sent: a read in between would cache the old row again.
+	 * Also after an error, as a request that timed out may still have been applied.
+	 * A journaled write is dropped again when it is replayed (sqlite3_client_replayed()).
+	 */
+	if (method != HTTP_METHOD_POST) sqlite3_client_invalidate(path);
+#endif
+#if CONFIG_ESP_REPLICA_ENABLE
+	// A journaled write is applied too, so that local reads see it while the server is down
+	if (ret == ESP_OK || ret == ESP_ERR_NOT_FINISHED) sqlite3_replica_apply(method, path, data, data_len);
+#endif
+	return ret;
+}
+
+esp_err_t sqlite3_client_send(esp_http_client_method_t method, const char * path, const char * data, int data_len)
+{
+	return sqlite3_client_send_ex(method, path, data, data_len, NULL);
+}
+
+void sqlite3_client_replayed(esp_http_client_method_t method, const char * path, const char * data, int data_len, esp_err_t err)
+{
+#if CONFIG_ESP_CACHE_ENABLE
+	// Rows read while the write waited in the queue were cached with the old values
+	if (method != HTTP_METHOD_POST) sqlite3_client_invalidate(path);
+#endif
+#if CONFIG_ESP_REPLICA_ENABLE
+	if (method == HTTP_METHOD_POST) {
+		// The rows are on the server now, for the next sync to fetch
+		if (err == ESP_OK) sqlite3_replica_apply(method, path, data, data_len);
+	} else if (err != ESP_OK) {
+		// The replica took the write when it was journaled
+		sqlite3_replica_rejected(path);
+	}
+#endif
+}
+
+/* An integer id given as a JSON number or as a numeric string, -1 otherwise */
+static int sqlite3_client_json_id(const cJSON *item)
+{
+	if (cJSON_IsNumber(item)) return item->valueint;
+	if (cJSON_IsString(item) && item->valuestring[0]) {
+		char *end;
+		long value = strtol(item->valuestring, &end, 10);
+		if (*end == 0) return value;
+	}
+	return -1;
+}
+
+int sqlite3_client_row_id(const cJSON *row)
+{
+	return sqlite3_client_json_id(cJSON_GetObjectItem(row, "id"));
+}
+
+/*
+ * A posted value and the value read back are the same when they print the same:
+ * ArrestDB may hand numbers back as strings.
+ */
+static bool sqlite3_client_same_value(const cJSON *posted, const cJSON *stored)
+{
+	if (cJSON_IsNull(posted)) return stored == NULL || cJSON_IsNull(stored);
+	if (stored == NULL) return false;
+	if (cJSON_IsString(posted) && cJSON_IsString(stored)) return strcmp(posted->valuestring, stored->valuestring) == 0;
+	if (cJSON_IsNumber(posted) && cJSON_IsNumber(stored)) return posted->valuedouble == stored->valuedouble;
+	if (cJSON_IsNumber(posted) && cJSON_IsString(stored)) {
+		char *end;
+		double value = strtod(stored->valuestring, &end);
+		return end != stored->valuestring && *end == 0 && value == posted->valuedouble;
+	}
+	if (cJSON_IsBool(posted)) return sqlite3_client_json_id(stored) == (cJSON_IsTrue(posted) ? 1 : 0);
+	return false;
+}
+
+/* True when the stored row carries every posted column with the posted value */
+static bool sqlite3_client_same_row(const cJSON *posted, const cJSON *stored)
+{
+	if (!cJSON_IsObject(stored)) return false;
+	const cJSON *column = NULL;
+	cJSON_ArrayForEach(column, posted) {
+		if (!sqlite3_client_same_value(column, cJSON_GetObjectItem(stored, column->string))) return false;
+	}
+	return true;
+}
+
+#define MAX_CREATE_CANDIDATES 8
+
+typedef struct {
+	const cJSON *posted;
+	int id;
+	cJSON *row;             // the matching row, when the caller asked for it
+} sqlite3_client_match_t;
+
+static esp_err_t sqlite3_client_match_row(const cJSON *row, void *ctx)
+{
+	sqlite3_client_match_t *match = ctx;
+	if (match->id >= 0 || !sqlite3_client_same_row(match->posted, row)) return ESP_OK;
+	match->id = sqlite3_client_json_id(cJSON_GetObjectItem(row, "id"));
+	if (match->id >= 0 && match->row == NULL) match->row = cJSON_Duplicate(row, true);
+	return ESP_OK;
+}
+
+/*
+ * Fallback when the server tells nothing about the new row: filter the table on the first
+ * posted column and take the newest row whose columns all equal the posted values.
+ * Unlike max(id) this never picks up a different row inserted by another client;
+ * only an identical row inserted at the same moment can be taken for ours.
+ */
+static esp_err_t sqlite3_client_find_created(const char * table, const cJSON *posted, int *id, cJSON **row)
+{
+	const cJSON *column = NULL;
+	char value[32];
+	sqlite3_query_t query;
+	sqlite3_query_init(&query, table);
+	cJSON_ArrayForEach(column, posted) {
+		if (cJSON_IsString(column) && column->valuestring[0] && column->string[0]) {
+			sqlite3_query_where(&query, column->string, column->valuestring);
+			break;
+		} else if (cJSON_IsNumber(column) && column->string[0]) {
+			snprintf(value, sizeof(value), "%.17g", column->valuedouble);
+			sqlite3_query_where(&query, column->string, value);
+			break;
+		}
+	}
+	if (column == NULL) return ESP_ERR_NOT_SUPPORTED;
+	sqlite3_query_order(&query, "id", true);
+	sqlite3_query_limit(&query, MAX_CREATE_CANDIDATES, 0);
+	const char *path = sqlite3_query_path(&query);
+	if (path == NULL) return sqlite3_query_error(&query);
+
+	sqlite3_client_match_t match = {
+		.posted = posted,
+		.id = -1,
+		.row = NULL,
+	};
+	esp_err_t err = sqlite3_client_get_rows(path, sqlite3_client_match_row, &match);
+	if (err == ESP_OK && match.id < 0) err = ESP_ERR_NOT_FOUND;
+	*id = match.id;
+	if (row) {
+		*row = match.row;
+	} else {
+		cJSON_Delete(match.row);
+	}
+	return err;
+}
+
+/* "/customers/5" or "http://host/customers/5" */
+static int sqlite3_client_location_id(const char *location)
+{
+	const char *slash = strrchr(location, '/');
+	if (slash == NULL || slash[1] == 0) return -1;
+	char *end;
+	long value = strtol(slash + 1, &end, 10);
+	return (*end == 0) ? value : -1;
+}
+
+esp_err_t sqlite3_client_create(const char * table, const char * data, int data_len, int *id, cJSON **row)
+{
+	ESP_LOGI(TAG, "sqlite3_client_create table=%s", table);
+	*id = -1;
+	if (row) *row = NULL;
+	cJSON *posted = cJSON_ParseWithLength(data, data_len);
+	if (!cJSON_IsObject(posted)) {
+		cJSON_Delete(posted);
+		return ESP_ERR_INVALID_ARG;
+	}
+	char _table[32];
+	if (*table == '/') table++;
+	size_t table_len = strcspn(table, "/?");
+	if (table_len == 0 || table_len >= sizeof(_table)) {
+		cJSON_Delete(posted);
+		return ESP_ERR_INVALID_ARG;
+	}
+	memcpy(_table, table, table_len);
+	_table[table_len] = 0;
+
+	sqlite3_client_reply_t reply = {0};
+	esp_err_t err = sqlite3_client_send_ex(HTTP_METHOD_POST, _table, data, data_len, &reply);
+	if (err == ESP_OK) {
+		// The new id, from the response body ({"id": 5}, the stored row, or the success object) ...
+		const cJSON *body = reply.body;
+		if (cJSON_IsObject(body) && !cJSON_HasObjectItem(body, "id")) body = cJSON_GetObjectItem(body, "success");
+		if (cJSON_IsNumber(reply.body)) *id = reply.body->valueint;
+		if (cJSON_IsObject(body)) *id = sqlite3_client_json_id(cJSON_GetObjectItem(body, "id"));
+		if (*id >= 0 && row && body == reply.body && sqlite3_client_same_row(posted, body)) {
+			// The server answered with the stored row itself
+			*row = reply.body;
+			reply.body = NULL;
+		}
+		// ... or from the Location header ...
+		if (*id < 0 && reply.location[0]) *id = sqlite3_client_location_id(reply.location);
+		if (*id >= 0) {
+			ESP_LOGI(TAG, "created %s/%d", _table, *id);
+		} else {
+			// ... or, when the server tells neither, by looking the row up
+			ESP_LOGW(TAG, "server did not return the new id, looking the row up");
+			err = sqlite3_client_find_created(_table, posted, id, row);
+		}
+	}
+	if (err == ESP_OK && row && *row == NULL) {
+		// The posted columns and the id are all that is known about the row
+		cJSON *created = cJSON_CreateObject();
+		if (created) {
+			cJSON_AddNumberToObject(created, "id", *id);
+			const cJSON *column = NULL;
+			cJSON_ArrayForEach(column, posted) {
+				cJSON_AddItemToObject(created, column->string, cJSON_Duplicate(column, true));
+			}
+		}
+		*row = created;
+	}
+	cJSON_Delete(reply.body);
+	cJSON_Delete(posted);
+	return err;
+}
+
+esp_err_t sqlite3_client_post(char * path, char * name, int gender)
+{
+	ESP_LOGI(TAG, "sqlite3_client_post path=%s",path);
+	char post_data[64];
+	//sprintf(post_data, "name=%s&gender=%d", name, gender);
+	snprintf(post_data, sizeof(post_data), "{\"name\":\"%s\", \"gender\":%d}", name, gender);
+	return sqlite3_client_send(HTTP_METHOD_POST, path, post_data, strlen(post_data));
+}
+
+esp_err_t sqlite3_client_put(char * path, char * name, int gender)
+{
+	ESP_LOGI(TAG, "sqlite3_client_put path=%s",path);
+	char post_data[64];
+	//sprintf(post_data, "name=%s&gender=%d", name, gender);
+	snprintf(post_data, sizeof(post_data), "{\"name\":\"%s\", \"gender\":%d}", name, gender);
+	return sqlite3_client_send(HTTP_METHOD_PUT, path, post_data, strlen(post_data));
+}
+
+esp_err_t sqlite3_client_delete(char * path)
+{
+	ESP_LOGI(TAG, "sqlite3_client_delete path=%s",path);
+	return sqlite3_client_send(HTTP_METHOD_DELETE, path, NULL, 0);
+}
+
+static esp_err_t sqlite3_client_maxid_row(const cJSON *row, void *ctx)
+{
+	*(int *)ctx = sqlite3_client_row_id(row);
+	return ESP_OK;
+}
+
+int sqlite3_client_get_maxid(char * path)
+{
+	ESP_LOGI(TAG, "sqlite3_client_get_maxid path=%s",path);
+	sqlite3_query_t query;
+	if (*path == '/') path++;
+	sqlite3_query_init(&query, path);
+	sqlite3_query_order(&query, "id", true);
+	sqlite3_query_limit(&query, 1, 0);
+	const char *_path = sqlite3_query_path(&query);
+	if (_path == NULL) return -1;
+	ESP_LOGI(TAG, "_path=[%s]", _path);
+	//_path = "customers?by=id&order=desc&limit=1"
+	// An error status or a row without an id leaves -1
+	int newid = -1;
+	esp_err_t err = sqlite3_client_get_rows(_path, sqlite3_client_maxid_row, &newid);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "sqlite3_client_get_maxid failed: %s", esp_err_to_name(err));
+		return -1;
+	}
+	ESP_LOGD(TAG, "newid=%d",newid);
+	return newid;
+}
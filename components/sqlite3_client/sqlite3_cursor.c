@@ -0,0 +1,205 @@
+/* Paged table cursor with background prefetch
+ *
+ * This sample code is in the public domain.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "json_arena.h"
+#include "sqlite3_client.h"
+#include "sqlite3_cursor.h"
+#include "sqlite3_query.h"
+
+typedef struct {
+	char *text;             // rows as consecutive NUL terminated JSON strings
+	size_t size;
+	size_t len;
+	int rows;
+} sqlite3_cursor_page_t;
+
+struct sqlite3_cursor {
+	char table[32];
+	char by[32];
+	char order[8];
+	int page_size;
+	int offset;             // offset of the next page to request
+
+	sqlite3_cursor_page_t pages[2];
+	int current;            // page being consumed, the other one is being prefetched
+	int next_row;
+	size_t next_text;
+	bool last_page;         // the page being consumed is the final one
+	cJSON *row;
+	json_arena_t *arena;    // holds row, reset for every row
+
+	TaskHandle_t task;
+	SemaphoreHandle_t fetch_request;
+	SemaphoreHandle_t fetch_done;
+	bool in_flight;
+	bool closing;
+	esp_err_t fetch_result;
+};
+
+static const char *TAG = "CURSOR";
+
+static esp_err_t sqlite3_cursor_collect(const char *row, size_t row_len, void *ctx)
+{
+	sqlite3_cursor_page_t *page = ctx;
+	if (page->len + row_len + 1 > page->size) {
+		size_t size = page->size ? page->size * 2 : 1024;
+		while (size < page->len + row_len + 1) size *= 2;
+		char *text = realloc(page->text, size);
+		if (text == NULL) return ESP_ERR_NO_MEM;
+		page->text = text;
+		page->size = size;
+	}
+	memcpy(page->text + page->len, row, row_len + 1);
+	page->len += row_len + 1;
+	page->rows++;
+	return ESP_OK;
+}
+
+static esp_err_t sqlite3_cursor_fetch(sqlite3_cursor_handle_t cursor, sqlite3_cursor_page_t *page)
+{
+	sqlite3_query_t query;
+	sqlite3_query_init(&query, cursor->table);
+	sqlite3_query_order(&query, cursor->by, strcasecmp(cursor->order, "desc") == 0);
+	sqlite3_query_limit(&query, cursor->page_size, cursor->offset);
+	const char *path = sqlite3_query_path(&query);
+	if (path == NULL) return sqlite3_query_error(&query);
+	page->len = 0;
+	page->rows = 0;
+	esp_err_t err = sqlite3_client_get_raw(path, sqlite3_cursor_collect, page);
+	// ArrestDB answers 404 when the offset is past the last row
+	if (err == ESP_ERR_NOT_FOUND) err = ESP_OK;
+	if (err == ESP_OK) cursor->offset += cursor->page_size;
+	ESP_LOGD(TAG, "fetched %d rows from %s", page->rows, path);
+	return err;
+}
+
+static void sqlite3_cursor_task(void *pvParameters)
+{
+	sqlite3_cursor_handle_t cursor = pvParameters;
+	while (1) {
+		xSemaphoreTake(cursor->fetch_request, portMAX_DELAY);
+		if (cursor->closing) break;
+		cursor->fetch_result = sqlite3_cursor_fetch(cursor, &cursor->pages[!cursor->current]);
+		xSemaphoreGive(cursor->fetch_done);
+	}
+	xSemaphoreGive(cursor->fetch_done);
+	vTaskDelete(NULL);
+}
+
+static void sqlite3_cursor_prefetch(sqlite3_cursor_handle_t cursor)
+{
+	cursor->in_flight = true;
+	xSemaphoreGive(cursor->fetch_request);
+}
+
+static esp_err_t sqlite3_cursor_wait(sqlite3_cursor_handle_t cursor)
+{
+	if (!cursor->in_flight) return ESP_OK;
+	xSemaphoreTake(cursor->fetch_done, portMAX_DELAY);
+	cursor->in_flight = false;
+	return cursor->fetch_result;
+}
+
+esp_err_t sqlite3_cursor_open(const sqlite3_cursor_config_t *config, sqlite3_cursor_handle_t *cursor)
+{
+	sqlite3_cursor_handle_t _cursor = calloc(1, sizeof(struct sqlite3_cursor));
+	if (_cursor == NULL) return ESP_ERR_NO_MEM;
+	strlcpy(_cursor->table, config->table, sizeof(_cursor->table));
+	strlcpy(_cursor->by, config->by ? config->by : "id", sizeof(_cursor->by));
+	strlcpy(_cursor->order, config->order ? config->order : "asc", sizeof(_cursor->order));
+	_cursor->page_size = config->page_size > 0 ? config->page_size : CONFIG_ESP_CURSOR_PAGE_SIZE;
+
+	_cursor->fetch_request = xSemaphoreCreateBinary();
+	_cursor->fetch_done = xSemaphoreCreateBinary();
+	_cursor->arena = json_arena_create(CONFIG_ESP_JSON_ARENA_SIZE);
+	if (_cursor->fetch_request == NULL || _cursor->fetch_done == NULL || _cursor->arena == NULL) goto fail;
+	if (xTaskCreate(sqlite3_cursor_task, "CURSOR", CONFIG_ESP_SQLITE3_TASK_STACK, _cursor, uxTaskPriorityGet(NULL), &_cursor->task) != pdPASS) goto fail;
+
+	// The first page is requested right away, sqlite3_cursor_next() waits for it
+	sqlite3_cursor_prefetch(_cursor);
+	*cursor = _cursor;
+	return ESP_OK;
+
+fail:
+	if (_cursor->fetch_request) vSemaphoreDelete(_cursor->fetch_request);
+	if (_cursor->fetch_done) vSemaphoreDelete(_cursor->fetch_done);
+	json_arena_delete(_cursor->arena);
+	free(_cursor);
+	return ESP_ERR_NO_MEM;
+}
+
+static void sqlite3_cursor_free_row(sqlite3_cursor_handle_t cursor)
+{
+	json_arena_begin(cursor->arena);
+	cJSON_Delete(cursor->row);
+	json_arena_end(cursor->arena);
+	json_arena_reset(cursor->arena);
+	cursor->row = NULL;
+}
+
+esp_err_t sqlite3_cursor_next(sqlite3_cursor_handle_t cursor, const cJSON **row)
+{
+	sqlite3_cursor_free_row(cursor);
+
+	sqlite3_cursor_page_t *page = &cursor->pages[cursor->current];
+	if (cursor->next_row >= page->rows) {
+		if (cursor->last_page) return ESP_ERR_NOT_FOUND;
+		esp_err_t err = sqlite3_cursor_wait(cursor);
+		if (err != ESP_OK) {
+			// The offset was not advanced: ask for the same page again, so that the next call retries it
+			sqlite3_cursor_prefetch(cursor);
+			return err;
+		}
+		cursor->current = !cursor->current;
+		cursor->next_row = 0;
+		cursor->next_text = 0;
+		page = &cursor->pages[cursor->current];
+		// A short page is the last one, otherwise fetch the following page while this one is consumed
+		if (page->rows < cursor->page_size) {
+			cursor->last_page = true;
+		} else {
+			sqlite3_cursor_prefetch(cursor);
+		}
+		if (page->rows == 0) return ESP_ERR_NOT_FOUND;
+	}
+
+	const char *text = page->text + cursor->next_text;
+	size_t text_len = strlen(text);
+	cursor->next_text += text_len + 1;
+	cursor->next_row++;
+	json_arena_begin(cursor->arena);
+	cursor->row = cJSON_ParseWithLength(text, text_len);
+	json_arena_end(cursor->arena);
+	if (cursor->row == NULL) {
+		ESP_LOGE(TAG, "cJSON_Parse failed [%s]", text);
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+	*row = cursor->row;
+	return ESP_OK;
+}
+
+void sqlite3_cursor_close(sqlite3_cursor_handle_t cursor)
+{
+	if (cursor == NULL) return;
+	sqlite3_cursor_wait(cursor);
+	cursor->closing = true;
+	xSemaphoreGive(cursor->fetch_request);
+	xSemaphoreTake(cursor->fetch_done, portMAX_DELAY);
+	vSemaphoreDelete(cursor->fetch_request);
+	vSemaphoreDelete(cursor->fetch_done);
+	sqlite3_cursor_free_row(cursor);
+	json_arena_delete(cursor->arena);
+	free(cursor->pages[0].text);
+	free(cursor->pages[1].text);
+	free(cursor);
+}
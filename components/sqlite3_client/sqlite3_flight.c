@@ -0,0 +1,157 @@
+/* Single-flight coalescing of identical reads
+ *
+ * This sample code is in the public domain.
+ */
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "sqlite3_flight.h"
+
+#define MAX_FLIGHT_PATH 128
+
+/* One GET in the air, and its result once it landed */
+struct sqlite3_flight {
+	char path[MAX_FLIGHT_PATH];
+	atomic_int refs;            // the leader and its followers
+	SemaphoreHandle_t landed;   // given once; every follower takes it and gives it back
+	esp_err_t err;
+	atomic_bool shared;         // rows holds the whole result
+	int row_count;
+	cJSON *rows;
+};
+
+static const char *TAG = "FLIGHT";
+
+static struct sqlite3_flight *s_flights[CONFIG_ESP_COALESCE_FLIGHTS];
+static SemaphoreHandle_t s_mutex;
+
+esp_err_t sqlite3_flight_init(void)
+{
+	s_mutex = xSemaphoreCreateMutex();
+	if (s_mutex == NULL) return ESP_ERR_NO_MEM;
+	return ESP_OK;
+}
+
+/* "/customers//gender/2/" -> "customers/gender/2"; the query string is kept as it is */
+static bool sqlite3_flight_normalize(const char *path, char *key, size_t key_size)
+{
+	size_t len = 0;
+	while (*path == '/') path++;
+	for (;*path && *path != '?';path++) {
+		if (*path == '/' && path[1] == '/') continue;
+		if (len + 1 >= key_size) return false;
+		key[len++] = *path;
+	}
+	while (len > 0 && key[len-1] == '/') len--;
+	key[len] = 0;
+	return strlcat(key, path, key_size) < key_size;
+}
+
+sqlite3_flight_handle_t sqlite3_flight_join(const char *path, bool *leader)
+{
+	char key[MAX_FLIGHT_PATH];
+	if (!sqlite3_flight_normalize(path, key, sizeof(key))) return NULL;
+
+	struct sqlite3_flight *flight = NULL;
+	int free_slot = -1;
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	for (int i=0;i<CONFIG_ESP_COALESCE_FLIGHTS;i++) {
+		if (s_flights[i] == NULL) {
+			if (free_slot < 0) free_slot = i;
+		} else if (strcmp(s_flights[i]->path, key) == 0) {
+			// Nothing to wait for when the rows are not kept: read them in parallel
+			if (!atomic_load(&s_flights[i]->shared)) {
+				xSemaphoreGive(s_mutex);
+				return NULL;
+			}
+			flight = s_flights[i];
+			atomic_fetch_add(&flight->refs, 1);
+			*leader = false;
+			break;
+		}
+	}
+	if (flight == NULL && free_slot >= 0) {
+		flight = calloc(1, sizeof(struct sqlite3_flight));
+		if (flight) flight->landed = xSemaphoreCreateBinary();
+		if (flight && flight->landed) {
+			strlcpy(flight->path, key, MAX_FLIGHT_PATH);
+			atomic_store(&flight->refs, 1);
+			atomic_store(&flight->shared, true);
+			s_flights[free_slot] = flight;
+			*leader = true;
+		} else {
+			free(flight);
+			flight = NULL;
+		}
+	}
+	xSemaphoreGive(s_mutex);
+	if (flight && !*leader) ESP_LOGI(TAG, "joined the request in flight for %s", key);
+	return flight;
+}
+
+static void sqlite3_flight_unshare(struct sqlite3_flight *flight)
+{
+	atomic_store(&flight->shared, false);
+	cJSON_Delete(flight->rows);
+	flight->rows = NULL;
+}
+
+void sqlite3_flight_add_row(sqlite3_flight_handle_t flight, const cJSON *row)
+{
+	if (!atomic_load(&flight->shared)) return;
+	// Rows are only copied once someone joined; a follower that comes later than
+	// the first row finds the result unshared and sends its own request
+	if (atomic_load(&flight->refs) == 1 || flight->row_count >= CONFIG_ESP_COALESCE_MAX_ROWS) {
+		sqlite3_flight_unshare(flight);
+		return;
+	}
+	if (flight->rows == NULL) flight->rows = cJSON_CreateArray();
+	cJSON *copy = cJSON_Duplicate(row, true);
+	if (flight->rows == NULL || copy == NULL) {
+		cJSON_Delete(copy);
+		sqlite3_flight_unshare(flight);
+		return;
+	}
+	cJSON_AddItemToArray(flight->rows, copy);
+	flight->row_count++;
+}
+
+void sqlite3_flight_complete(sqlite3_flight_handle_t flight, esp_err_t err, bool complete)
+{
+	// New requests for the path start a flight of their own from now on
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	for (int i=0;i<CONFIG_ESP_COALESCE_FLIGHTS;i++) {
+		if (s_flights[i] == flight) s_flights[i] = NULL;
+	}
+	xSemaphoreGive(s_mutex);
+
+	flight->err = err;
+	if (!complete) {
+		sqlite3_flight_unshare(flight);
+		flight->err = ESP_ERR_INVALID_STATE;
+	}
+	xSemaphoreGive(flight->landed);
+}
+
+esp_err_t sqlite3_flight_wait(sqlite3_flight_handle_t flight, const cJSON **rows)
+{
+	xSemaphoreTake(flight->landed, portMAX_DELAY);
+	xSemaphoreGive(flight->landed);
+	*rows = flight->rows;
+	if (flight->err != ESP_OK) return flight->err;
+	if (!atomic_load(&flight->shared)) return ESP_ERR_INVALID_STATE;
+	return ESP_OK;
+}
+
+void sqlite3_flight_release(sqlite3_flight_handle_t flight)
+{
+	if (atomic_fetch_sub(&flight->refs, 1) != 1) return;
+	cJSON_Delete(flight->rows);
+	vSemaphoreDelete(flight->landed);
+	free(flight);
+}
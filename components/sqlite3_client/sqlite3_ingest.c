@@ -0,0 +1,132 @@
+/* Ring buffer ingestion with batched bulk inserts
+ *
+ * This sample code is in the public domain.
+ */
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+#include "esp_log.h"
+
+#include "sqlite3_client.h"
+#include "sqlite3_ingest.h"
+
+struct sqlite3_ingest {
+	char table[32];
+	int batch_rows;
+	TickType_t flush_ticks;
+	RingbufHandle_t ring;
+	atomic_uint dropped;    // rows rejected because the ring was full
+
+	char *batch;            // "[row,row,...]" being assembled by the flusher
+	size_t batch_size;
+	size_t batch_len;
+	int rows;
+};
+
+static const char *TAG = "INGEST";
+
+static void sqlite3_ingest_flush(sqlite3_ingest_handle_t ingest)
+{
+	if (ingest->rows == 0) return;
+	ingest->batch[ingest->batch_len++] = ']';
+	ESP_LOGI(TAG, "flush %d rows, %d bytes", ingest->rows, (int)ingest->batch_len);
+	esp_err_t err = sqlite3_client_send(HTTP_METHOD_POST, ingest->table, ingest->batch, ingest->batch_len);
+	if (err == ESP_ERR_NOT_FINISHED) {
+		ESP_LOGW(TAG, "bulk insert of %d rows journaled for replay", ingest->rows);
+	} else if (err != ESP_OK) {
+		ESP_LOGE(TAG, "bulk insert of %d rows failed: %s", ingest->rows, esp_err_to_name(err));
+	}
+	ingest->batch_len = 0;
+	ingest->rows = 0;
+}
+
+static void sqlite3_ingest_task(void *pvParameters)
+{
+	sqlite3_ingest_handle_t ingest = pvParameters;
+	TickType_t deadline = 0;
+	sqlite3_client_set_priority(HTTP_POOL_PRIORITY_BACKGROUND);
+	while (1) {
+		// Sleep until a row arrives, or until the deadline of the batch being assembled
+		TickType_t wait = portMAX_DELAY;
+		if (ingest->rows > 0) {
+			int32_t remaining = (int32_t)(deadline - xTaskGetTickCount());
+			wait = remaining > 0 ? remaining : 0;
+		}
+		size_t size;
+		char *row = xRingbufferReceive(ingest->ring, &size, wait);
+		if (row == NULL) {
+			sqlite3_ingest_flush(ingest);
+			continue;
+		}
+
+		// Room for the row, a separator and the closing bracket
+		if (ingest->rows > 0 && ingest->batch_len + size + 2 > ingest->batch_size) {
+			sqlite3_ingest_flush(ingest);
+		}
+		if (size + 2 > ingest->batch_size) {
+			ESP_LOGE(TAG, "row of %d bytes does not fit in a batch", (int)size);
+		} else {
+			if (ingest->rows == 0) {
+				deadline = xTaskGetTickCount() + ingest->flush_ticks;
+				ingest->batch[ingest->batch_len++] = '[';
+			} else {
+				ingest->batch[ingest->batch_len++] = ',';
+			}
+			memcpy(ingest->batch + ingest->batch_len, row, size);
+			ingest->batch_len += size;
+			ingest->rows++;
+		}
+		vRingbufferReturnItem(ingest->ring, row);
+
+		unsigned int dropped = atomic_exchange(&ingest->dropped, 0);
+		if (dropped) ESP_LOGW(TAG, "%u rows dropped, ring buffer full", dropped);
+
+		if (ingest->rows >= ingest->batch_rows) sqlite3_ingest_flush(ingest);
+	}
+}
+
+esp_err_t sqlite3_ingest_create(const sqlite3_ingest_config_t *config, sqlite3_ingest_handle_t *ingest)
+{
+	sqlite3_ingest_handle_t _ingest = calloc(1, sizeof(struct sqlite3_ingest));
+	if (_ingest == NULL) return ESP_ERR_NO_MEM;
+	strlcpy(_ingest->table, config->table, sizeof(_ingest->table));
+	_ingest->batch_rows = config->batch_rows > 0 ? config->batch_rows : CONFIG_ESP_INGEST_BATCH_ROWS;
+	_ingest->flush_ticks = pdMS_TO_TICKS(config->flush_ms > 0 ? config->flush_ms : CONFIG_ESP_INGEST_FLUSH_MS);
+	atomic_init(&_ingest->dropped, 0);
+
+	_ingest->batch_size = CONFIG_ESP_INGEST_BATCH_SIZE;
+	_ingest->batch = malloc(_ingest->batch_size);
+	_ingest->ring = xRingbufferCreate(config->ring_size > 0 ? config->ring_size : CONFIG_ESP_INGEST_RING_SIZE, RINGBUF_TYPE_NOSPLIT);
+	if (_ingest->batch == NULL || _ingest->ring == NULL) goto fail;
+	if (xTaskCreate(sqlite3_ingest_task, "INGEST", CONFIG_ESP_SQLITE3_TASK_STACK, _ingest, 1, NULL) != pdPASS) goto fail;
+	*ingest = _ingest;
+	return ESP_OK;
+
+fail:
+	if (_ingest->ring) vRingbufferDelete(_ingest->ring);
+	free(_ingest->batch);
+	free(_ingest);
+	return ESP_ERR_NO_MEM;
+}
+
+esp_err_t sqlite3_ingest_put(sqlite3_ingest_handle_t ingest, const char *row)
+{
+	if (xRingbufferSend(ingest->ring, row, strlen(row), 0) != pdTRUE) {
+		atomic_fetch_add(&ingest->dropped, 1);
+		return ESP_ERR_NO_MEM;
+	}
+	return ESP_OK;
+}
+
+esp_err_t sqlite3_ingest_put_from_isr(sqlite3_ingest_handle_t ingest, const char *row, BaseType_t *higher_priority_task_woken)
+{
+	if (xRingbufferSendFromISR(ingest->ring, row, strlen(row), higher_priority_task_woken) != pdTRUE) {
+		atomic_fetch_add(&ingest->dropped, 1);
+		return ESP_ERR_NO_MEM;
+	}
+	return ESP_OK;
+}
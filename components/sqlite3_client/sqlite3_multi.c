@@ -0,0 +1,196 @@
+/* Multi-get of rows by primary key
+ *
+ * This sample code is in the public domain.
+ */
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+#include "sqlite3_async.h"
+#include "sqlite3_client.h"
+#include "sqlite3_multi.h"
+#include "sqlite3_query.h"
+
+/* A range scan may read up to this many rows per key */
+#define MULTI_DENSE_FACTOR 2
+
+typedef struct {
+	int *keys;              // sorted, without duplicates
+	int count;
+	cJSON **rows;           // rows waiting for their turn
+	int next;               // next key to hand to the callback
+	int offset;             // of the range scan
+	int scan_rows;
+	int lo;                 // keys in [lo, hi] were answered by the range scan
+	int hi;
+	sqlite3_multi_row_cb_t callback;
+	void *ctx;
+	esp_err_t err;
+} sqlite3_multi_t;
+
+static const char *TAG = "MULTI";
+
+static int sqlite3_multi_compare(const void *a, const void *b)
+{
+	int x = *(const int *)a;
+	int y = *(const int *)b;
+	return (x > y) - (x < y);
+}
+
+static void sqlite3_multi_deliver(sqlite3_multi_t *multi, const cJSON *row)
+{
+	if (multi->err == ESP_OK) multi->err = multi->callback(multi->keys[multi->next], row, multi->ctx);
+	multi->next++;
+}
+
+static bool sqlite3_multi_covered(const sqlite3_multi_t *multi, int k)
+{
+	return multi->keys[k] >= multi->lo && multi->keys[k] <= multi->hi;
+}
+
+/*
+ * Rows of the range scan arrive in id order. They go straight to the callback,
+ * unless the scan started above the first key: then the keys below it are looked up first
+ * and the rows are kept until then.
+ */
+static esp_err_t sqlite3_multi_scan_row(const cJSON *row, void *ctx)
+{
+	sqlite3_multi_t *multi = ctx;
+	int id = sqlite3_client_row_id(row);
+	if (multi->scan_rows++ == 0) multi->lo = (multi->offset == 0) ? INT_MIN : id;
+	multi->hi = id;
+	if (multi->lo > multi->keys[0]) {
+		int *key = bsearch(&id, multi->keys, multi->count, sizeof(int), sqlite3_multi_compare);
+		if (key && multi->rows[key - multi->keys] == NULL) {
+			multi->rows[key - multi->keys] = cJSON_Duplicate(row, true);
+			if (multi->rows[key - multi->keys] == NULL) return ESP_ERR_NO_MEM;
+		}
+		return ESP_OK;
+	}
+	// Keys passed over are not in the table
+	while (multi->next < multi->count && multi->keys[multi->next] < id) sqlite3_multi_deliver(multi, NULL);
+	if (multi->next < multi->count && multi->keys[multi->next] == id) sqlite3_multi_deliver(multi, row);
+	return multi->err;
+}
+
+/* Runs in an async worker */
+static esp_err_t sqlite3_multi_lookup_row(const cJSON *row, void *ctx)
+{
+	cJSON **slot = ctx;
+	if (*slot) return ESP_OK;
+	*slot = cJSON_Duplicate(row, true);
+	return (*slot) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static esp_err_t sqlite3_multi_scan(const char * table, sqlite3_multi_t *multi, int span)
+{
+	multi->offset = (multi->keys[0] > 0) ? multi->keys[0] - 1 : 0;
+	sqlite3_query_t query;
+	sqlite3_query_init(&query, table);
+	sqlite3_query_order(&query, "id", false);
+	sqlite3_query_limit(&query, span, multi->offset);
+	const char *path = sqlite3_query_path(&query);
+	if (path == NULL) return sqlite3_query_error(&query);
+	esp_err_t err = sqlite3_client_get_rows(path, sqlite3_multi_scan_row, multi);
+	if (multi->err != ESP_OK) return multi->err;
+	if (err != ESP_OK) {
+		// The point lookups may still be answered by the row cache or the replica
+		ESP_LOGW(TAG, "%s: range scan failed (%s), looking the keys up one by one", table, esp_err_to_name(err));
+		multi->lo = INT_MAX;
+		multi->hi = INT_MIN;
+		return ESP_OK;
+	}
+
+	if (multi->scan_rows == 0) {
+		// Past the end of the table: it either has no rows at all or fewer than the offset
+		multi->lo = (multi->offset == 0) ? INT_MIN : INT_MAX;
+		multi->hi = INT_MAX;
+	} else if (multi->scan_rows < span) {
+		multi->hi = INT_MAX;
+	}
+	ESP_LOGI(TAG, "%s: range scan read %d rows, %d keys left", table, multi->scan_rows, multi->count - multi->next);
+	return ESP_OK;
+}
+
+/*
+ * Look up the keys the range scan did not answer, CONFIG_ESP_MULTI_CONCURRENCY at a time,
+ * and hand every remaining key to the callback in order.
+ * On an error the lookups in flight are still waited for, so that no worker writes into freed rows.
+ */
+static void sqlite3_multi_lookup(const char * table, sqlite3_multi_t *multi, sqlite3_async_handle_t *handles)
+{
+	int submit = multi->next;
+	int in_flight = 0;
+	sqlite3_query_t query;
+	while (multi->next < multi->count) {
+		int k = multi->next;
+		while (multi->err == ESP_OK && in_flight < CONFIG_ESP_MULTI_CONCURRENCY && submit < multi->count) {
+			if (!sqlite3_multi_covered(multi, submit)) {
+				sqlite3_query_init(&query, table);
+				sqlite3_query_id(&query, multi->keys[submit]);
+				if (sqlite3_query_path(&query)) {
+					handles[submit] = sqlite3_async_get_rows(sqlite3_query_path(&query), sqlite3_multi_lookup_row, &multi->rows[submit], NULL, NULL);
+				}
+				if (handles[submit]) in_flight++;
+			}
+			submit++;
+		}
+		if (!sqlite3_multi_covered(multi, k)) {
+			esp_err_t result = ESP_OK;
+			if (handles[k]) {
+				sqlite3_async_wait(handles[k], portMAX_DELAY, &result);
+				sqlite3_async_free(handles[k]);
+				handles[k] = NULL;
+				in_flight--;
+			} else if (multi->err == ESP_OK) {
+				// The queue was full, so this one is read here
+				sqlite3_query_init(&query, table);
+				sqlite3_query_id(&query, multi->keys[k]);
+				result = sqlite3_query_path(&query) ? sqlite3_client_get_rows(sqlite3_query_path(&query), sqlite3_multi_lookup_row, &multi->rows[k]) : sqlite3_query_error(&query);
+			}
+			if (result != ESP_OK && result != ESP_ERR_NOT_FOUND && multi->err == ESP_OK) multi->err = result;
+		}
+		sqlite3_multi_deliver(multi, multi->rows[k]);
+		cJSON_Delete(multi->rows[k]);
+		multi->rows[k] = NULL;
+	}
+}
+
+esp_err_t sqlite3_multi_get(const char * table, const int *ids, int count, sqlite3_multi_row_cb_t callback, void *ctx)
+{
+	if (count <= 0) return ESP_OK;
+	sqlite3_multi_t multi = {
+		.lo = INT_MAX,
+		.hi = INT_MIN,
+		.callback = callback,
+		.ctx = ctx,
+	};
+	void *memory = calloc(count, sizeof(int) + sizeof(cJSON *) + sizeof(sqlite3_async_handle_t));
+	if (memory == NULL) return ESP_ERR_NO_MEM;
+	multi.rows = memory;
+	sqlite3_async_handle_t *handles = (sqlite3_async_handle_t *)(multi.rows + count);
+	multi.keys = (int *)(handles + count);
+	memcpy(multi.keys, ids, count * sizeof(int));
+	qsort(multi.keys, count, sizeof(int), sqlite3_multi_compare);
+	for (int i=0;i<count;i++) {
+		if (multi.count == 0 || multi.keys[multi.count-1] != multi.keys[i]) multi.keys[multi.count++] = multi.keys[i];
+	}
+
+	// One round trip for the scan against count / CONFIG_ESP_MULTI_CONCURRENCY for the lookups
+	long span = (long)multi.keys[multi.count-1] - multi.keys[0] + 1;
+	bool dense = multi.count > CONFIG_ESP_MULTI_CONCURRENCY && span <= (long)multi.count * MULTI_DENSE_FACTOR;
+	ESP_LOGI(TAG, "%s: %d keys over %ld ids, %s", table, multi.count, span, dense ? "range scan" : "point lookups");
+	esp_err_t err = ESP_OK;
+	if (dense) err = sqlite3_multi_scan(table, &multi, span);
+	if (err == ESP_OK) {
+		sqlite3_multi_lookup(table, &multi, handles);
+		err = multi.err;
+	}
+	for (int i=0;i<multi.count;i++) cJSON_Delete(multi.rows[i]);
+	free(memory);
+	return err;
+}
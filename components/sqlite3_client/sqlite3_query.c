@@ -0,0 +1,153 @@
+/* Query builder for ArrestDB paths
+ *
+ * This sample code is in the public domain.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "sqlite3_query.h"
+
+static const char *TAG = "QUERY";
+
+bool sqlite3_query_escape(char *out, size_t out_size, const char *in)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	size_t len = 0;
+	for (; *in; in++) {
+		unsigned char c = *in;
+		bool plain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || strchr("-._~", c);
+		if (len + (plain ? 1 : 3) >= out_size) return false;
+		if (plain) {
+			out[len++] = c;
+		} else {
+			out[len++] = '%';
+			out[len++] = hex[c >> 4];
+			out[len++] = hex[c & 15];
+		}
+	}
+	out[len] = 0;
+	return true;
+}
+
+static esp_err_t sqlite3_query_fail(sqlite3_query_t *query, esp_err_t err)
+{
+	if (query->err == ESP_OK) {
+		ESP_LOGE(TAG, "%s... : %s", query->path, esp_err_to_name(err));
+		query->err = err;
+	}
+	return err;
+}
+
+static esp_err_t sqlite3_query_append(sqlite3_query_t *query, const char *text, bool escape)
+{
+	char *end = query->path + query->len;
+	size_t room = SQLITE3_QUERY_MAX_PATH - query->len;
+	bool fits = escape ? sqlite3_query_escape(end, room, text) : strlcpy(end, text, room) < room;
+	if (!fits) {
+		*end = 0;
+		return sqlite3_query_fail(query, ESP_ERR_INVALID_SIZE);
+	}
+	query->len += strlen(end);
+	return ESP_OK;
+}
+
+/* "/name" for a filter, "?name=" or "&name=" for a parameter */
+static esp_err_t sqlite3_query_begin(sqlite3_query_t *query, const char *name, bool parameter)
+{
+	if (query->err != ESP_OK) return query->err;
+	if (!parameter) {
+		if (query->filtered) return sqlite3_query_fail(query, ESP_ERR_NOT_SUPPORTED);
+		if (query->parameters) return sqlite3_query_fail(query, ESP_ERR_INVALID_STATE);
+		query->filtered = true;
+		if (sqlite3_query_append(query, "/", false) != ESP_OK) return query->err;
+		return sqlite3_query_append(query, name, true);
+	}
+	if (sqlite3_query_append(query, query->parameters ? "&" : "?", false) != ESP_OK) return query->err;
+	query->parameters = true;
+	if (sqlite3_query_append(query, name, false) != ESP_OK) return query->err;
+	return sqlite3_query_append(query, "=", false);
+}
+
+esp_err_t sqlite3_query_init(sqlite3_query_t *query, const char *table)
+{
+	memset(query, 0, sizeof(sqlite3_query_t));
+	if (table == NULL || *table == 0) return sqlite3_query_fail(query, ESP_ERR_INVALID_ARG);
+	return sqlite3_query_append(query, table, true);
+}
+
+esp_err_t sqlite3_query_id(sqlite3_query_t *query, int id)
+{
+	char value[12];
+	snprintf(value, sizeof(value), "%d", id);
+	return sqlite3_query_begin(query, value, false);
+}
+
+esp_err_t sqlite3_query_where(sqlite3_query_t *query, const char *column, const char *value)
+{
+	// ArrestDB cannot route an empty segment
+	if (*column == 0 || *value == 0) return sqlite3_query_fail(query, ESP_ERR_INVALID_ARG);
+	if (sqlite3_query_begin(query, column, false) != ESP_OK) return query->err;
+	if (sqlite3_query_append(query, "/", false) != ESP_OK) return query->err;
+	return sqlite3_query_append(query, value, true);
+}
+
+esp_err_t sqlite3_query_where_int(sqlite3_query_t *query, const char *column, long value)
+{
+	char text[24];
+	snprintf(text, sizeof(text), "%ld", value);
+	return sqlite3_query_where(query, column, text);
+}
+
+esp_err_t sqlite3_query_order(sqlite3_query_t *query, const char *by, bool descending)
+{
+	if (sqlite3_query_begin(query, "by", true) != ESP_OK) return query->err;
+	if (sqlite3_query_append(query, by, true) != ESP_OK) return query->err;
+	if (sqlite3_query_begin(query, "order", true) != ESP_OK) return query->err;
+	return sqlite3_query_append(query, descending ? "desc" : "asc", false);
+}
+
+esp_err_t sqlite3_query_limit(sqlite3_query_t *query, int limit, int offset)
+{
+	if (limit < 0 || offset < 0 || (offset > 0 && limit == 0)) return sqlite3_query_fail(query, ESP_ERR_INVALID_ARG);
+	char value[12];
+	if (limit > 0) {
+		snprintf(value, sizeof(value), "%d", limit);
+		if (sqlite3_query_begin(query, "limit", true) != ESP_OK) return query->err;
+		if (sqlite3_query_append(query, value, false) != ESP_OK) return query->err;
+	}
+	if (offset > 0) {
+		snprintf(value, sizeof(value), "%d", offset);
+		if (sqlite3_query_begin(query, "offset", true) != ESP_OK) return query->err;
+		if (sqlite3_query_append(query, value, false) != ESP_OK) return query->err;
+	}
+	return query->err;
+}
+
+esp_err_t sqlite3_query_select(sqlite3_query_t *query, const char *column)
+{
+	if (query->err != ESP_OK) return query->err;
+	if (query->column_count >= SQLITE3_QUERY_MAX_COLUMNS) return sqlite3_query_fail(query, ESP_ERR_INVALID_SIZE);
+	query->columns[query->column_count++] = column;
+	return ESP_OK;
+}
+
+const char *sqlite3_query_path(const sqlite3_query_t *query)
+{
+	return (query->err == ESP_OK) ? query->path : NULL;
+}
+
+esp_err_t sqlite3_query_error(const sqlite3_query_t *query)
+{
+	return query->err;
+}
+
+bool sqlite3_query_selects(const char *key, size_t key_len, void *query)
+{
+	const sqlite3_query_t *_query = query;
+	for (int i=0;i<_query->column_count;i++) {
+		if (strncmp(_query->columns[i], key, key_len) == 0 && _query->columns[i][key_len] == 0) return true;
+	}
+	return false;
+}
@@ -0,0 +1,675 @@
+/* Local replica of remote tables with incremental sync
+ *
+ * This sample code is in the public domain.
+ */
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "cJSON.h"
+
+#include "sqlite3_client.h"
+#include "sqlite3_query.h"
+#include "sqlite3_replica.h"
+
+/*
+ * Every table is one file named <slot>.rep (8.3 names for FAT) holding a sequence of records:
+ *   header | text
+ * The first record names the table. ROW records carry a row as compact JSON, DELETE records drop a row,
+ * and a MARK record is written, and synced to flash, when a sync completed. A later record for the same id
+ * replaces an earlier one, so the file is only appended to until the superseded records take up half of it
+ * and it is rewritten with the live rows. Rows appended after the last MARK are kept but fetched again,
+ * since the mark only moves once all rows below it are in; a torn record at the end is dropped on load.
+ */
+#define REPLICA_MAGIC 0x5052    // "RP"
+#define REPLICA_MAX_TABLES 4
+#define REPLICA_MAX_TABLE 32
+#define REPLICA_MIN_COMPACT 4096
+#define REPLICA_MAX_RESTARTS 3  // syncs read again from the newest row after deletes shifted a page
+
+enum {
+	REPLICA_TABLE = 1,
+	REPLICA_ROW,
+	REPLICA_DELETE,
+	REPLICA_MARK,
+};
+
+typedef struct __attribute__((packed)) {
+	uint16_t magic;
+	uint8_t kind;
+	uint8_t reserved;
+	int32_t id;
+	uint16_t len;           // text that follows
+} sqlite3_replica_record_t;
+
+typedef struct {
+	int id;
+	uint32_t offset;        // of the row text in the file
+	uint16_t len;
+} sqlite3_replica_entry_t;
+
+typedef struct {
+	char table[REPLICA_MAX_TABLE];
+	int slot;
+	FILE *file;
+	uint32_t size;          // new records are appended here
+	uint32_t dead;          // bytes of superseded records
+	int mark;               // largest id of the last completed sync, -1 before the first
+	unsigned int posted;    // inserts sent or replayed by this device
+	unsigned int synced;    // inserts the last completed sync started after
+	sqlite3_replica_entry_t *entries;   // sorted by id
+	int count;
+	int capacity;
+} sqlite3_replica_table_t;
+
+static const char *TAG = "REPLICA";
+
+static SemaphoreHandle_t s_mutex;       // recursive: row callbacks may write to a mirrored table
+static SemaphoreHandle_t s_sync_mutex;  // one sync at a time
+static TaskHandle_t s_sync_task;
+static sqlite3_replica_table_t s_tables[REPLICA_MAX_TABLES];
+static int s_table_count;
+
+static void sqlite3_replica_file_name(char *name, size_t name_size, int slot, const char *ext)
+{
+	snprintf(name, name_size, "%s/%d.%s", CONFIG_ESP_REPLICA_BASE_PATH, slot, ext);
+}
+
+/* Index of the first entry with an id of at least id */
+static int sqlite3_replica_lower_bound(const sqlite3_replica_table_t *table, int id)
+{
+	int low = 0;
+	int high = table->count;
+	while (low < high) {
+		int middle = (low + high) / 2;
+		if (table->entries[middle].id < id) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+static sqlite3_replica_entry_t *sqlite3_replica_find(sqlite3_replica_table_t *table, int id)
+{
+	int i = sqlite3_replica_lower_bound(table, id);
+	return (i < table->count && table->entries[i].id == id) ? &table->entries[i] : NULL;
+}
+
+static esp_err_t sqlite3_replica_index(sqlite3_replica_table_t *table, int id, uint32_t offset, uint16_t len)
+{
+	int i = sqlite3_replica_lower_bound(table, id);
+	if (i < table->count && table->entries[i].id == id) {
+		table->dead += sizeof(sqlite3_replica_record_t) + table->entries[i].len;
+	} else {
+		if (table->count == table->capacity) {
+			int capacity = table->capacity ? table->capacity * 2 : 32;
+			sqlite3_replica_entry_t *entries = realloc(table->entries, capacity * sizeof(sqlite3_replica_entry_t));
+			if (entries == NULL) return ESP_ERR_NO_MEM;
+			table->entries = entries;
+			table->capacity = capacity;
+		}
+		// Rows mostly arrive in id order, so this rarely moves anything
+		memmove(&table->entries[i+1], &table->entries[i], (table->count - i) * sizeof(sqlite3_replica_entry_t));
+		table->count++;
+	}
+	table->entries[i].id = id;
+	table->entries[i].offset = offset;
+	table->entries[i].len = len;
+	return ESP_OK;
+}
+
+static void sqlite3_replica_unindex(sqlite3_replica_table_t *table, int id)
+{
+	int i = sqlite3_replica_lower_bound(table, id);
+	if (i == table->count || table->entries[i].id != id) return;
+	table->dead += sizeof(sqlite3_replica_record_t) + table->entries[i].len;
+	memmove(&table->entries[i], &table->entries[i+1], (table->count - i - 1) * sizeof(sqlite3_replica_entry_t));
+	table->count--;
+}
+
+static esp_err_t sqlite3_replica_write(FILE *f, uint8_t kind, int id, const char *text, size_t len)
+{
+	sqlite3_replica_record_t record = {
+		.magic = REPLICA_MAGIC,
+		.kind = kind,
+		.id = id,
+		.len = len,
+	};
+	if (fwrite(&record, sizeof(record), 1, f) != 1 || (len > 0 && fwrite(text, 1, len, f) != len)) {
+		ESP_LOGE(TAG, "Failed to write record");
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+/* Append a record to the table's file; a ROW record is also entered into the index */
+static esp_err_t sqlite3_replica_append(sqlite3_replica_table_t *table, uint8_t kind, int id, const char *text, size_t len)
+{
+	if (table->file == NULL) return ESP_ERR_INVALID_STATE;
+	fseek(table->file, 0, SEEK_END);
+	esp_err_t err = sqlite3_replica_write(table->file, kind, id, text, len);
+	if (err != ESP_OK) return err;
+	uint32_t offset = table->size + sizeof(sqlite3_replica_record_t);
+	table->size = offset + len;
+	if (kind == REPLICA_ROW) return sqlite3_replica_index(table, id, offset, len);
+	if (kind == REPLICA_DELETE) sqlite3_replica_unindex(table, id);
+	return ESP_OK;
+}
+
+static void sqlite3_replica_sync_file(FILE *f)
+{
+	fflush(f);
+	fsync(fileno(f));
+}
+
+/*
+ * Rewrite the file with the live rows only. The new file is written next to the old one and
+ * renamed over it; load() finishes a rename cut short by a power loss.
+ */
+static esp_err_t sqlite3_replica_compact(sqlite3_replica_table_t *table)
+{
+	char name[64];
+	char temp[64];
+	sqlite3_replica_file_name(name, sizeof(name), table->slot, "rep");
+	sqlite3_replica_file_name(temp, sizeof(temp), table->slot, "tmp");
+	if (table->file == NULL && table->count > 0) return ESP_ERR_INVALID_STATE;
+	char *row = malloc(CONFIG_ESP_JSON_MAX_ROW_SIZE);
+	FILE *f = fopen(temp, "wb");
+	if (row == NULL || f == NULL) {
+		ESP_LOGE(TAG, "Failed to open %s", temp);
+		free(row);
+		if (f) fclose(f);
+		return ESP_FAIL;
+	}
+
+	esp_err_t err = sqlite3_replica_write(f, REPLICA_TABLE, 0, table->table, strlen(table->table));
+	for (int i=0;i<table->count && err == ESP_OK;i++) {
+		const sqlite3_replica_entry_t *entry = &table->entries[i];
+		fseek(table->file, entry->offset, SEEK_SET);
+		if (fread(row, 1, entry->len, table->file) != entry->len) {
+			err = ESP_FAIL;
+			break;
+		}
+		err = sqlite3_replica_write(f, REPLICA_ROW, entry->id, row, entry->len);
+	}
+	if (err == ESP_OK && table->mark >= 0) err = sqlite3_replica_write(f, REPLICA_MARK, table->mark, NULL, 0);
+	sqlite3_replica_sync_file(f);
+	fclose(f);
+	free(row);
+	if (err != ESP_OK) {
+		// The old file and the index stay as they were
+		ESP_LOGE(TAG, "%s: compaction failed", table->table);
+		remove(temp);
+		return err;
+	}
+
+	// The rows now follow each other in id order
+	uint32_t offset = sizeof(sqlite3_replica_record_t) + strlen(table->table);
+	for (int i=0;i<table->count;i++) {
+		offset += sizeof(sqlite3_replica_record_t);
+		table->entries[i].offset = offset;
+		offset += table->entries[i].len;
+	}
+	if (table->mark >= 0) offset += sizeof(sqlite3_replica_record_t);
+
+	// FAT cannot rename over an existing file
+	if (table->file) fclose(table->file);
+	remove(name);
+	rename(temp, name);
+	table->file = fopen(name, "a+b");
+	if (table->file == NULL) {
+		ESP_LOGE(TAG, "Failed to open %s", name);
+		return ESP_FAIL;
+	}
+	ESP_LOGI(TAG, "%s: compacted to %d rows, %"PRIu32" bytes", table->table, table->count, offset);
+	table->size = offset;
+	table->dead = 0;
+	return ESP_OK;
+}
+
+/* Forget every row; the next sync copies the whole table */
+static void sqlite3_replica_clear(sqlite3_replica_table_t *table)
+{
+	table->count = 0;
+	table->mark = -1;
+	// Should the rewrite fail, the old file is loaded again after a restart, mark and all
+	sqlite3_replica_compact(table);
+}
+
+static void sqlite3_replica_compact_if_needed(sqlite3_replica_table_t *table)
+{
+	// On failure the old file and the index stay valid, it is tried again with the next write
+	if (table->dead >= REPLICA_MIN_COMPACT && table->dead >= table->size / 2) sqlite3_replica_compact(table);
+}
+
+/* Rebuild the index from the file a previous run left */
+static esp_err_t sqlite3_replica_load(sqlite3_replica_table_t *table)
+{
+	char name[64];
+	char temp[64];
+	sqlite3_replica_file_name(name, sizeof(name), table->slot, "rep");
+	sqlite3_replica_file_name(temp, sizeof(temp), table->slot, "tmp");
+	if (access(name, F_OK) != 0) rename(temp, name);
+	remove(temp);
+
+	table->file = fopen(name, "a+b");
+	if (table->file == NULL) {
+		ESP_LOGE(TAG, "Failed to open %s", name);
+		return ESP_FAIL;
+	}
+	fseek(table->file, 0, SEEK_END);
+	long file_len = ftell(table->file);
+	fseek(table->file, 0, SEEK_SET);
+
+	uint32_t offset = 0;
+	bool known = false;     // the file belongs to this table
+	bool torn = false;
+	char name_text[REPLICA_MAX_TABLE];
+	while (offset < (uint32_t)file_len) {
+		sqlite3_replica_record_t record;
+		if (fread(&record, sizeof(record), 1, table->file) != 1 || record.magic != REPLICA_MAGIC
+			|| record.len >= CONFIG_ESP_JSON_MAX_ROW_SIZE || offset + sizeof(record) + record.len > (uint32_t)file_len) {
+			torn = true;
+			break;
+		}
+		uint32_t text = offset + sizeof(record);
+		if (!known) {
+			if (record.kind != REPLICA_TABLE || record.len >= sizeof(name_text)
+				|| fread(name_text, 1, record.len, table->file) != record.len) break;
+			name_text[record.len] = 0;
+			if (strcmp(name_text, table->table) != 0) break;
+			known = true;
+		} else if (record.kind == REPLICA_ROW) {
+			if (sqlite3_replica_index(table, record.id, text, record.len) != ESP_OK) return ESP_ERR_NO_MEM;
+		} else if (record.kind == REPLICA_DELETE) {
+			sqlite3_replica_unindex(table, record.id);
+		} else if (record.kind == REPLICA_MARK) {
+			table->mark = record.id;
+		}
+		offset = text + record.len;
+		fseek(table->file, offset, SEEK_SET);
+	}
+	table->size = offset;
+
+	if (!known) {
+		if (file_len > 0) ESP_LOGW(TAG, "%s holds another table, copying %s again", name, table->table);
+		table->count = 0;
+		table->mark = -1;
+		return sqlite3_replica_compact(table);
+	}
+	if (torn) {
+		ESP_LOGW(TAG, "%s ends with a torn record at %"PRIu32, name, offset);
+		return sqlite3_replica_compact(table);
+	}
+	ESP_LOGI(TAG, "%s: %d rows, synced up to id %d", table->table, table->count, table->mark);
+	return ESP_OK;
+}
+
+static sqlite3_replica_table_t *sqlite3_replica_table(const char *table, size_t table_len)
+{
+	for (int i=0;i<s_table_count;i++) {
+		if (strncmp(s_tables[i].table, table, table_len) == 0 && s_tables[i].table[table_len] == 0) return &s_tables[i];
+	}
+	return NULL;
+}
+
+/*
+ * Split "table" or "table/id" into the mirrored table and the id (-1 for the whole table).
+ * NULL for any other path or a table that is not mirrored.
+ */
+static sqlite3_replica_table_t *sqlite3_replica_route(const char *path, int *id)
+{
+	if (*path == '/') path++;
+	size_t table_len = strcspn(path, "/?");
+	const char *rest = path + table_len;
+	*id = -1;
+	if (*rest == '/') {
+		char *end;
+		long value = strtol(rest + 1, &end, 10);
+		if (end == rest + 1 || *end != 0 || value < 0 || value > INT_MAX) return NULL;
+		*id = value;
+	} else if (*rest != 0) {
+		return NULL;
+	}
+	return sqlite3_replica_table(path, table_len);
+}
+
+static esp_err_t sqlite3_replica_read_row(sqlite3_replica_table_t *table, const sqlite3_replica_entry_t *entry, char *row)
+{
+	fseek(table->file, entry->offset, SEEK_SET);
+	if (fread(row, 1, entry->len, table->file) != entry->len) {
+		ESP_LOGE(TAG, "%s: Failed to read row %d", table->table, entry->id);
+		return ESP_FAIL;
+	}
+	row[entry->len] = 0;
+	return ESP_OK;
+}
+
+static esp_err_t sqlite3_replica_sync_table(sqlite3_replica_table_t *table);
+
+/*
+ * Rows this device inserted are above the mark until a sync fetched them, so a whole-table read
+ * waits for that sync rather than leave them out. False when the read has to go to the server.
+ */
+static bool sqlite3_replica_catch_up(sqlite3_replica_table_t *table)
+{
+	xSemaphoreTakeRecursive(s_mutex, portMAX_DELAY);
+	bool behind = table->posted != table->synced;
+	xSemaphoreGiveRecursive(s_mutex);
+	if (!behind) return true;
+	// Bounded, as the caller may be the row callback of a local read and hold the rows a running sync writes
+	if (xSemaphoreTake(s_sync_mutex, pdMS_TO_TICKS(CONFIG_ESP_HTTP_TIMEOUT_MS)) != pdTRUE) return false;
+	esp_err_t err = sqlite3_replica_sync_table(table);
+	xSemaphoreGive(s_sync_mutex);
+	// While the server is down the local rows are all there is
+	return err == ESP_OK || sqlite3_client_unreachable(err);
+}
+
+esp_err_t sqlite3_replica_read(const char *path, json_stream_row_cb_t callback, void *ctx)
+{
+	int id;
+	sqlite3_replica_table_t *table = sqlite3_replica_route(path, &id);
+	if (table == NULL) return ESP_ERR_NOT_SUPPORTED;
+	if (id < 0 && !sqlite3_replica_catch_up(table)) return ESP_ERR_NOT_SUPPORTED;
+	char *row = malloc(CONFIG_ESP_JSON_MAX_ROW_SIZE);
+	if (row == NULL) return ESP_ERR_NO_MEM;
+
+	esp_err_t err = ESP_OK;
+	xSemaphoreTakeRecursive(s_mutex, portMAX_DELAY);
+	if (table->mark < 0 || table->file == NULL || id > table->mark) {
+		// Not synced yet, or a row newer than the last sync
+		err = ESP_ERR_NOT_SUPPORTED;
+	} else if (id >= 0) {
+		sqlite3_replica_entry_t *entry = sqlite3_replica_find(table, id);
+		if (entry == NULL) {
+			err = ESP_ERR_NOT_FOUND;
+		} else {
+			err = sqlite3_replica_read_row(table, entry, row);
+			if (err == ESP_OK) err = callback(row, entry->len, ctx);
+		}
+	} else {
+		// The entry is looked up again for every row, as the callback may change the table
+		int next = 0;
+		while (err == ESP_OK) {
+			int i = sqlite3_replica_lower_bound(table, next);
+			if (i == table->count) break;
+			sqlite3_replica_entry_t entry = table->entries[i];
+			err = sqlite3_replica_read_row(table, &entry, row);
+			if (err == ESP_OK) err = callback(row, entry.len, ctx);
+			if (entry.id == INT_MAX) break;
+			next = entry.id + 1;
+		}
+	}
+	xSemaphoreGiveRecursive(s_mutex);
+	free(row);
+	if (err != ESP_ERR_NOT_SUPPORTED) ESP_LOGD(TAG, "%s: served locally", path);
+	return err;
+}
+
+static int sqlite3_replica_row_id(const char *row, size_t row_len)
+{
+	cJSON *root = cJSON_ParseWithLength(row, row_len);
+	int id = sqlite3_client_row_id(root);
+	cJSON_Delete(root);
+	return id;
+}
+
+typedef struct {
+	sqlite3_replica_table_t *table;
+	int mark;           // rows up to here were synced before
+	int floor;          // lowest id stored by this sync; pages are read newest first, so rows above it are in
+	int top;            // largest id seen
+	int rows;           // rows of the current page
+	int first;          // first (largest) id of the current page
+	int lowest;         // lowest id of the current page
+	int stored;
+} sqlite3_replica_sync_t;
+
+static esp_err_t sqlite3_replica_sync_row(const char *row, size_t row_len, void *ctx)
+{
+	sqlite3_replica_sync_t *sync = ctx;
+	int id = sqlite3_replica_row_id(row, row_len);
+	if (id < 0) {
+		ESP_LOGE(TAG, "%s: row without id [%s]", sync->table->table, row);
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+	if (sync->rows++ == 0) sync->first = id;
+	if (id < sync->lowest) sync->lowest = id;
+	if (id > sync->top) sync->top = id;
+	if (id <= sync->mark || id >= sync->floor) return ESP_OK;
+	xSemaphoreTakeRecursive(s_mutex, portMAX_DELAY);
+	esp_err_t err = sqlite3_replica_append(sync->table, REPLICA_ROW, id, row, row_len);
+	xSemaphoreGiveRecursive(s_mutex);
+	sync->floor = id;
+	sync->stored++;
+	return err;
+}
+
+static esp_err_t sqlite3_replica_sync_table(sqlite3_replica_table_t *table)
+{
+	sqlite3_replica_sync_t sync = {
+		.table = table,
+		.mark = table->mark,
+		.floor = INT_MAX,
+		.top = table->mark,
+	};
+	xSemaphoreTakeRecursive(s_mutex, portMAX_DELAY);
+	unsigned int posted = table->posted;
+	xSemaphoreGiveRecursive(s_mutex);
+	int offset = 0;
+	int restarts = 0;
+	while (1) {
+		sqlite3_query_t query;
+		sqlite3_query_init(&query, table->table);
+		sqlite3_query_order(&query, "id", true);
+		sqlite3_query_limit(&query, CONFIG_ESP_REPLICA_PAGE_SIZE, offset);
+		const char *path = sqlite3_query_path(&query);
+		if (path == NULL) return sqlite3_query_error(&query);
+		sync.rows = 0;
+		sync.lowest = INT_MAX;
+		int floor = sync.floor;
+		esp_err_t err = sqlite3_client_get_raw(path, sqlite3_replica_sync_row, &sync);
+		if (err != ESP_OK) {
+			// The rows stored so far stay, the mark only moves once all of them are in
+			ESP_LOGW(TAG, "%s: sync stopped after %d new rows: %s", table->table, sync.stored, esp_err_to_name(err));
+			return err;
+		}
+		/*
+		 * Pages overlap by one row: a following page starts with the last row of the one before.
+		 * When it starts below, rows deleted meanwhile shifted the page and a row may have been
+		 * skipped, so the table is read again from the newest row; rows already stored above floor are not stored again.
+		 */
+		if (offset > 0 && sync.rows > 0 && sync.first < floor) {
+			if (++restarts > REPLICA_MAX_RESTARTS) {
+				ESP_LOGW(TAG, "%s: rows keep being deleted, sync stopped after %d new rows", table->table, sync.stored);
+				return ESP_ERR_INVALID_STATE;
+			}
+			ESP_LOGW(TAG, "%s: rows were deleted during the sync, reading again", table->table);
+			sync.floor = floor;
+			offset = 0;
+			continue;
+		}
+		if (sync.rows < CONFIG_ESP_REPLICA_PAGE_SIZE || sync.lowest <= sync.mark) break;
+		offset += CONFIG_ESP_REPLICA_PAGE_SIZE - 1;
+	}
+
+	xSemaphoreTakeRecursive(s_mutex, portMAX_DELAY);
+	esp_err_t err = ESP_OK;
+	// An empty table is synced too, ArrestDB ids start at 1
+	int mark = (sync.top < 0) ? 0 : sync.top;
+	if (mark != table->mark) {
+		err = sqlite3_replica_append(table, REPLICA_MARK, mark, NULL, 0);
+		if (err == ESP_OK) {
+			sqlite3_replica_sync_file(table->file);
+			table->mark = mark;
+		}
+	}
+	if (err == ESP_OK) table->synced = posted;
+	sqlite3_replica_compact_if_needed(table);
+	xSemaphoreGiveRecursive(s_mutex);
+	ESP_LOGI(TAG, "%s: %d new rows, synced up to id %d", table->table, sync.stored, table->mark);
+	return err;
+}
+
+esp_err_t sqlite3_replica_sync(const char *table)
+{
+	esp_err_t ret = ESP_OK;
+	xSemaphoreTake(s_sync_mutex, portMAX_DELAY);
+	for (int i=0;i<s_table_count;i++) {
+		if (table && strcmp(s_tables[i].table, table) != 0) continue;
+		esp_err_t err = sqlite3_replica_sync_table(&s_tables[i]);
+		if (err != ESP_OK) ret = err;
+		if (sqlite3_client_unreachable(err)) break;
+	}
+	xSemaphoreGive(s_sync_mutex);
+	return ret;
+}
+
+esp_err_t sqlite3_replica_reset(const char *table)
+{
+	sqlite3_replica_table_t *_table = sqlite3_replica_table(table, strlen(table));
+	if (_table == NULL) return ESP_ERR_NOT_FOUND;
+	xSemaphoreTakeRecursive(s_mutex, portMAX_DELAY);
+	sqlite3_replica_clear(_table);
+	xSemaphoreGiveRecursive(s_mutex);
+	sqlite3_replica_kick();
+	return ESP_OK;
+}
+
+/* Overlay the posted columns on the mirrored row */
+static esp_err_t sqlite3_replica_update(sqlite3_replica_table_t *table, const sqlite3_replica_entry_t *entry, const char *data, int data_len)
+{
+	char *row = malloc(CONFIG_ESP_JSON_MAX_ROW_SIZE);
+	if (row == NULL) return ESP_ERR_NO_MEM;
+	esp_err_t err = sqlite3_replica_read_row(table, entry, row);
+	cJSON *stored = (err == ESP_OK) ? cJSON_ParseWithLength(row, entry->len) : NULL;
+	cJSON *posted = cJSON_ParseWithLength(data, data_len);
+	char *text = NULL;
+	if (cJSON_IsObject(stored) && cJSON_IsObject(posted)) {
+		cJSON *column = posted->child;
+		while (column) {
+			cJSON *next = column->next;
+			cJSON_DetachItemViaPointer(posted, column);
+			cJSON *old = cJSON_GetObjectItem(stored, column->string);
+			if (old) {
+				cJSON_ReplaceItemViaPointer(stored, old, column);
+			} else {
+				cJSON_AddItemToObject(stored, column->string, column);
+			}
+			column = next;
+		}
+		text = cJSON_PrintUnformatted(stored);
+	}
+	int id = entry->id;
+	if (text && strlen(text) < CONFIG_ESP_JSON_MAX_ROW_SIZE) {
+		err = sqlite3_replica_append(table, REPLICA_ROW, id, text, strlen(text));
+	} else {
+		err = ESP_ERR_INVALID_ARG;
+	}
+	cJSON_free(text);
+	cJSON_Delete(posted);
+	cJSON_Delete(stored);
+	free(row);
+	return err;
+}
+
+void sqlite3_replica_apply(esp_http_client_method_t method, const char *path, const char *data, int data_len)
+{
+	int id;
+	sqlite3_replica_table_t *table = sqlite3_replica_route(path, &id);
+	if (table == NULL) return;
+	if (method == HTTP_METHOD_POST) {
+		// The new rows are above the mark and come with the next sync, whole-table reads wait for it
+		xSemaphoreTakeRecursive(s_mutex, portMAX_DELAY);
+		table->posted++;
+		xSemaphoreGiveRecursive(s_mutex);
+		sqlite3_replica_kick();
+		return;
+	}
+	xSemaphoreTakeRecursive(s_mutex, portMAX_DELAY);
+	esp_err_t err = ESP_OK;
+	sqlite3_replica_entry_t *entry = (id >= 0) ? sqlite3_replica_find(table, id) : NULL;
+	if (id < 0) {
+		// A write to the whole table
+		err = ESP_ERR_NOT_SUPPORTED;
+	} else if (entry && method == HTTP_METHOD_DELETE) {
+		err = sqlite3_replica_append(table, REPLICA_DELETE, id, NULL, 0);
+	} else if (entry && method == HTTP_METHOD_PUT) {
+		err = sqlite3_replica_update(table, entry, data, data_len);
+	}
+	if (err == ESP_OK) {
+		sqlite3_replica_compact_if_needed(table);
+	} else {
+		// The local rows can no longer be trusted
+		ESP_LOGW(TAG, "%s: cannot apply the write locally (%s), copying the table again", path, esp_err_to_name(err));
+		sqlite3_replica_clear(table);
+		sqlite3_replica_kick();
+	}
+	xSemaphoreGiveRecursive(s_mutex);
+}
+
+void sqlite3_replica_rejected(const char *path)
+{
+	int id;
+	sqlite3_replica_table_t *table = sqlite3_replica_route(path, &id);
+	if (table == NULL) return;
+	ESP_LOGW(TAG, "%s: the server rejected a write applied locally, copying the table again", path);
+	xSemaphoreTakeRecursive(s_mutex, portMAX_DELAY);
+	sqlite3_replica_clear(table);
+	xSemaphoreGiveRecursive(s_mutex);
+	sqlite3_replica_kick();
+}
+
+static void sqlite3_replica_task(void *pvParameters)
+{
+	sqlite3_client_set_priority(HTTP_POOL_PRIORITY_BACKGROUND);
+	while (1) {
+		ulTaskNotifyTake(pdTRUE, CONFIG_ESP_REPLICA_SYNC_MS ? pdMS_TO_TICKS(CONFIG_ESP_REPLICA_SYNC_MS) : portMAX_DELAY);
+		sqlite3_replica_sync(NULL);
+	}
+}
+
+void sqlite3_replica_kick(void)
+{
+	if (s_sync_task) xTaskNotifyGive(s_sync_task);
+}
+
+esp_err_t sqlite3_replica_add(const char *table)
+{
+	if (strlen(table) >= REPLICA_MAX_TABLE) return ESP_ERR_INVALID_ARG;
+	if (s_table_count == REPLICA_MAX_TABLES) return ESP_ERR_NO_MEM;
+	xSemaphoreTakeRecursive(s_mutex, portMAX_DELAY);
+	sqlite3_replica_table_t *_table = &s_tables[s_table_count];
+	memset(_table, 0, sizeof(sqlite3_replica_table_t));
+	strlcpy(_table->table, table, sizeof(_table->table));
+	_table->slot = s_table_count;
+	_table->mark = -1;
+	esp_err_t err = sqlite3_replica_load(_table);
+	if (err == ESP_OK) s_table_count++;
+	xSemaphoreGiveRecursive(s_mutex);
+	if (err != ESP_OK) {
+		if (_table->file) fclose(_table->file);
+		free(_table->entries);
+		return err;
+	}
+	sqlite3_replica_kick();
+	return ESP_OK;
+}
+
+esp_err_t sqlite3_replica_init(void)
+{
+	s_mutex = xSemaphoreCreateRecursiveMutex();
+	s_sync_mutex = xSemaphoreCreateMutex();
+	if (s_mutex == NULL || s_sync_mutex == NULL) return ESP_ERR_NO_MEM;
+	if (xTaskCreate(sqlite3_replica_task, "REPLICA", CONFIG_ESP_SQLITE3_TASK_STACK, NULL, 1, &s_sync_task) != pdPASS) return ESP_ERR_NO_MEM;
+	return ESP_OK;
+}
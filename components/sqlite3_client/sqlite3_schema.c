@@ -0,0 +1,261 @@
+/* Decode JSON rows straight into C structs
+ *
+ * This sample code is in the public domain.
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "sqlite3_schema.h"
+
+#define MAX_COLUMN_NAME 64
+#define MAX_NUMBER_TEXT 40
+
+static const char *TAG = "SCHEMA";
+
+static const char *sqlite3_schema_skip_space(const char *p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+	return p;
+}
+
+static int sqlite3_schema_hex(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+/*
+ * Decode the string starting after the opening quote into out (may be NULL to skip it).
+ * The text is truncated to out_size-1 bytes. Returns the position after the closing quote, NULL on a syntax error.
+ */
+static const char *sqlite3_schema_string(const char *p, const char *end, char *out, size_t out_size)
+{
+	size_t len = 0;
+	bool full = false;
+	while (p < end && *p != '"') {
+		char c = *p++;
+		char utf8[4];
+		int n = 1;
+		utf8[0] = c;
+		if (c == '\\') {
+			if (p >= end) return NULL;
+			c = *p++;
+			switch (c) {
+				case 'b': utf8[0] = '\b'; break;
+				case 'f': utf8[0] = '\f'; break;
+				case 'n': utf8[0] = '\n'; break;
+				case 'r': utf8[0] = '\r'; break;
+				case 't': utf8[0] = '\t'; break;
+				case 'u': {
+					if (end - p < 4) return NULL;
+					unsigned int code = 0;
+					for (int i=0;i<4;i++) {
+						int h = sqlite3_schema_hex(p[i]);
+						if (h < 0) return NULL;
+						code = (code << 4) | h;
+					}
+					p += 4;
+					// Surrogate pairs are not joined; each half becomes a 3 byte sequence
+					if (code < 0x80) {
+						utf8[0] = code;
+					} else if (code < 0x800) {
+						utf8[0] = 0xc0 | (code >> 6);
+						utf8[1] = 0x80 | (code & 0x3f);
+						n = 2;
+					} else {
+						utf8[0] = 0xe0 | (code >> 12);
+						utf8[1] = 0x80 | ((code >> 6) & 0x3f);
+						utf8[2] = 0x80 | (code & 0x3f);
+						n = 3;
+					}
+					break;
+				}
+				default: utf8[0] = c; break;
+			}
+		}
+		if (out && !full) {
+			// Never cut a multi-byte character in half
+			full = len + n >= out_size;
+			if (!full) {
+				memcpy(out + len, utf8, n);
+				len += n;
+			}
+		}
+	}
+	if (p >= end) return NULL;
+	if (out && out_size > 0) out[len] = 0;
+	return p + 1;
+}
+
+/* Skip a nested object or array; p points at its opening bracket */
+static const char *sqlite3_schema_skip_nested(const char *p, const char *end)
+{
+	int depth = 0;
+	while (p < end) {
+		char c = *p++;
+		if (c == '"') {
+			p = sqlite3_schema_string(p, end, NULL, 0);
+			if (p == NULL) return NULL;
+		} else if (c == '{' || c == '[') {
+			depth++;
+		} else if (c == '}' || c == ']') {
+			if (--depth == 0) return p;
+		}
+	}
+	return NULL;
+}
+
+static const sqlite3_column_t *sqlite3_schema_column(const sqlite3_schema_t *schema, const char *name, int *hint)
+{
+	// Rows usually carry the columns in declaration order, so try the one after the previous match first
+	int count = schema->column_count;
+	for (int i=0;i<count;i++) {
+		int index = (*hint + i) % count;
+		if (strcmp(schema->columns[index].name, name) == 0) {
+			*hint = index + 1;
+			return &schema->columns[index];
+		}
+	}
+	return NULL;
+}
+
+static void sqlite3_schema_store_int(void *field, size_t size, long long value)
+{
+	if (size == sizeof(int8_t)) *(int8_t *)field = value;
+	else if (size == sizeof(int16_t)) *(int16_t *)field = value;
+	else if (size == sizeof(int32_t)) *(int32_t *)field = value;
+	else if (size == sizeof(int64_t)) *(int64_t *)field = value;
+}
+
+/* Store a scalar given as text: a JSON string's content, or the literal of a number, true or false */
+static void sqlite3_schema_store(const sqlite3_column_t *column, void *record, const char *text, bool quoted)
+{
+	void *field = (char *)record + column->offset;
+	switch (column->type) {
+		case SQLITE3_COLUMN_INT: {
+			char *end;
+			long long value = strtoll(text, &end, 10);
+			if (*end == '.' || *end == 'e' || *end == 'E') value = strtod(text, NULL);
+			if (!quoted && strcmp(text, "true") == 0) value = 1;
+			sqlite3_schema_store_int(field, column->size, value);
+			break;
+		}
+		case SQLITE3_COLUMN_DOUBLE: {
+			double value = strtod(text, NULL);
+			if (!quoted && strcmp(text, "true") == 0) value = 1;
+			if (column->size == sizeof(float)) {
+				*(float *)field = value;
+			} else {
+				*(double *)field = value;
+			}
+			break;
+		}
+		case SQLITE3_COLUMN_BOOL:
+			*(bool *)field = strcmp(text, "true") == 0 || (strcmp(text, "false") != 0 && strtod(text, NULL) != 0);
+			break;
+		case SQLITE3_COLUMN_TEXT:
+			// Strings are decoded in place; this is a number or a literal
+			if (!quoted) strlcpy(field, text, column->size);
+			break;
+	}
+}
+
+static void sqlite3_schema_mark(const sqlite3_schema_t *schema, const sqlite3_column_t *column, uint32_t *present)
+{
+	int index = column - schema->columns;
+	if (present && index < SQLITE3_SCHEMA_MAX_COLUMNS) *present |= 1u << index;
+}
+
+esp_err_t sqlite3_schema_decode(const sqlite3_schema_t *schema, const char *row, size_t row_len, void *record, uint32_t *present)
+{
+	const char *p = row;
+	const char *end = row + row_len;
+	int hint = 0;
+	memset(record, 0, schema->record_size);
+	if (present) *present = 0;
+
+	p = sqlite3_schema_skip_space(p, end);
+	if (p >= end || *p++ != '{') goto syntax;
+	p = sqlite3_schema_skip_space(p, end);
+	if (p < end && *p == '}') return ESP_OK;
+	while (p < end) {
+		char name[MAX_COLUMN_NAME];
+		if (*p++ != '"') goto syntax;
+		p = sqlite3_schema_string(p, end, name, sizeof(name));
+		if (p == NULL) goto syntax;
+		p = sqlite3_schema_skip_space(p, end);
+		if (p >= end || *p++ != ':') goto syntax;
+		p = sqlite3_schema_skip_space(p, end);
+		if (p >= end) goto syntax;
+
+		const sqlite3_column_t *column = sqlite3_schema_column(schema, name, &hint);
+		if (*p == '"') {
+			if (column && column->type == SQLITE3_COLUMN_TEXT) {
+				p = sqlite3_schema_string(p + 1, end, (char *)record + column->offset, column->size);
+			} else {
+				char text[MAX_NUMBER_TEXT];
+				p = sqlite3_schema_string(p + 1, end, column ? text : NULL, sizeof(text));
+				if (p && column) sqlite3_schema_store(column, record, text, true);
+			}
+			if (p == NULL) goto syntax;
+			if (column) sqlite3_schema_mark(schema, column, present);
+		} else if (*p == '{' || *p == '[') {
+			// Not a column value ArrestDB produces; leave the member zero
+			p = sqlite3_schema_skip_nested(p, end);
+			if (p == NULL) goto syntax;
+		} else {
+			const char *literal = p;
+			while (p < end && *p != ',' && *p != '}' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+			size_t literal_len = p - literal;
+			bool null = (literal_len == 4 && memcmp(literal, "null", 4) == 0);
+			if (column && !null && literal_len > 0 && literal_len < MAX_NUMBER_TEXT) {
+				char text[MAX_NUMBER_TEXT];
+				memcpy(text, literal, literal_len);
+				text[literal_len] = 0;
+				sqlite3_schema_store(column, record, text, false);
+				sqlite3_schema_mark(schema, column, present);
+			}
+		}
+
+		p = sqlite3_schema_skip_space(p, end);
+		if (p >= end) goto syntax;
+		if (*p == '}') return ESP_OK;
+		if (*p++ != ',') goto syntax;
+		p = sqlite3_schema_skip_space(p, end);
+	}
+
+syntax:
+	ESP_LOGE(TAG, "cannot decode row [%.*s]", (int)row_len, row);
+	return ESP_ERR_INVALID_RESPONSE;
+}
+
+esp_err_t sqlite3_schema_decode_fields(const sqlite3_schema_t *schema, const char * const *names, const char * const *values, int count, void *record, uint32_t *present)
+{
+	int hint = 0;
+	memset(record, 0, schema->record_size);
+	if (present) *present = 0;
+	for (int i=0;i<count;i++) {
+		if (values[i] == NULL) continue;
+		const sqlite3_column_t *column = sqlite3_schema_column(schema, names[i], &hint);
+		if (column == NULL) continue;
+		if (column->type == SQLITE3_COLUMN_TEXT) {
+			char *field = (char *)record + column->offset;
+			size_t len = strlcpy(field, values[i], column->size);
+			// Never cut a multi-byte character in half
+			if (len >= column->size) {
+				len = column->size - 1;
+				while (len > 0 && (values[i][len] & 0xc0) == 0x80) len--;
+				field[len] = 0;
+			}
+		} else {
+			sqlite3_schema_store(column, record, values[i], false);
+		}
+		sqlite3_schema_mark(schema, column, present);
+	}
+	return ESP_OK;
+}
@@ -0,0 +1,262 @@
+/* Per method and per table request statistics
+ *
+ * This sample code is in the public domain.
+ */
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "http_buffer.h"
+#include "sqlite3_stats.h"
+
+#define STATS_METHODS 5     // GET, POST, PUT, DELETE, others
+
+typedef struct {
+	atomic_uint requests;
+	atomic_uint failures;
+	atomic_uint http_errors;
+	atomic_uint retries;
+	atomic_uint hedges;
+	atomic_ullong bytes_sent;
+	atomic_ullong bytes_received;
+	atomic_ullong total_us;
+	atomic_ullong phase_us[SQLITE3_STATS_PHASES];
+	atomic_uint heap_peak;
+	atomic_uint histogram[SQLITE3_STATS_BUCKETS];
+	atomic_uint headers_histogram[SQLITE3_STATS_BUCKETS];
+} sqlite3_stats_entry_t;
+
+enum { TABLE_FREE, TABLE_CLAIMED, TABLE_READY };
+
+typedef struct {
+	atomic_int state;
+	char name[32];
+	sqlite3_stats_entry_t entry;
+} sqlite3_stats_table_t;
+
+static const char *TAG = "STATS";
+static const char *s_method_names[STATS_METHODS] = { "GET", "POST", "PUT", "DELETE", "OTHER" };
+static const char *s_phase_names[SQLITE3_STATS_PHASES] = { "connect", "write", "wait", "read", "decode" };
+
+static sqlite3_stats_entry_t s_methods[STATS_METHODS];
+static sqlite3_stats_table_t s_tables[CONFIG_ESP_STATS_TABLES];
+
+static int sqlite3_stats_method_index(esp_http_client_method_t method)
+{
+	switch (method) {
+		case HTTP_METHOD_GET: return 0;
+		case HTTP_METHOD_POST: return 1;
+		case HTTP_METHOD_PUT: return 2;
+		case HTTP_METHOD_DELETE: return 3;
+		default: return 4;
+	}
+}
+
+/* Find a table's counters, claiming a free slot for a new table; NULL when all slots are taken */
+static sqlite3_stats_entry_t *sqlite3_stats_table(const char *name, bool create)
+{
+	for (int i=0;i<CONFIG_ESP_STATS_TABLES;i++) {
+		sqlite3_stats_table_t *table = &s_tables[i];
+		int state = atomic_load(&table->state);
+		if (state == TABLE_READY && strcmp(table->name, name) == 0) return &table->entry;
+		if (state == TABLE_FREE && create) {
+			if (atomic_compare_exchange_strong(&table->state, &state, TABLE_CLAIMED)) {
+				strlcpy(table->name, name, sizeof(table->name));
+				atomic_store(&table->state, TABLE_READY);
+				return &table->entry;
+			}
+			// Another task claimed it in the meantime, possibly for this very table
+			if (atomic_load(&table->state) == TABLE_READY && strcmp(table->name, name) == 0) return &table->entry;
+		}
+	}
+	return NULL;
+}
+
+static uint32_t sqlite3_stats_free_heap(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+	return 0;
+#else
+	return esp_get_free_heap_size();
+#endif
+}
+
+static int sqlite3_stats_bucket(int64_t us)
+{
+	int64_t ms = us / 1000;
+	int bucket = 0;
+	while (ms > 0 && bucket < SQLITE3_STATS_BUCKETS - 1) {
+		ms >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+static void sqlite3_stats_max(atomic_uint *peak, uint32_t value)
+{
+	unsigned int current = atomic_load(peak);
+	while (value > current && !atomic_compare_exchange_weak(peak, &current, value));
+}
+
+static void sqlite3_stats_add(sqlite3_stats_entry_t *entry, const sqlite3_stats_sample_t *sample, esp_err_t err, int64_t total_us)
+{
+	atomic_fetch_add(&entry->requests, 1);
+	if (sample->status == 0 && err != ESP_OK) atomic_fetch_add(&entry->failures, 1);
+	if (sample->status >= 400) atomic_fetch_add(&entry->http_errors, 1);
+	atomic_fetch_add(&entry->retries, sample->retries);
+	atomic_fetch_add(&entry->hedges, sample->hedges);
+	atomic_fetch_add(&entry->bytes_sent, sample->bytes_sent);
+	atomic_fetch_add(&entry->bytes_received, sample->bytes_received);
+	atomic_fetch_add(&entry->total_us, total_us);
+	for (int i=0;i<SQLITE3_STATS_PHASES;i++) {
+		atomic_fetch_add(&entry->phase_us[i], sample->phase_us[i]);
+	}
+	if (sample->heap_free > sample->heap_min) sqlite3_stats_max(&entry->heap_peak, sample->heap_free - sample->heap_min);
+	atomic_fetch_add(&entry->histogram[sqlite3_stats_bucket(total_us)], 1);
+	if (sample->headers_us > 0) atomic_fetch_add(&entry->headers_histogram[sqlite3_stats_bucket(sample->headers_us)], 1);
+}
+
+void sqlite3_stats_begin(sqlite3_stats_sample_t *sample, esp_http_client_method_t method, const char *path)
+{
+	memset(sample, 0, sizeof(sqlite3_stats_sample_t));
+	sample->active = true;
+	sample->method = method;
+	if (*path == '/') path++;
+	size_t table_len = strcspn(path, "/?");
+	if (table_len >= sizeof(sample->table)) table_len = sizeof(sample->table) - 1;
+	memcpy(sample->table, path, table_len);
+	sample->table[table_len] = 0;
+	sample->heap_free = sample->heap_min = sqlite3_stats_free_heap();
+	sample->started = esp_timer_get_time();
+}
+
+void sqlite3_stats_heap(sqlite3_stats_sample_t *sample)
+{
+	uint32_t heap_free = sqlite3_stats_free_heap();
+	if (heap_free < sample->heap_min) sample->heap_min = heap_free;
+}
+
+void sqlite3_stats_end(sqlite3_stats_sample_t *sample, esp_err_t err)
+{
+	if (!sample->active) return;
+	sample->active = false;
+	sqlite3_stats_heap(sample);
+	int64_t total_us = esp_timer_get_time() - sample->started;
+	sqlite3_stats_add(&s_methods[sqlite3_stats_method_index(sample->method)], sample, err, total_us);
+	sqlite3_stats_entry_t *table = sqlite3_stats_table(sample->table, true);
+	if (table) sqlite3_stats_add(table, sample, err, total_us);
+}
+
+static void sqlite3_stats_copy(sqlite3_stats_entry_t *entry, sqlite3_stats_t *stats)
+{
+	stats->requests = atomic_load(&entry->requests);
+	stats->failures = atomic_load(&entry->failures);
+	stats->http_errors = atomic_load(&entry->http_errors);
+	stats->retries = atomic_load(&entry->retries);
+	stats->hedges = atomic_load(&entry->hedges);
+	stats->bytes_sent = atomic_load(&entry->bytes_sent);
+	stats->bytes_received = atomic_load(&entry->bytes_received);
+	stats->total_us = atomic_load(&entry->total_us);
+	for (int i=0;i<SQLITE3_STATS_PHASES;i++) {
+		stats->phase_us[i] = atomic_load(&entry->phase_us[i]);
+	}
+	stats->heap_peak = atomic_load(&entry->heap_peak);
+	for (int i=0;i<SQLITE3_STATS_BUCKETS;i++) {
+		stats->histogram[i] = atomic_load(&entry->histogram[i]);
+		stats->headers_histogram[i] = atomic_load(&entry->headers_histogram[i]);
+	}
+}
+
+esp_err_t sqlite3_stats_get_method(esp_http_client_method_t method, sqlite3_stats_t *stats)
+{
+	sqlite3_stats_copy(&s_methods[sqlite3_stats_method_index(method)], stats);
+	return ESP_OK;
+}
+
+esp_err_t sqlite3_stats_get_table(const char *table, sqlite3_stats_t *stats)
+{
+	sqlite3_stats_entry_t *entry = sqlite3_stats_table(table, false);
+	if (entry == NULL) return ESP_ERR_NOT_FOUND;
+	sqlite3_stats_copy(entry, stats);
+	return ESP_OK;
+}
+
+static uint32_t sqlite3_stats_histogram_percentile(const uint32_t *histogram, int pct)
+{
+	uint32_t total = 0;
+	for (int i=0;i<SQLITE3_STATS_BUCKETS;i++) total += histogram[i];
+	uint32_t rank = ((uint64_t)total * pct + 99) / 100;
+	uint32_t count = 0;
+	for (int i=0;i<SQLITE3_STATS_BUCKETS;i++) {
+		count += histogram[i];
+		if (count >= rank && count > 0) return 1u << i;
+	}
+	return 1u << (SQLITE3_STATS_BUCKETS - 1);
+}
+
+uint32_t sqlite3_stats_percentile(const sqlite3_stats_t *stats, int pct)
+{
+	return sqlite3_stats_histogram_percentile(stats->histogram, pct);
+}
+
+uint32_t sqlite3_stats_headers_percentile(const sqlite3_stats_t *stats, int pct)
+{
+	return sqlite3_stats_histogram_percentile(stats->headers_histogram, pct);
+}
+
+static void sqlite3_stats_log(const char *name, const sqlite3_stats_t *stats)
+{
+	if (stats->requests == 0) return;
+	uint32_t n = stats->requests;
+	char phases[96];
+	int len = 0;
+	for (int i=0;i<SQLITE3_STATS_PHASES;i++) {
+		len += snprintf(phases + len, sizeof(phases) - len, " %s=%u", s_phase_names[i], (unsigned int)(stats->phase_us[i] / n));
+	}
+	ESP_LOGI(TAG, "%s n=%u fail=%u err=%u retry=%u hedge=%u p50<%ums p99<%ums avg=%uus%s tx=%llu rx=%llu heap=%u",
+		name, (unsigned int)n, (unsigned int)stats->failures, (unsigned int)stats->http_errors, (unsigned int)stats->retries, (unsigned int)stats->hedges,
+		(unsigned int)sqlite3_stats_percentile(stats, 50), (unsigned int)sqlite3_stats_percentile(stats, 99),
+		(unsigned int)(stats->total_us / n), phases,
+		(unsigned long long)stats->bytes_sent, (unsigned long long)stats->bytes_received, (unsigned int)stats->heap_peak);
+}
+
+void sqlite3_stats_dump(void)
+{
+	sqlite3_stats_t stats;
+	for (int i=0;i<STATS_METHODS;i++) {
+		sqlite3_stats_copy(&s_methods[i], &stats);
+		sqlite3_stats_log(s_method_names[i], &stats);
+	}
+	for (int i=0;i<CONFIG_ESP_STATS_TABLES;i++) {
+		if (atomic_load(&s_tables[i].state) != TABLE_READY) continue;
+		sqlite3_stats_copy(&s_tables[i].entry, &stats);
+		sqlite3_stats_log(s_tables[i].name, &stats);
+	}
+	http_buffer_stats_t buffers;
+	http_buffer_get_stats(&buffers);
+	ESP_LOGI(TAG, "buffers budget=%u allocated=%u (peak %u) in_use=%u (peak %u) gets=%u reused=%u waits=%u over_budget=%u",
+		(unsigned int)buffers.budget, (unsigned int)buffers.allocated, (unsigned int)buffers.peak_allocated,
+		(unsigned int)buffers.in_use, (unsigned int)buffers.peak_in_use,
+		buffers.gets, buffers.reused, buffers.waits, buffers.over_budget);
+}
+
+static void sqlite3_stats_task(void *pvParameters)
+{
+	TickType_t interval = pdMS_TO_TICKS((intptr_t)pvParameters);
+	while (1) {
+		vTaskDelay(interval);
+		sqlite3_stats_dump();
+	}
+}
+
+esp_err_t sqlite3_stats_start_dump(int interval_ms)
+{
+	if (xTaskCreate(sqlite3_stats_task, "STATS", 1024*3, (void *)(intptr_t)interval_ms, 1, NULL) != pdPASS) return ESP_ERR_NO_MEM;
+	return ESP_OK;
+}
@@ -0,0 +1,450 @@
+/* Crash-safe write-ahead queue on a flash file system
+ *
+ * This sample code is in the public domain.
+ */
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#if CONFIG_ESP_BREAKER_ENABLE
+#include "http_breaker.h"
+#endif
+#include "sqlite3_client.h"
+#include "sqlite3_wal.h"
+
+/*
+ * Segment files are named <seq>.wal (8.3 names for FAT) and hold a sequence of records:
+ *   header | path | data
+ * Records are only appended, a segment is never rewritten. Once a segment is full the next
+ * one is started, and a segment is deleted as soon as all its records were replayed,
+ * so writes move across the partition (the FAT wear levelling layer spreads them further).
+ * A record whose CRC does not match is a write torn by a reset and ends the segment.
+ */
+#define WAL_MAGIC 0x4c57    // "WL"
+#define WAL_MAX_PATH 256
+#define WAL_BATCH_RECORDS 32    // journaled inserts merged into one replay request
+
+typedef struct __attribute__((packed)) {
+	uint16_t magic;
+	uint8_t method;
+	uint8_t reserved;
+	uint16_t path_len;
+	uint16_t data_len;
+	uint32_t crc;           // over method, path and data
+} sqlite3_wal_record_t;
+
+/* Replay position, persisted so that a reset does not replay acknowledged records again */
+typedef struct {
+	uint32_t seq;
+	uint32_t offset;
+} sqlite3_wal_cursor_t;
+
+static const char *TAG = "WAL";
+
+static SemaphoreHandle_t s_mutex;
+static TaskHandle_t s_replay_task;
+static FILE *s_head;            // segment receiving new records
+static uint32_t s_head_seq;
+static uint32_t s_head_len;
+static sqlite3_wal_cursor_t s_cursor;
+static atomic_bool s_offline;   // the last replay found the server unreachable
+
+static uint32_t sqlite3_wal_crc32(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	crc = ~crc;
+	while (len--) {
+		crc ^= *p++;
+		for (int i=0;i<8;i++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+static void sqlite3_wal_segment_name(char *name, size_t name_size, uint32_t seq)
+{
+	snprintf(name, name_size, "%s/%08"PRIu32".wal", CONFIG_ESP_WAL_BASE_PATH, seq);
+}
+
+static void sqlite3_wal_save_cursor(void)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "%s/cursor.dat", CONFIG_ESP_WAL_BASE_PATH);
+	FILE *f = fopen(name, "wb");
+	if (f == NULL) {
+		ESP_LOGE(TAG, "Failed to open %s", name);
+		return;
+	}
+	fwrite(&s_cursor, sizeof(s_cursor), 1, f);
+	fflush(f);
+	fsync(fileno(f));
+	fclose(f);
+}
+
+/* Close the head segment so that the replay task only reads segments nobody writes to */
+static void sqlite3_wal_seal(void)
+{
+	if (s_head == NULL) return;
+	fclose(s_head);
+	s_head = NULL;
+	s_head_seq++;
+	s_head_len = 0;
+}
+
+bool sqlite3_wal_pending(void)
+{
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	bool pending = (s_head != NULL) || (s_cursor.seq < s_head_seq);
+	xSemaphoreGive(s_mutex);
+	return pending;
+}
+
+esp_err_t sqlite3_wal_append(esp_http_client_method_t method, const char *path, const char *data, int data_len)
+{
+	size_t path_len = strlen(path);
+	// The record header holds 16-bit lengths: a longer body would be journaled torn and lost on replay
+	if (path_len > WAL_MAX_PATH || data_len > UINT16_MAX || data_len > CONFIG_ESP_WAL_SEGMENT_SIZE) return ESP_ERR_INVALID_SIZE;
+	sqlite3_wal_record_t record = {
+		.magic = WAL_MAGIC,
+		.method = method,
+		.path_len = path_len,
+		.data_len = data_len,
+	};
+	record.crc = sqlite3_wal_crc32(0, &record.method, 1);
+	record.crc = sqlite3_wal_crc32(record.crc, path, path_len);
+	record.crc = sqlite3_wal_crc32(record.crc, data, data_len);
+	size_t record_len = sizeof(record) + path_len + data_len;
+
+	esp_err_t ret = ESP_OK;
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	if (s_head != NULL && s_head_len + record_len > CONFIG_ESP_WAL_SEGMENT_SIZE) {
+		sqlite3_wal_seal();
+	}
+	if (s_head == NULL) {
+		if (s_head_seq - s_cursor.seq >= CONFIG_ESP_WAL_MAX_SEGMENTS) {
+			ESP_LOGE(TAG, "write-ahead queue is full");
+			ret = ESP_ERR_NO_MEM;
+			goto exit;
+		}
+		char name[64];
+		sqlite3_wal_segment_name(name, sizeof(name), s_head_seq);
+		s_head = fopen(name, "ab");
+		if (s_head == NULL) {
+			ESP_LOGE(TAG, "Failed to open %s", name);
+			ret = ESP_FAIL;
+			goto exit;
+		}
+	}
+	if (fwrite(&record, sizeof(record), 1, s_head) != 1
+		|| fwrite(path, 1, path_len, s_head) != path_len
+		|| fwrite(data, 1, data_len, s_head) != (size_t)data_len) {
+		ESP_LOGE(TAG, "Failed to write record");
+		ret = ESP_FAIL;
+		goto exit;
+	}
+	fflush(s_head);
+	fsync(fileno(s_head));
+	s_head_len += record_len;
+	ESP_LOGI(TAG, "journaled %s (%d bytes) in segment %"PRIu32, path, data_len, s_head_seq);
+
+exit:
+	xSemaphoreGive(s_mutex);
+	return ret;
+}
+
+bool sqlite3_wal_offline(void)
+{
+	return atomic_load(&s_offline);
+}
+
+/*
+ * Consecutive POSTs to the same table are merged into one JSON array,
+ * which ArrestDB inserts in a single transaction.
+ */
+typedef struct {
+	char path[WAL_MAX_PATH+1];
+	char *data;
+	size_t len;
+	int records;
+	uint16_t ends[WAL_BATCH_RECORDS];       // where each record ends in data
+	uint32_t offsets[WAL_BATCH_RECORDS];    // segment offset just after each record
+} sqlite3_wal_batch_t;
+
+static bool sqlite3_wal_merge(sqlite3_wal_batch_t *batch, const char *path, const char *data, size_t data_len, uint32_t offset)
+{
+	// Strip the brackets of a bulk insert body, a single row is taken as it is
+	if (data_len >= 2 && data[0] == '[') {
+		data++;
+		data_len -= 2;
+	}
+	if (batch->records > 0 && strcmp(batch->path, path) != 0) return false;
+	if (batch->records == WAL_BATCH_RECORDS) return false;
+	if (batch->len + data_len + 2 > CONFIG_ESP_WAL_REPLAY_BATCH_SIZE) return false;
+	if (batch->records == 0) {
+		strlcpy(batch->path, path, sizeof(batch->path));
+		batch->data[batch->len++] = '[';
+	} else {
+		batch->data[batch->len++] = ',';
+	}
+	memcpy(batch->data + batch->len, data, data_len);
+	batch->len += data_len;
+	batch->ends[batch->records] = batch->len;
+	batch->offsets[batch->records] = offset;
+	batch->records++;
+	return true;
+}
+
+/*
+ * Send the merged records one at a time, so that a bad one is only dropped by itself.
+ * The separators around each record are overwritten with the brackets of a bulk insert.
+ */
+static bool sqlite3_wal_flush_each(sqlite3_wal_batch_t *batch)
+{
+	size_t start = 1;
+	for (int i=0;i<batch->records;i++) {
+		size_t end = batch->ends[i];
+		batch->data[start-1] = '[';
+		batch->data[end] = ']';
+		esp_err_t err = sqlite3_client_request(HTTP_METHOD_POST, batch->path, batch->data + start - 1, end - start + 2);
+		if (sqlite3_client_unreachable(err)) return false;
+		if (err != ESP_OK) ESP_LOGE(TAG, "server rejected a journaled insert into %s: %s", batch->path, esp_err_to_name(err));
+		sqlite3_client_replayed(HTTP_METHOD_POST, batch->path, NULL, 0, err);
+		s_cursor.offset = batch->offsets[i];
+		sqlite3_wal_save_cursor();
+		start = end + 1;
+	}
+	return true;
+}
+
+/* Returns false when the server is still unreachable */
+static bool sqlite3_wal_flush(sqlite3_wal_batch_t *batch)
+{
+	if (batch->records == 0) return true;
+	batch->data[batch->len++] = ']';
+	esp_err_t err = sqlite3_client_request(HTTP_METHOD_POST, batch->path, batch->data, batch->len);
+	bool online = !sqlite3_client_unreachable(err);
+	if (online && err != ESP_OK && batch->records > 1) {
+		// ArrestDB rolled the whole array back, the good records with the bad one
+		ESP_LOGW(TAG, "server rejected %d merged inserts: %s, sending them one by one", batch->records, esp_err_to_name(err));
+		online = sqlite3_wal_flush_each(batch);
+	} else if (online) {
+		if (err != ESP_OK) ESP_LOGE(TAG, "server rejected a journaled insert into %s: %s", batch->path, esp_err_to_name(err));
+		sqlite3_client_replayed(HTTP_METHOD_POST, batch->path, NULL, 0, err);
+		s_cursor.offset = batch->offsets[batch->records-1];
+		sqlite3_wal_save_cursor();
+	}
+	batch->len = 0;
+	batch->records = 0;
+	return online;
+}
+
+/* Replay one sealed segment from the cursor. Returns false when the server is unreachable. */
+static bool sqlite3_wal_replay_segment(uint32_t seq, char *record_buffer, sqlite3_wal_batch_t *batch)
+{
+	char name[64];
+	sqlite3_wal_segment_name(name, sizeof(name), seq);
+	FILE *f = fopen(name, "rb");
+	if (f == NULL) return true;
+	if (s_cursor.offset) fseek(f, s_cursor.offset, SEEK_SET);
+	uint32_t offset = s_cursor.offset;
+	int replayed = 0;
+	bool online = true;
+
+	while (online) {
+		sqlite3_wal_record_t record;
+		if (fread(&record, sizeof(record), 1, f) != 1) break;
+		if (record.magic != WAL_MAGIC || record.path_len > WAL_MAX_PATH || record.data_len > CONFIG_ESP_WAL_SEGMENT_SIZE) {
+			ESP_LOGW(TAG, "segment %"PRIu32" ends with a damaged record at %"PRIu32, seq, offset);
+			break;
+		}
+		char *path = record_buffer;
+		char *data = record_buffer + WAL_MAX_PATH + 1;
+		if (fread(path, 1, record.path_len, f) != record.path_len
+			|| fread(data, 1, record.data_len, f) != record.data_len) {
+			ESP_LOGW(TAG, "segment %"PRIu32" ends with a torn record at %"PRIu32, seq, offset);
+			break;
+		}
+		uint32_t crc = sqlite3_wal_crc32(0, &record.method, 1);
+		crc = sqlite3_wal_crc32(crc, path, record.path_len);
+		crc = sqlite3_wal_crc32(crc, data, record.data_len);
+		if (crc != record.crc) {
+			ESP_LOGW(TAG, "segment %"PRIu32" ends with a torn record at %"PRIu32, seq, offset);
+			break;
+		}
+		path[record.path_len] = 0;
+		offset += sizeof(record) + record.path_len + record.data_len;
+		replayed++;
+
+		if (record.method == HTTP_METHOD_POST && record.data_len > 0) {
+			bool merged = sqlite3_wal_merge(batch, path, data, record.data_len, offset);
+			if (!merged) {
+				if (!sqlite3_wal_flush(batch)) {
+					online = false;
+					break;
+				}
+				merged = sqlite3_wal_merge(batch, path, data, record.data_len, offset);
+			}
+			if (merged) continue;
+			// Larger than a replay batch, sent on its own below
+		}
+		// Anything else keeps its place in the order, so the pending inserts go first
+		if (!sqlite3_wal_flush(batch)) {
+			online = false;
+			break;
+		}
+		esp_err_t err = sqlite3_client_request(record.method, path, data, record.data_len);
+		if (sqlite3_client_unreachable(err)) {
+			online = false;
+			break;
+		}
+		if (err != ESP_OK) ESP_LOGE(TAG, "server rejected journaled %s: %s", path, esp_err_to_name(err));
+		sqlite3_client_replayed(record.method, path, data, record.data_len, err);
+		s_cursor.offset = offset;
+		sqlite3_wal_save_cursor();
+	}
+	if (online) online = sqlite3_wal_flush(batch);
+	fclose(f);
+
+	if (!online) {
+		ESP_LOGW(TAG, "server unreachable, replay stops at segment %"PRIu32" offset %"PRIu32, seq, s_cursor.offset);
+		return false;
+	}
+	ESP_LOGI(TAG, "segment %"PRIu32" replayed (%d records)", seq, replayed);
+	remove(name);
+	return true;
+}
+
+/* Replay the segments sealed so far; false when the server is unreachable */
+static bool sqlite3_wal_replay_sealed(char *record_buffer, sqlite3_wal_batch_t *batch, bool *answered)
+{
+	xSemaphoreTake(s_mutex, portMAX_DELAY);
+	uint32_t last = s_head_seq;
+	xSemaphoreGive(s_mutex);
+
+	while (s_cursor.seq < last) {
+		if (!sqlite3_wal_replay_segment(s_cursor.seq, record_buffer, batch)) return false;
+		*answered = true;
+		xSemaphoreTake(s_mutex, portMAX_DELAY);
+		s_cursor.seq++;
+		s_cursor.offset = 0;
+		xSemaphoreGive(s_mutex);
+		sqlite3_wal_save_cursor();
+	}
+	return true;
+}
+
+/* Whether the server answers; while the breaker is open it is known not to */
+static bool sqlite3_wal_reachable(void)
+{
+#if CONFIG_ESP_BREAKER_ENABLE
+	if (!http_breaker_allow()) return false;
+#endif
+	return http_pool_ping() == ESP_OK;
+}
+
+static void sqlite3_wal_replay(void)
+{
+	char *record_buffer = malloc(WAL_MAX_PATH + 1 + CONFIG_ESP_WAL_SEGMENT_SIZE);
+	sqlite3_wal_batch_t batch = {
+		.data = malloc(CONFIG_ESP_WAL_REPLAY_BATCH_SIZE),
+	};
+	if (record_buffer == NULL || batch.data == NULL) {
+		ESP_LOGE(TAG, "no memory for replay");
+		goto exit;
+	}
+
+	bool answered = false;
+	bool online = sqlite3_wal_replay_sealed(record_buffer, &batch, &answered);
+	if (online) {
+		/*
+		 * Then the head: new writes go to a fresh segment while it is replayed.
+		 * It is only sealed once the server answered, otherwise every retry while offline
+		 * would start a segment of its own and fill the queue long before its size.
+		 */
+		if (!answered) online = sqlite3_wal_reachable();
+		if (online) {
+			xSemaphoreTake(s_mutex, portMAX_DELAY);
+			sqlite3_wal_seal();
+			xSemaphoreGive(s_mutex);
+			online = sqlite3_wal_replay_sealed(record_buffer, &batch, &answered);
+		}
+	}
+	atomic_store(&s_offline, !online);
+
+exit:
+	free(record_buffer);
+	free(batch.data);
+}
+
+static void sqlite3_wal_task(void *pvParameters)
+{
+	// A backlog is replayed without holding up interactive requests
+	sqlite3_client_set_priority(HTTP_POOL_PRIORITY_BACKGROUND);
+	while (1) {
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_ESP_WAL_RETRY_MS));
+		if (sqlite3_wal_pending()) sqlite3_wal_replay();
+	}
+}
+
+void sqlite3_wal_kick(void)
+{
+	if (s_replay_task) xTaskNotifyGive(s_replay_task);
+}
+
+esp_err_t sqlite3_wal_init(void)
+{
+	s_mutex = xSemaphoreCreateMutex();
+	if (s_mutex == NULL) return ESP_ERR_NO_MEM;
+
+	// Find the oldest and newest segments left by the previous run
+	DIR *dir = opendir(CONFIG_ESP_WAL_BASE_PATH);
+	if (dir == NULL) {
+		ESP_LOGE(TAG, "Failed to open %s", CONFIG_ESP_WAL_BASE_PATH);
+		return ESP_FAIL;
+	}
+	uint32_t first = UINT32_MAX;
+	uint32_t last = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		char *ext;
+		uint32_t seq = strtoul(entry->d_name, &ext, 10);
+		if (ext == entry->d_name || strcasecmp(ext, ".wal") != 0) continue;
+		if (seq < first) first = seq;
+		if (seq > last) last = seq;
+	}
+	closedir(dir);
+
+	char name[64];
+	snprintf(name, sizeof(name), "%s/cursor.dat", CONFIG_ESP_WAL_BASE_PATH);
+	FILE *f = fopen(name, "rb");
+	if (f == NULL || fread(&s_cursor, sizeof(s_cursor), 1, f) != 1) {
+		s_cursor.seq = 0;
+		s_cursor.offset = 0;
+	}
+	if (f) fclose(f);
+
+	if (first == UINT32_MAX) {
+		// Nothing pending
+		s_head_seq = s_cursor.seq;
+	} else {
+		if (s_cursor.seq < first) {
+			s_cursor.seq = first;
+			s_cursor.offset = 0;
+		}
+		s_head_seq = last + 1;
+	}
+	ESP_LOGI(TAG, "segments %"PRIu32"..%"PRIu32" pending, replay from offset %"PRIu32,
+		s_cursor.seq, s_head_seq, s_cursor.offset);
+
+	if (xTaskCreate(sqlite3_wal_task, "WAL", CONFIG_ESP_SQLITE3_TASK_STACK, NULL, 1, &s_replay_task) != pdPASS) return ESP_ERR_NO_MEM;
+	return ESP_OK;
+}
@@ -3,3 +3,7 @@
 #
 # (Uses default behaviour of compiling all source files in directory, adding 'include' to include path.)
 
+ifdef CONFIG_ESP_HTTPS_SERVER_CERT
+COMPONENT_EMBED_TXTFILES := server_cert.pem
+endif
+
@@ -2,6 +2,7 @@
  *
  * This sample code is in the public domain.
  */
+#include <stdlib.h>
 #include <string.h>
 
 #include "freertos/FreeRTOS.h"
@@ -17,9 +18,31 @@
 #include "lwip/err.h"
 #include "lwip/sys.h"
 
-#include "esp_http_client.h" 
-#include "esp_tls.h" 
-#include "cJSON.h"
+#include "http_pool.h"
+#if CONFIG_ESP_RESOLVER_ENABLE
+#include "http_resolver.h"
+#endif
+#include "json_arena.h"
+#include "sqlite3_aggregate.h"
+#include "sqlite3_client.h"
+#include "sqlite3_cursor.h"
+#include "sqlite3_async.h"
+#include "sqlite3_stats.h"
+#if CONFIG_ESP_CACHE_ENABLE
+#include "sqlite3_cache.h"
+#endif
+#if CONFIG_ESP_COALESCE_ENABLE
+#include "sqlite3_flight.h"
+#endif
+#if CONFIG_ESP_WAL_ENABLE || CONFIG_ESP_REPLICA_ENABLE
+#include "esp_vfs_fat.h"
+#endif
+#if CONFIG_ESP_WAL_ENABLE
+#include "sqlite3_wal.h"
+#endif
+#if CONFIG_ESP_REPLICA_ENABLE
+#include "sqlite3_replica.h"
+#endif
 
 /* FreeRTOS event group to signal when we are connected*/
 static EventGroupHandle_t s_wifi_event_group;
@@ -32,7 +55,26 @@ static EventGroupHandle_t s_wifi_event_group;
 
 static const char *TAG = "SQLITE";
 
+/* customers table, decoded without cJSON */
+typedef struct {
+	int id;
+	char name[32];
+	int gender;
+} customer_t;
+
+static const sqlite3_column_t customer_columns[] = {
+	SQLITE3_COLUMN(customer_t, id, SQLITE3_COLUMN_INT),
+	SQLITE3_COLUMN(customer_t, name, SQLITE3_COLUMN_TEXT),
+	SQLITE3_COLUMN(customer_t, gender, SQLITE3_COLUMN_INT),
+};
+static const sqlite3_schema_t customer_schema = SQLITE3_SCHEMA(customer_t, customer_columns);
+
 static int s_retry_num = 0;
+static bool s_connected = false;
+
+#if CONFIG_ESP_HTTPS_SERVER_CERT
+extern const char server_cert_pem_start[] asm("_binary_server_cert_pem_start");
+#endif
 
 EventGroupHandle_t xEventGroup;
 /* - Is the Enter key entered? */
@@ -43,7 +85,11 @@ static void event_handler(void* arg, esp_event_base_t event_base, int32_t event_
 	if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
 		esp_wifi_connect();
 	} else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-		if (s_retry_num < CONFIG_ESP_MAXIMUM_RETRY) {
+		if (s_connected) {
+			// Once we were online, keep trying; writes are journaled meanwhile
+			esp_wifi_connect();
+			ESP_LOGI(TAG, "link lost, reconnecting to the AP");
+		} else if (s_retry_num < CONFIG_ESP_MAXIMUM_RETRY) {
 			esp_wifi_connect();
 			s_retry_num++;
 			ESP_LOGI(TAG, "retry to connect to the AP");
@@ -55,6 +101,19 @@ static void event_handler(void* arg, esp_event_base_t event_base, int32_t event_
 		ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
 		ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
 		s_retry_num = 0;
+#if CONFIG_ESP_RESOLVER_ENABLE
+		// The server may have another address on this network
+		if (s_connected) http_resolver_invalidate();
+#endif
+#if CONFIG_ESP_WAL_ENABLE
+		// Replay the writes journaled while we were offline
+		if (s_connected) sqlite3_wal_kick();
+#endif
+#if CONFIG_ESP_REPLICA_ENABLE
+		// Catch up with the rows added while we were offline
+		if (s_connected) sqlite3_replica_kick();
+#endif
+		s_connected = true;
 		xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
 	}
 }
@@ -126,376 +185,14 @@ esp_err_t wifi_init_sta(void)
 		ret_value = ESP_FAIL;
 	}
 
-	/* The event will not be processed after unregister */
-	ESP_ERROR_CHECK(esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, instance_got_ip));
-	ESP_ERROR_CHECK(esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, instance_any_id));
-	vEventGroupDelete(s_wifi_event_group);
+	/* The handlers stay registered, so that the station reconnects when the link is lost later on */
 	return ret_value;
 }
 
-void JSON_Record(const cJSON * const array) {
-	int id = cJSON_GetObjectItem(array,"id")->valueint;
-	char *name = cJSON_GetObjectItem(array,"name")->valuestring;
-	int gender = cJSON_GetObjectItem(array,"gender")->valueint;
-	ESP_LOGI(TAG, "%d\t%s\t%d", id, name, gender);
-}
-
-char *JSON_Types(int type) {
-	if (type == cJSON_Invalid) return ("cJSON_Invalid");
-	if (type == cJSON_False) return ("cJSON_False");
-	if (type == cJSON_True) return ("cJSON_True");
-	if (type == cJSON_NULL) return ("cJSON_NULL");
-	if (type == cJSON_Number) return ("cJSON_Number");
-	if (type == cJSON_String) return ("cJSON_String");
-	if (type == cJSON_Array) return ("cJSON_Array");
-	if (type == cJSON_Object) return ("cJSON_Object");
-	if (type == cJSON_Raw) return ("cJSON_Raw");
-	return NULL;
-}
-
-void JSON_Print(const cJSON * const root) {
-	ESP_LOGI(TAG, "-----------------------------------------");
-	ESP_LOGD(TAG, "root->type=%s", JSON_Types(root->type));
-	if (cJSON_IsArray(root)) {
-		ESP_LOGD(TAG, "root->type is Array");
-		int root_array_size = cJSON_GetArraySize(root); 
-		for (int i=0;i<root_array_size;i++) {
-			cJSON *record = cJSON_GetArrayItem(root,i);
-			JSON_Record(record);
-		}
-	} else {
-		ESP_LOGD(TAG, "root->type is Object");
-		JSON_Record(root);
-	}
-	ESP_LOGI(TAG, "-----------------------------------------");
-}
-
-void JSON_Analyze(const cJSON * const root) {
-	//ESP_LOGI(TAG, "root->type=%s", JSON_Types(root->type));
-	cJSON *current_element = NULL;
-	//ESP_LOGI(TAG, "root->child=%p", root->child);
-	//ESP_LOGI(TAG, "root->next =%p", root->next);
-	cJSON_ArrayForEach(current_element, root) {
-		//ESP_LOGI(TAG, "type=%s", JSON_Types(current_element->type));
-		//ESP_LOGI(TAG, "current_element->string=%p", current_element->string);
-		if (current_element->string) {
-			const char* string = current_element->string;
-			ESP_LOGI(TAG, "[%s]", string);
-		}
-		if (cJSON_IsInvalid(current_element)) {
-			ESP_LOGI(TAG, "Invalid");
-		} else if (cJSON_IsFalse(current_element)) {
-			ESP_LOGI(TAG, "False");
-		} else if (cJSON_IsTrue(current_element)) {
-			ESP_LOGI(TAG, "True");
-		} else if (cJSON_IsNull(current_element)) {
-			ESP_LOGI(TAG, "Null");
-		} else if (cJSON_IsNumber(current_element)) {
-			int valueint = current_element->valueint;
-			double valuedouble = current_element->valuedouble;
-			ESP_LOGI(TAG, "int=%d double=%f", valueint, valuedouble);
-		} else if (cJSON_IsString(current_element)) {
-			const char* valuestring = current_element->valuestring;
-			ESP_LOGI(TAG, "%s", valuestring);
-		} else if (cJSON_IsArray(current_element)) {
-			ESP_LOGD(TAG, "Array");
-			JSON_Analyze(current_element);
-		} else if (cJSON_IsObject(current_element)) {
-			ESP_LOGD(TAG, "Object");
-			JSON_Analyze(current_element);
-		} else if (cJSON_IsRaw(current_element)) {
-			ESP_LOGI(TAG, "Raw(Not support)");
-		}
-	}
-}
-
-#define MAX_HTTP_OUTPUT_BUFFER 2048
-
-/*
- * http_native_request() demonstrates use of low level APIs to connect to a server,
- * make a http request and read response. Event handler is not used in this case.
- * Note: This approach should only be used in case use of low level APIs is required.
- * By default, PHP's built-in web server does not automatically send a Content-Length header for dynamic content.
- */
-esp_err_t sqlite3_client_get(char * path)
-{
-	ESP_LOGI(TAG, "sqlite3_client_get path=%s",path);
-	char output_buffer[MAX_HTTP_OUTPUT_BUFFER] = {0};
-	char url[64];
-	sprintf(url, "http://%s:%d/", CONFIG_ESP_WEB_SERVER, CONFIG_ESP_WEB_SERVER_PORT);
-	if (strlen(path) > 0) {
-		int url_length = strlen(url);
-		if (url[url_length-1] != '/') strcat(url,"/");
-		strcat(url, path);
-	}
-	ESP_LOGI(TAG, "url=[%s]",url);
-	
-	esp_http_client_config_t config = {
-		.url = url,
-	};
-	esp_http_client_handle_t client = esp_http_client_init(&config);
-
-	// GET Request
-	esp_err_t ret = ESP_FAIL;
-	esp_http_client_set_method(client, HTTP_METHOD_GET);
-	esp_err_t err = esp_http_client_open(client, 0);
-	if (err != ESP_OK) {
-		ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
-	} else {
-		int64_t content_length = esp_http_client_fetch_headers(client);
-		ESP_LOGI(TAG, "HTTP GET content_length = %"PRId64, content_length);
-		if (content_length < 0) {
-			ESP_LOGE(TAG, "HTTP client fetch headers failed");
-		} else {
-			int data_read = esp_http_client_read_response(client, output_buffer, MAX_HTTP_OUTPUT_BUFFER);
-			if (data_read >= 0) {
-				ESP_LOGI(TAG, "HTTP GET Status = %d, data_read = %d",
-					esp_http_client_get_status_code(client), data_read);
-				ESP_LOG_BUFFER_HEXDUMP(TAG, output_buffer, data_read, ESP_LOG_DEBUG);
-				output_buffer[data_read] = 0;
-				ESP_LOGD(TAG, "\n%s", output_buffer);
-				cJSON *root = cJSON_Parse(output_buffer);
-				JSON_Print(root);
-				ret = ESP_OK;
-			} else {
-				ESP_LOGE(TAG, "HTTP client read response failed");
-			}
-		}
-	}
-	esp_http_client_close(client);
-	esp_http_client_cleanup(client);
-	return ret;
-}
-
-esp_err_t sqlite3_client_post(char * path, char * name, int gender)
-{
-	ESP_LOGI(TAG, "sqlite3_client_post path=%s",path);
-	char output_buffer[MAX_HTTP_OUTPUT_BUFFER] = {0};
-	char url[64];
-	sprintf(url, "http://%s:%d/", CONFIG_ESP_WEB_SERVER, CONFIG_ESP_WEB_SERVER_PORT);
-	if (strlen(path) > 0) {
-		int url_length = strlen(url);
-		if (url[url_length-1] != '/') strcat(url,"/");
-		strcat(url, path);
-	}
-	ESP_LOGI(TAG, "url=[%s]",url);
-	
-	esp_http_client_config_t config = {
-		.url = url,
-	};
-	esp_http_client_handle_t client = esp_http_client_init(&config);
-
-	// POST Request
-	esp_err_t ret = ESP_FAIL;
-	char post_data[64];
-	//sprintf(post_data, "name=%s&gender=%d", name, gender);
-	sprintf(post_data, "{\"name\":\"%s\", \"gender\":%d}", name, gender);
-	ESP_LOGI(TAG, "post_data=[%s]", post_data);
-	esp_http_client_set_method(client, HTTP_METHOD_POST);
-	esp_http_client_set_header(client, "Content-Type", "application/json");
-	esp_err_t err = esp_http_client_open(client, strlen(post_data));
-	if (err != ESP_OK) {
-		ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
-	} else {
-		int wlen = esp_http_client_write(client, post_data, strlen(post_data));
-		if (wlen < 0) {
-			ESP_LOGE(TAG, "HTTP client write failed");
-		}
-		int64_t content_length = esp_http_client_fetch_headers(client);
-		if (content_length < 0) {
-			ESP_LOGE(TAG, "HTTP client fetch headers failed");
-		} else {
-			int data_read = esp_http_client_read_response(client, output_buffer, MAX_HTTP_OUTPUT_BUFFER);
-			if (data_read >= 0) {
-				ESP_LOGI(TAG, "HTTP POST Status = %d, data_read=%d",
-					esp_http_client_get_status_code(client), data_read);
-				ESP_LOG_BUFFER_HEXDUMP(TAG, output_buffer, data_read, ESP_LOG_DEBUG);
-				output_buffer[data_read] = 0;
-				ESP_LOGD(TAG, "\n%s", output_buffer);
-				cJSON *root = cJSON_Parse(output_buffer);
-				char *response_string = cJSON_Print(root);
-				ESP_LOGI(TAG, "response_string\n%s",response_string);
-				cJSON_Delete(root);
-				cJSON_free(response_string);
-				ret = ESP_OK;
-			} else {
-				ESP_LOGE(TAG, "HTTP client read response failed");
-			}
-		}
-	}
-	esp_http_client_close(client);
-	esp_http_client_cleanup(client);
-	return ret;
-}
-
-esp_err_t sqlite3_client_put(char * path, char * name, int gender)
-{
-	ESP_LOGI(TAG, "sqlite3_client_put path=%s",path);
-	char output_buffer[MAX_HTTP_OUTPUT_BUFFER] = {0};
-	char url[64];
-	sprintf(url, "http://%s:%d/", CONFIG_ESP_WEB_SERVER, CONFIG_ESP_WEB_SERVER_PORT);
-	if (strlen(path) > 0) {
-		int url_length = strlen(url);
-		if (url[url_length-1] != '/') strcat(url,"/");
-		strcat(url, path);
-	}
-	ESP_LOGI(TAG, "url=[%s]",url);
-
-	esp_http_client_config_t config = {
-		.url = url,
-	};
-	esp_http_client_handle_t client = esp_http_client_init(&config);
-
-	// PUT Request
-	esp_err_t ret = ESP_FAIL;
-	char post_data[64];
-	//sprintf(post_data, "name=%s&gender=%d", name, gender);
-	sprintf(post_data, "{\"name\":\"%s\", \"gender\":%d}", name, gender);
-	ESP_LOGI(TAG, "post_data=[%s]", post_data);
-	esp_http_client_set_method(client, HTTP_METHOD_PUT);
-	esp_http_client_set_header(client, "Content-Type", "application/json");
-	esp_err_t err = esp_http_client_open(client, strlen(post_data));
-	if (err != ESP_OK) {
-		ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
-	} else {
-		int wlen = esp_http_client_write(client, post_data, strlen(post_data));
-		if (wlen < 0) {
-			ESP_LOGE(TAG, "HTTP client write failed");
-		}
-		int64_t content_length = esp_http_client_fetch_headers(client);
-		if (content_length < 0) {
-			ESP_LOGE(TAG, "HTTP client fetch headers failed");
-		} else {
-			int data_read = esp_http_client_read_response(client, output_buffer, MAX_HTTP_OUTPUT_BUFFER);
-			if (data_read >= 0) {
-				ESP_LOGI(TAG, "HTTP PUT Status = %d, data_read=%d",
-					esp_http_client_get_status_code(client), data_read);
-				ESP_LOG_BUFFER_HEXDUMP(TAG, output_buffer, data_read, ESP_LOG_DEBUG);
-				output_buffer[data_read] = 0;
-				ESP_LOGD(TAG, "\n%s", output_buffer);
-				cJSON *root = cJSON_Parse(output_buffer);
-				char *response_string = cJSON_Print(root);
-				ESP_LOGI(TAG, "response_string\n%s",response_string);
-				cJSON_Delete(root);
-				cJSON_free(response_string);
-				ret = ESP_OK;
-			} else {
-				ESP_LOGE(TAG, "HTTP client read response failed");
-			}
-		}
-	}
-	esp_http_client_close(client);
-	esp_http_client_cleanup(client);
-	return ret;
-}
-
-esp_err_t sqlite3_client_delete(char * path)
+static esp_err_t print_group(const char *group, int rows, const double *values, void *ctx)
 {
-	ESP_LOGI(TAG, "sqlite3_client_delete path=%s",path);
-	char output_buffer[MAX_HTTP_OUTPUT_BUFFER] = {0};
-	char url[64];
-	sprintf(url, "http://%s:%d/", CONFIG_ESP_WEB_SERVER, CONFIG_ESP_WEB_SERVER_PORT);
-	if (strlen(path) > 0) {
-		int url_length = strlen(url);
-		if (url[url_length-1] != '/') strcat(url,"/");
-		strcat(url, path);
-	}
-	ESP_LOGI(TAG, "url=[%s]",url);
-
-	esp_http_client_config_t config = {
-		.url = url,
-	};
-	esp_http_client_handle_t client = esp_http_client_init(&config);
-
-	// DELETE Request
-	esp_err_t ret = ESP_FAIL;
-	esp_http_client_set_method(client, HTTP_METHOD_DELETE);
-	esp_err_t err = esp_http_client_open(client, 0);
-	if (err != ESP_OK) {
-		ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
-	} else {
-		int wlen = esp_http_client_write(client, "", 0);
-		if (wlen < 0) {
-			ESP_LOGE(TAG, "HTTP client write failed");
-		}
-		int64_t content_length = esp_http_client_fetch_headers(client);
-		if (content_length < 0) {
-			ESP_LOGE(TAG, "HTTP client fetch headers failed");
-		} else {
-			int data_read = esp_http_client_read_response(client, output_buffer, MAX_HTTP_OUTPUT_BUFFER);
-			if (data_read >= 0) {
-				ESP_LOGI(TAG, "HTTP DELETE Status = %d, data_read=%d",
-					esp_http_client_get_status_code(client), data_read);
-				ESP_LOG_BUFFER_HEXDUMP(TAG, output_buffer, data_read, ESP_LOG_DEBUG);
-				output_buffer[data_read] = 0;
-				ESP_LOGD(TAG, "\n%s", output_buffer);
-				cJSON *root = cJSON_Parse(output_buffer);
-				char *response_string = cJSON_Print(root);
-				ESP_LOGI(TAG, "response_string\n%s",response_string);
-				cJSON_Delete(root);
-				cJSON_free(response_string);
-				ret = ESP_OK;
-			} else {
-				ESP_LOGE(TAG, "HTTP client read response failed");
-			}
-		}
-	}
-	esp_http_client_close(client);
-	esp_http_client_cleanup(client);
-	return ret;
-}
-
-int sqlite3_client_get_maxid(char * path)
-{
-	ESP_LOGI(TAG, "sqlite3_client_get_maxid path=%s",path);
-	char output_buffer[MAX_HTTP_OUTPUT_BUFFER] = {0};
-	char _path[64];
-	sprintf(_path, "/%s?limit=1&by=id&order=desc", path);
-	ESP_LOGI(TAG, "_path=[%s]", _path);
-	esp_http_client_config_t config = {
-		.host = CONFIG_ESP_WEB_SERVER,
-		.port = CONFIG_ESP_WEB_SERVER_PORT,
-		//.path = "/customers/?limit=1&by=id&order=desc",
-		.path = _path,
-	};
-	esp_http_client_handle_t client = esp_http_client_init(&config);
-
-	// GET Request
-	int newid = -1;
-	esp_http_client_set_method(client, HTTP_METHOD_GET);
-	esp_err_t err = esp_http_client_open(client, 0);
-	if (err != ESP_OK) {
-		ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
-	} else {
-		int64_t content_length = esp_http_client_fetch_headers(client);
-		ESP_LOGI(TAG, "HTTP GET content_length = %"PRId64, content_length);
-		if (content_length < 0) {
-			ESP_LOGE(TAG, "HTTP client fetch headers failed");
-		} else {
-			int data_read = esp_http_client_read_response(client, output_buffer, MAX_HTTP_OUTPUT_BUFFER);
-			if (data_read >= 0) {
-				ESP_LOGI(TAG, "HTTP GET Status = %d, data_read = %d",
-					esp_http_client_get_status_code(client), data_read);
-				ESP_LOG_BUFFER_HEXDUMP(TAG, output_buffer, data_read, ESP_LOG_DEBUG);
-				output_buffer[data_read] = 0;
-				ESP_LOGD(TAG, "\n%s", output_buffer);
-				cJSON *root = cJSON_Parse(output_buffer);
-				int root_array_size = cJSON_GetArraySize(root); 
-				ESP_LOGD(TAG, "root_array_size=%d", root_array_size);
-				for (int i=0;i<root_array_size;i++) {
-					cJSON *array = cJSON_GetArrayItem(root,i);
-					newid = cJSON_GetObjectItem(array,"id")->valueint;
-					ESP_LOGD(TAG, "newid=%d",newid);
-				}
-				cJSON_Delete(root);
-			} else {
-				ESP_LOGE(TAG, "HTTP client read response failed");
-			}
-		}
-	}
-	esp_http_client_close(client);
-	esp_http_client_cleanup(client);
-	return newid;
+	ESP_LOGI(TAG, "%s\t%d\t%.0f\t%.0f", group ? group : "null", rows, values[0], values[1]);
+	return ESP_OK;
 }
 
 void http_task(void *pvParameters)
@@ -505,7 +202,19 @@ void http_task(void *pvParameters)
 	ESP_LOGW(TAG, "Enter key to Read all data");
 	xEventGroupClearBits(xEventGroup, KEYBOARD_ENTER_BIT);
 	xEventGroupWaitBits(xEventGroup, KEYBOARD_ENTER_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
-	sqlite3_client_get("customers/"); 
+	sqlite3_cursor_config_t cursor_config = {
+		.table = "customers",
+	};
+	sqlite3_cursor_handle_t cursor;
+	if (sqlite3_cursor_open(&cursor_config, &cursor) == ESP_OK) {
+		const cJSON *row;
+		ESP_LOGI(TAG, "-----------------------------------------");
+		while (sqlite3_cursor_next(cursor, &row) == ESP_OK) {
+			JSON_Record(row);
+		}
+		ESP_LOGI(TAG, "-----------------------------------------");
+		sqlite3_cursor_close(cursor);
+	}
 
 	// Read by ID
 	ESP_LOGI(TAG, "");
@@ -519,7 +228,39 @@ void http_task(void *pvParameters)
 	ESP_LOGW(TAG, "Enter key to Read by gender");
 	xEventGroupClearBits(xEventGroup, KEYBOARD_ENTER_BIT);
 	xEventGroupWaitBits(xEventGroup, KEYBOARD_ENTER_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
-	sqlite3_client_get("customers/gender/2"); 
+	customer_t customers[10];
+	int count;
+	sqlite3_query_t query;
+	sqlite3_query_init(&query, "customers");
+	sqlite3_query_where_int(&query, "gender", 2);
+	sqlite3_query_order(&query, "name", false);
+	sqlite3_query_limit(&query, 10, 0);
+	if (sqlite3_query_path(&query) && sqlite3_client_get_records(sqlite3_query_path(&query), &customer_schema, customers, 10, &count) == ESP_OK) {
+		ESP_LOGI(TAG, "-----------------------------------------");
+		for (int i=0;i<count;i++) {
+			ESP_LOGI(TAG, "%d\t%s\t%d", customers[i].id, customers[i].name, customers[i].gender);
+		}
+		ESP_LOGI(TAG, "-----------------------------------------");
+	}
+
+	// Count by gender
+	ESP_LOGI(TAG, "");
+	ESP_LOGW(TAG, "Enter key to Count by gender");
+	xEventGroupClearBits(xEventGroup, KEYBOARD_ENTER_BIT);
+	xEventGroupWaitBits(xEventGroup, KEYBOARD_ENTER_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+	static const sqlite3_aggregate_column_t per_gender[] = {
+		{ SQLITE3_AGGREGATE_MIN, "id" },
+		{ SQLITE3_AGGREGATE_MAX, "id" },
+	};
+	sqlite3_aggregate_config_t aggregate_config = {
+		.table = "customers",
+		.group_by = "gender",
+		.columns = per_gender,
+		.column_count = 2,
+	};
+	ESP_LOGI(TAG, "-----------------------------------------");
+	sqlite3_aggregate(&aggregate_config, print_group, NULL);
+	ESP_LOGI(TAG, "-----------------------------------------");
 
 	// Create
 	ESP_LOGI(TAG, "");
@@ -528,11 +269,13 @@ void http_task(void *pvParameters)
 	xEventGroupWaitBits(xEventGroup, KEYBOARD_ENTER_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
 	int newid = 0;
 	char path[64];
-	if (sqlite3_client_post("customers/", "Tom", 1) == ESP_OK) {
-		newid = sqlite3_client_get_maxid("customers/"); 
+	char post_data[64];
+	cJSON *row = NULL;
+	snprintf(post_data, sizeof(post_data), "{\"name\":\"%s\", \"gender\":%d}", "Tom", 1);
+	if (sqlite3_client_create("customers", post_data, strlen(post_data), &newid, &row) == ESP_OK) {
 		ESP_LOGI(TAG, "newid=%d", newid);
-		sprintf(path, "customers/%d", newid);
-		sqlite3_client_get(path); 
+		JSON_Print(row);
+		cJSON_Delete(row);
 	}
 
 	// Update
@@ -540,7 +283,7 @@ void http_task(void *pvParameters)
 	ESP_LOGW(TAG, "Enter key to Update new record");
 	xEventGroupClearBits(xEventGroup, KEYBOARD_ENTER_BIT);
 	xEventGroupWaitBits(xEventGroup, KEYBOARD_ENTER_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
-	sprintf(path, "customers/%d", newid);
+	snprintf(path, sizeof(path), "customers/%d", newid);
 	if(sqlite3_client_get(path) == ESP_OK) { 
 		sqlite3_client_put(path, "Petty", 2); 
 		sqlite3_client_get(path); 
@@ -588,9 +331,65 @@ void app_main()
 	}
 	ESP_ERROR_CHECK(ret);
 
+	// Parse JSON into per request arenas
+	ESP_ERROR_CHECK(json_arena_init());
+
 	// Initialize WiFi
 	ESP_ERROR_CHECK(wifi_init_sta());
 
+	// Initialize HTTP connection pool
+#if CONFIG_ESP_HTTPS_SERVER_CERT
+	http_pool_set_server_cert(server_cert_pem_start);
+#endif
+	ESP_ERROR_CHECK(http_pool_init(CONFIG_ESP_WEB_SERVER, CONFIG_ESP_WEB_SERVER_PORT));
+
+#if CONFIG_ESP_CACHE_ENABLE
+	// Initialize row cache
+	ESP_ERROR_CHECK(sqlite3_cache_init());
+#endif
+
+#if CONFIG_ESP_COALESCE_ENABLE
+	// Initialize read coalescing
+	ESP_ERROR_CHECK(sqlite3_flight_init());
+#endif
+
+#if CONFIG_ESP_WAL_ENABLE
+	// Mount FAT file system for the write-ahead queue
+	esp_vfs_fat_mount_config_t mount_config = {
+		.max_files = 4,
+		.format_if_mount_failed = true,
+		.allocation_unit_size = CONFIG_WL_SECTOR_SIZE,
+	};
+	wl_handle_t wl_handle;
+	ESP_ERROR_CHECK(esp_vfs_fat_spiflash_mount_rw_wl(CONFIG_ESP_WAL_BASE_PATH, "storage", &mount_config, &wl_handle));
+
+	// Initialize write-ahead queue
+	ESP_ERROR_CHECK(sqlite3_wal_init());
+#endif
+
+#if CONFIG_ESP_REPLICA_ENABLE
+	// Mount FAT file system for the table replica
+	esp_vfs_fat_mount_config_t replica_mount_config = {
+		.max_files = 6,
+		.format_if_mount_failed = true,
+		.allocation_unit_size = CONFIG_WL_SECTOR_SIZE,
+	};
+	wl_handle_t replica_wl_handle;
+	ESP_ERROR_CHECK(esp_vfs_fat_spiflash_mount_rw_wl(CONFIG_ESP_REPLICA_BASE_PATH, "replica", &replica_mount_config, &replica_wl_handle));
+
+	// Mirror the customers table; it is synced in the background
+	ESP_ERROR_CHECK(sqlite3_replica_init());
+	ESP_ERROR_CHECK(sqlite3_replica_add("customers"));
+#endif
+
+	// Start asynchronous request workers
+	ESP_ERROR_CHECK(sqlite3_async_init());
+
+#if CONFIG_ESP_STATS_DUMP_MS > 0
+	// Log request statistics periodically
+	ESP_ERROR_CHECK(sqlite3_stats_start_dump(CONFIG_ESP_STATS_DUMP_MS));
+#endif
+
 	// Create EventGroup
 	xEventGroup = xEventGroupCreate();
 
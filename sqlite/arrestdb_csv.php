@@ -0,0 +1,60 @@
+<?php
+/*
+ * Router script for PHP's built-in web server that adds the compact CSV response mode to ArrestDB.
+ * GET requests with "Accept: text/csv" are answered with a header row and one line per row
+ * instead of pretty printed JSON. Everything else, errors included, is passed through unchanged.
+ *
+ * php -S 0.0.0.0:8080 -t $HOME/ArrestDB arrestdb_csv.php
+ *
+ * This sample code is in the public domain.
+ */
+$root = $_SERVER['DOCUMENT_ROOT'];
+$path = parse_url($_SERVER['REQUEST_URI'], PHP_URL_PATH);
+
+// ArrestDB takes the route from what follows SCRIPT_NAME in PHP_SELF
+$_SERVER['SCRIPT_NAME'] = '/index.php';
+$_SERVER['SCRIPT_FILENAME'] = $root . '/index.php';
+$_SERVER['PHP_SELF'] = '/index.php' . $path;
+
+// NULL is an empty field, an empty string is quoted
+function csv_field($value)
+{
+	if (is_null($value)) return '';
+	if (is_bool($value)) return $value ? '1' : '0';
+	$text = (string) $value;
+	if ($text === '' || strpbrk($text, ",\"\r\n") !== false) {
+		return '"' . str_replace('"', '""', $text) . '"';
+	}
+	return $text;
+}
+
+// Runs after ArrestDB exits, before its buffered output is sent
+function csv_reply()
+{
+	$json = ob_get_clean();
+	$rows = json_decode($json, true);
+	if (http_response_code() != 200 || !is_array($rows) || empty($rows)) {
+		echo $json;
+		return;
+	}
+	// A single row ("table/id") is an object
+	if (array_keys($rows) !== range(0, count($rows) - 1)) $rows = array($rows);
+	$columns = array_keys($rows[0]);
+	header('Content-Type: text/csv; charset=utf-8');
+	echo implode(',', array_map('csv_field', $columns)), "\n";
+	foreach ($rows as $row) {
+		$fields = array();
+		foreach ($columns as $column) {
+			$fields[] = csv_field(array_key_exists($column, $row) ? $row[$column] : null);
+		}
+		echo implode(',', $fields), "\n";
+	}
+}
+
+if ($_SERVER['REQUEST_METHOD'] == 'GET' && strpos(isset($_SERVER['HTTP_ACCEPT']) ? $_SERVER['HTTP_ACCEPT'] : '', 'text/csv') !== false) {
+	ob_start();
+	register_shutdown_function('csv_reply');
+}
+
+chdir($root);
+require $root . '/index.php';
@@ -0,0 +1,301 @@
+#!/usr/bin/env python3
+#
+# In-memory stand-in for ArrestDB, for benchmarks and tests without PHP.
+#
+# It answers the same routes with the same status codes:
+#   GET    /table[?limit=&offset=&by=&order=]
+#   GET    /table/id
+#   GET    /table/column/value[?limit=&offset=&by=&order=]
+#   POST   /table           (one object, or an array of objects in one go)
+#   PUT    /table/id
+#   DELETE /table/id
+#
+# GET requests that accept text/csv are answered with a header row and one line per row,
+# as sqlite/arrestdb_csv.php does for ArrestDB.
+# Bodies of at least 256 bytes are gzip compressed when the request accepts it,
+# as PHP does with zlib.output_compression=On.
+#
+# python3 mock_arrestdb.py --port 8080 --rows 10000 --latency 20 --jitter 5
+#
+# A row posted with the id of an existing row is a conflict (409), and the whole array is rejected,
+# as ArrestDB inserts an array in one transaction.
+#
+# Failures for tests (test/main/test.c), answered before the connection goes away:
+#   GET /_mock/down/<ms>        close every connection without an answer for that long
+#   GET /_mock/fail/<offset>    answer the next GET with that offset with 503 Service Unavailable
+#
+# With --tls-cert and --tls-key it terminates TLS itself, as a stand-in for an HTTPS server.
+# --verbose then logs whether each connection made a full handshake or resumed a session.
+#
+# This sample code is in the public domain.
+
+import argparse
+import gzip
+import json
+import random
+import ssl
+import threading
+import time
+import zlib
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import urlsplit, parse_qs, unquote
+
+NAMES = ["Luis", "Leonie", "Francois", "Bjorn"]
+
+
+class Database:
+	def __init__(self):
+		self.lock = threading.Lock()
+		self.tables = {}
+		self.next_id = {}
+
+	def table(self, name):
+		return self.tables.setdefault(name, {})
+
+	def conflicts(self, name, rows):
+		ids = [int(r["id"]) for r in rows if str(r.get("id", "")).isdigit()]
+		return len(set(ids)) < len(ids) or any(i in self.table(name) for i in ids)
+
+	def insert(self, name, row):
+		table = self.table(name)
+		new_id = self.next_id.get(name, 1)
+		if str(row.get("id", "")).isdigit():
+			new_id = int(row["id"])
+		self.next_id[name] = max(self.next_id.get(name, 1), new_id + 1)
+		stored = {"id": new_id}
+		stored.update({k: v for k, v in row.items() if k != "id"})
+		table[new_id] = stored
+		return new_id
+
+	def seed(self, rows, padding):
+		for i in range(rows):
+			row = {"name": NAMES[i % len(NAMES)], "gender": 1 + (i // 2) % 2}
+			if padding:
+				row["note"] = "x" * padding
+			self.insert("customers", row)
+
+
+def csv_field(value):
+	# NULL is an empty field, an empty string is quoted
+	if value is None:
+		return ""
+	text = str(value)
+	if text == "" or any(c in text for c in ',"\r\n'):
+		return '"' + text.replace('"', '""') + '"'
+	return text
+
+
+class Handler(BaseHTTPRequestHandler):
+	protocol_version = "HTTP/1.1"
+	db = None
+	options = None
+	down_until = 0
+	fail_offsets = set()
+
+	def setup(self):
+		# The handshake runs here, in the connection's thread, not in the accept loop
+		if isinstance(self.request, ssl.SSLSocket):
+			self.request.do_handshake()
+			self.log_message("%s %s", self.request.version(), "resumed" if self.request.session_reused else "full handshake")
+		super().setup()
+
+	def log_message(self, format, *args):
+		if self.options.verbose:
+			super().log_message(format, *args)
+
+	def delay(self):
+		latency = self.options.latency + random.uniform(-self.options.jitter, self.options.jitter)
+		# The occasional stuck request, like a PHP worker blocked on the database lock
+		if self.options.stall > 0 and random.uniform(0, 100) < self.options.stall:
+			latency += self.options.stall_ms
+		if latency > 0:
+			time.sleep(latency / 1000.0)
+
+	def dropped(self):
+		# Close the connection without an answer, like a server that went away
+		if time.time() < Handler.down_until:
+			self.close_connection = True
+			return True
+		return False
+
+	def control(self, parts):
+		if parts[1] == "down":
+			Handler.down_until = time.time() + int(parts[2]) / 1000.0
+		elif parts[1] == "fail":
+			Handler.fail_offsets.add(parts[2])
+		else:
+			return self.error(400, "Bad Request")
+		self.success(200, "OK")
+
+	def send(self, code, data, content_type=None, headers=None):
+		if len(data) >= 256 and not self.options.no_compress and "gzip" in self.headers.get("Accept-Encoding", ""):
+			data = gzip.compress(data)
+			headers = dict(headers or {}, **{"Content-Encoding": "gzip"})
+		self.send_response(code)
+		if content_type:
+			self.send_header("Content-Type", content_type)
+		self.send_header("Content-Length", str(len(data)))
+		for key, value in (headers or {}).items():
+			self.send_header(key, value)
+		self.end_headers()
+		self.wfile.write(data)
+
+	def reply(self, code, body=None, headers=None):
+		if body is None:
+			return self.send(code, b"", None, headers)
+		self.send(code, json.dumps(body).encode(), "application/json", headers)
+
+	def accepts_csv(self):
+		return not self.options.no_csv and "text/csv" in self.headers.get("Accept", "")
+
+	def reply_csv(self, rows):
+		columns = list(rows[0].keys())
+		lines = [",".join(csv_field(c) for c in columns)]
+		lines += [",".join(csv_field(row.get(c)) for c in columns) for row in rows]
+		self.send(200, ("\n".join(lines) + "\n").encode(), "text/csv; charset=utf-8")
+
+	def error(self, code, status):
+		self.reply(code, {"error": {"code": code, "status": status}})
+
+	def success(self, code, status, extra=None, headers=None):
+		body = {"success": {"code": code, "status": status}}
+		if extra:
+			body["success"].update(extra)
+		self.reply(code, body, headers)
+
+	def route(self):
+		url = urlsplit(self.path)
+		parts = [unquote(p) for p in url.path.split("/") if p]
+		query = {k: v[0] for k, v in parse_qs(url.query).items()}
+		return parts, query
+
+	def body(self):
+		length = int(self.headers.get("Content-Length", 0))
+		data = self.rfile.read(length) if length else b""
+		# ArrestDB inflates bodies that start with a zlib header
+		if data[:1] == b"\x78":
+			data = zlib.decompress(data)
+		return json.loads(data) if data else None
+
+	def do_GET(self):
+		self.delay()
+		parts, query = self.route()
+		if len(parts) == 3 and parts[0] == "_mock":
+			return self.control(parts)
+		if self.dropped():
+			return
+		if query.get("offset") in Handler.fail_offsets:
+			Handler.fail_offsets.discard(query["offset"])
+			return self.error(503, "Service Unavailable")
+		if not parts or parts[0] not in self.db.tables:
+			return self.error(404, "Not Found")
+		with self.db.lock:
+			rows = list(self.db.tables[parts[0]].values())
+		if len(parts) == 2:
+			row = self.db.tables[parts[0]].get(int(parts[1])) if parts[1].isdigit() else None
+			if row and self.accepts_csv():
+				return self.reply_csv([row])
+			return self.reply(200, row) if row else self.error(404, "Not Found")
+		if len(parts) == 3:
+			rows = [r for r in rows if str(r.get(parts[1])) == parts[2]]
+		if "by" in query:
+			by = query["by"]
+			rows.sort(key=lambda r: (r.get(by) is None, r.get(by)), reverse=query.get("order", "asc").lower() == "desc")
+		offset = int(query.get("offset", 0))
+		if "limit" in query:
+			rows = rows[offset:offset + int(query["limit"])]
+		elif offset:
+			rows = rows[offset:]
+		if not rows:
+			return self.reply(204)
+		if self.accepts_csv():
+			return self.reply_csv(rows)
+		self.reply(200, rows)
+
+	def do_POST(self):
+		self.delay()
+		if self.dropped():
+			return
+		parts, _ = self.route()
+		if len(parts) != 1:
+			return self.error(400, "Bad Request")
+		try:
+			body = self.body()
+		except ValueError:
+			return self.error(400, "Bad Request")
+		rows = body if isinstance(body, list) else [body]
+		if not rows or not all(isinstance(r, dict) for r in rows):
+			return self.reply(204)
+		with self.db.lock:
+			conflict = self.db.conflicts(parts[0], rows)
+			ids = [] if conflict else [self.db.insert(parts[0], r) for r in rows]
+		if conflict:
+			return self.error(409, "Conflict")
+		if self.options.return_id and len(ids) == 1:
+			return self.success(201, "Created", {"id": ids[0]}, {"Location": "/%s/%d" % (parts[0], ids[0])})
+		self.success(201, "Created")
+
+	def do_PUT(self):
+		self.delay()
+		if self.dropped():
+			return
+		parts, _ = self.route()
+		if len(parts) != 2 or not parts[1].isdigit():
+			return self.error(400, "Bad Request")
+		try:
+			body = self.body()
+		except ValueError:
+			return self.error(400, "Bad Request")
+		with self.db.lock:
+			row = self.db.table(parts[0]).get(int(parts[1]))
+			if row is None:
+				return self.error(404, "Not Found")
+			row.update({k: v for k, v in body.items() if k != "id"})
+		self.success(200, "OK")
+
+	def do_DELETE(self):
+		self.delay()
+		if self.dropped():
+			return
+		parts, _ = self.route()
+		if len(parts) != 2 or not parts[1].isdigit():
+			return self.error(400, "Bad Request")
+		with self.db.lock:
+			row = self.db.table(parts[0]).pop(int(parts[1]), None)
+		if row is None:
+			return self.error(404, "Not Found")
+		self.success(200, "OK")
+
+
+def main():
+	parser = argparse.ArgumentParser(description="In-memory stand-in for ArrestDB")
+	parser.add_argument("--host", default="0.0.0.0")
+	parser.add_argument("--port", type=int, default=8080)
+	parser.add_argument("--rows", type=int, default=4, help="rows to seed the customers table with")
+	parser.add_argument("--padding", type=int, default=0, help="bytes of an extra note column per seeded row")
+	parser.add_argument("--latency", type=float, default=0, help="added to every request (ms)")
+	parser.add_argument("--jitter", type=float, default=0, help="random +/- on top of the latency (ms)")
+	parser.add_argument("--stall", type=float, default=0, help="percent of the requests that stall")
+	parser.add_argument("--stall-ms", type=float, default=1000, help="how long a stalled request takes (ms)")
+	parser.add_argument("--return-id", action="store_true", help="answer an insert with the new id and a Location header")
+	parser.add_argument("--no-csv", action="store_true", help="always answer JSON, like stock ArrestDB")
+	parser.add_argument("--no-compress", action="store_true", help="never compress responses")
+	parser.add_argument("--tls-cert", help="PEM certificate, to serve HTTPS")
+	parser.add_argument("--tls-key", help="PEM private key of the certificate")
+	parser.add_argument("--verbose", action="store_true")
+	options = parser.parse_args()
+
+	Handler.db = Database()
+	Handler.db.seed(options.rows, options.padding)
+	Handler.options = options
+	server = ThreadingHTTPServer((options.host, options.port), Handler)
+	if options.tls_cert:
+		context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+		context.load_cert_chain(options.tls_cert, options.tls_key)
+		server.socket = context.wrap_socket(server.socket, server_side=True, do_handshake_on_connect=False)
+	print("mock ArrestDB on %s://%s:%d, %d rows" % ("https" if options.tls_cert else "http", options.host, options.port, options.rows))
+	server.serve_forever()
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,384 @@
+/* Tests of the remote sqlite3 client
+ *
+ * Run on the linux target against sqlite/mock_arrestdb.py, which also plays the failures:
+ *   python3 ../sqlite/mock_arrestdb.py --rows 100 &
+ *   idf.py --preview set-target linux && idf.py build
+ *   ./build/sqlite3-test.elf
+ *
+ * Environment: TEST_SERVER, TEST_PORT.
+ * The replica tests use their own tables, "parts" (never on the server) and "devices".
+ * Exits with the number of failed checks. Every run adds rows, so restart the mock for the next one.
+ *
+ * This sample code is in the public domain.
+ */
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#if CONFIG_ESP_BREAKER_ENABLE
+#include "http_breaker.h"
+#endif
+#include "http_pool.h"
+#include "json_arena.h"
+#include "sqlite3_aggregate.h"
+#if CONFIG_ESP_CACHE_ENABLE
+#include "sqlite3_cache.h"
+#endif
+#include "sqlite3_client.h"
+#include "sqlite3_cursor.h"
+#if CONFIG_ESP_REPLICA_ENABLE
+#include "sqlite3_replica.h"
+#endif
+#if CONFIG_ESP_COALESCE_ENABLE
+#include "sqlite3_flight.h"
+#endif
+#include "sqlite3_wal.h"
+
+static const char *TAG = "TEST";
+
+static int s_failures;
+
+#define TEST_CHECK(condition) do { \
+	if (!(condition)) { \
+		ESP_LOGE(TAG, "%s:%d: %s", __func__, __LINE__, #condition); \
+		s_failures++; \
+	} \
+} while (0)
+
+/* Have the mock close every connection without an answer for ms */
+static void test_server_down(int ms)
+{
+	char path[32];
+	snprintf(path, sizeof(path), "_mock/down/%d", ms);
+	ESP_ERROR_CHECK(sqlite3_client_request(HTTP_METHOD_GET, path, NULL, 0));
+}
+
+static esp_err_t test_count_group(const char *group, int rows, const double *values, void *ctx)
+{
+	*(int *)ctx = rows;
+	return ESP_OK;
+}
+
+/* Rows of the customers table, only those named name unless it is NULL; -1 when the scan failed */
+static int test_count(const char *name)
+{
+	static const sqlite3_aggregate_column_t columns[] = {
+		{ SQLITE3_AGGREGATE_COUNT, NULL },
+	};
+	sqlite3_aggregate_config_t config = {
+		.table = "customers",
+		.where = name ? "name" : NULL,
+		.equals = name,
+		.columns = columns,
+		.column_count = 1,
+	};
+	int count = 0;
+	if (sqlite3_aggregate(&config, test_count_group, &count) != ESP_OK) return -1;
+	return count;
+}
+
+static esp_err_t test_count_row(const cJSON *row, void *ctx)
+{
+	(*(int *)ctx)++;
+	return ESP_OK;
+}
+
+/* Wake the replay and wait until the write-ahead queue is empty */
+static bool test_wait_replayed(int timeout_ms)
+{
+	sqlite3_wal_kick();
+	for (int waited=0;waited<timeout_ms;waited+=100) {
+		if (!sqlite3_wal_pending()) return true;
+		vTaskDelay(pdMS_TO_TICKS(100));
+	}
+	return false;
+}
+
+/* More writes than segments while the server is down: small writes share a segment */
+static void test_wal_offline_writes(void)
+{
+	int writes = CONFIG_ESP_WAL_MAX_SEGMENTS + 8;
+	test_server_down(3000);
+	for (int i=0;i<writes;i++) {
+		char row[64];
+		int len = snprintf(row, sizeof(row), "{\"name\":\"offline\",\"gender\":%d}", i);
+		TEST_CHECK(sqlite3_client_send(HTTP_METHOD_POST, "customers", row, len) == ESP_ERR_NOT_FINISHED);
+	}
+	TEST_CHECK(sqlite3_wal_pending());
+	vTaskDelay(pdMS_TO_TICKS(3000));
+	TEST_CHECK(test_wait_replayed(20000));
+	TEST_CHECK(test_count("offline") == writes);
+}
+
+/* A rejected row in a merged replay is dropped alone: the mock rejects a row with the id of an existing one */
+static void test_wal_rejected_insert(void)
+{
+	test_server_down(2000);
+	for (int i=0;i<5;i++) {
+		char row[64];
+		int len = (i == 2) ? snprintf(row, sizeof(row), "{\"id\":1,\"name\":\"rejected\"}")
+			: snprintf(row, sizeof(row), "{\"name\":\"merged\",\"gender\":%d}", i);
+		TEST_CHECK(sqlite3_client_send(HTTP_METHOD_POST, "customers", row, len) == ESP_ERR_NOT_FINISHED);
+	}
+	vTaskDelay(pdMS_TO_TICKS(2000));
+	TEST_CHECK(test_wait_replayed(20000));
+	TEST_CHECK(test_count("merged") == 4);
+	TEST_CHECK(test_count("rejected") == 0);
+}
+
+/* A page that fails is reported once and read again on the next call, no rows are skipped */
+static void test_cursor_retry(void)
+{
+	int rows = test_count(NULL);
+	TEST_CHECK(rows > 30);
+	ESP_ERROR_CHECK(sqlite3_client_request(HTTP_METHOD_GET, "_mock/fail/20", NULL, 0));
+	sqlite3_cursor_config_t config = {
+		.table = "customers",
+		.page_size = 10,
+	};
+	sqlite3_cursor_handle_t cursor;
+	TEST_CHECK(sqlite3_cursor_open(&config, &cursor) == ESP_OK);
+	int read = 0;
+	int failed = 0;
+	int last_id = 0;
+	bool ordered = true;
+	while (failed <= 1) {
+		const cJSON *row;
+		esp_err_t err = sqlite3_cursor_next(cursor, &row);
+		if (err == ESP_ERR_NOT_FOUND) break;
+		if (err != ESP_OK) {
+			failed++;
+			continue;
+		}
+		int id = sqlite3_client_row_id(row);
+		if (id <= last_id) ordered = false;
+		last_id = id;
+		read++;
+	}
+	sqlite3_cursor_close(cursor);
+	TEST_CHECK(failed == 1);
+	TEST_CHECK(ordered);
+	TEST_CHECK(read == rows);
+}
+
+#if CONFIG_ESP_CACHE_ENABLE
+/* An expired row read by primary key is served while the server is down, also once the breaker opened */
+static void test_cache_stale(void)
+{
+	int rows = 0;
+	TEST_CHECK(sqlite3_client_get_rows("customers/1", test_count_row, &rows) == ESP_OK);
+	TEST_CHECK(rows == 1);
+	vTaskDelay(pdMS_TO_TICKS(CONFIG_ESP_CACHE_TTL_MS + 100));
+	test_server_down(2000);
+	int reads = 2;
+	int recover_ms = 2000;
+#if CONFIG_ESP_BREAKER_ENABLE
+	reads = CONFIG_ESP_BREAKER_FAILURES + 1;
+	recover_ms += 2 * CONFIG_ESP_BREAKER_PROBE_MS;
+#endif
+	for (int i=0;i<reads;i++) {
+		rows = 0;
+		TEST_CHECK(sqlite3_client_get_rows("customers/1", test_count_row, &rows) == ESP_OK);
+		TEST_CHECK(rows == 1);
+	}
+#if CONFIG_ESP_BREAKER_ENABLE
+	TEST_CHECK(!http_breaker_allow());
+#endif
+	// Let the server come back and the breaker close
+	vTaskDelay(pdMS_TO_TICKS(recover_ms));
+}
+#endif
+
+#if CONFIG_ESP_REPLICA_ENABLE
+/* A record of a replica file, laid out as sqlite3_replica.c writes it */
+typedef struct __attribute__((packed)) {
+	uint16_t magic;
+	uint8_t kind;
+	uint8_t reserved;
+	int32_t id;
+	uint16_t len;
+} test_replica_record_t;
+
+enum {
+	TEST_REPLICA_TABLE = 1,
+	TEST_REPLICA_ROW,
+	TEST_REPLICA_DELETE,
+	TEST_REPLICA_MARK,
+};
+
+/* Returns the bytes written */
+static size_t test_replica_write(FILE *f, uint8_t kind, int id, const char *text)
+{
+	test_replica_record_t record = {
+		.magic = 0x5052,
+		.kind = kind,
+		.id = id,
+		.len = text ? strlen(text) : 0,
+	};
+	fwrite(&record, sizeof(record), 1, f);
+	if (text) fwrite(text, 1, record.len, f);
+	return sizeof(record) + record.len;
+}
+
+static long test_file_size(int slot)
+{
+	char name[64];
+	struct stat st;
+	snprintf(name, sizeof(name), "%s/%d.rep", CONFIG_ESP_REPLICA_BASE_PATH, slot);
+	return (stat(name, &st) == 0) ? st.st_size : -1;
+}
+
+static esp_err_t test_count_raw(const char *row, size_t row_len, void *ctx)
+{
+	(*(int *)ctx)++;
+	return ESP_OK;
+}
+
+/* Copies the row text into ctx, a buffer of 64 bytes */
+static esp_err_t test_copy_raw(const char *row, size_t row_len, void *ctx)
+{
+	snprintf(ctx, 64, "%.*s", (int)row_len, row);
+	return ESP_OK;
+}
+
+/*
+ * A power loss during a compaction left only the new file, named .tmp, and a reset tore its last record:
+ * loading renames it, drops the torn record and rewrites the file with the live rows.
+ */
+static void test_replica_load(void)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "%s/0.tmp", CONFIG_ESP_REPLICA_BASE_PATH);
+	FILE *f = fopen(name, "wb");
+	TEST_CHECK(f != NULL);
+	if (f == NULL) return;
+	size_t live = test_replica_write(f, TEST_REPLICA_TABLE, 0, "parts");
+	live += test_replica_write(f, TEST_REPLICA_ROW, 1, "{\"id\":1,\"name\":\"bolt\"}");
+	test_replica_write(f, TEST_REPLICA_ROW, 2, "{\"id\":2,\"name\":\"nut\"}");
+	test_replica_write(f, TEST_REPLICA_DELETE, 2, NULL);
+	live += test_replica_write(f, TEST_REPLICA_ROW, 3, "{\"id\":3,\"name\":\"washer\"}");
+	live += test_replica_write(f, TEST_REPLICA_MARK, 3, NULL);
+	test_replica_record_t torn = { .magic = 0x5052, .kind = TEST_REPLICA_ROW, .id = 4, .len = 40 };
+	fwrite(&torn, sizeof(torn), 1, f);
+	fwrite("{\"id\"", 1, 5, f);
+	fclose(f);
+
+	// The first table added takes slot 0
+	TEST_CHECK(sqlite3_replica_add("parts") == ESP_OK);
+	TEST_CHECK(access(name, F_OK) != 0);
+	TEST_CHECK(test_file_size(0) == (long)live);
+	char row[64] = "";
+	TEST_CHECK(sqlite3_replica_read("parts/1", test_copy_raw, row) == ESP_OK);
+	TEST_CHECK(strstr(row, "bolt") != NULL);
+	TEST_CHECK(sqlite3_replica_read("parts/2", test_copy_raw, row) == ESP_ERR_NOT_FOUND);
+	TEST_CHECK(sqlite3_replica_read("parts/3", test_copy_raw, row) == ESP_OK);
+	TEST_CHECK(strstr(row, "washer") != NULL);
+}
+
+/* Rows replaced over and over are compacted away, the last version stays */
+static void test_replica_compact(void)
+{
+	for (int i=0;i<3;i++) {
+		char row[32];
+		int len = snprintf(row, sizeof(row), "{\"name\":\"device-%d\"}", i);
+		TEST_CHECK(sqlite3_client_request(HTTP_METHOD_POST, "devices", row, len) == ESP_OK);
+	}
+	TEST_CHECK(sqlite3_replica_add("devices") == ESP_OK);
+	TEST_CHECK(sqlite3_replica_sync("devices") == ESP_OK);
+	// Without compaction every update appends the whole row again
+	long appended = test_file_size(1);
+	int updates = 150;
+	for (int i=0;i<updates;i++) {
+		char row[32];
+		int len = snprintf(row, sizeof(row), "{\"name\":\"renamed-%03d\"}", i);
+		TEST_CHECK(sqlite3_client_send(HTTP_METHOD_PUT, "devices/1", row, len) == ESP_OK);
+		appended += sizeof(test_replica_record_t) + strlen("{\"id\":1,\"name\":\"renamed-000\"}");
+	}
+	TEST_CHECK(test_file_size(1) < appended / 2);
+	char stored[64] = "";
+	char last[32];
+	snprintf(last, sizeof(last), "renamed-%03d", updates - 1);
+	TEST_CHECK(sqlite3_replica_read("devices/1", test_copy_raw, stored) == ESP_OK);
+	TEST_CHECK(strstr(stored, last) != NULL);
+}
+
+/* A whole-table read right after an insert has the new row */
+static void test_replica_posted(void)
+{
+	int before = 0;
+	TEST_CHECK(sqlite3_replica_read("devices", test_count_raw, &before) == ESP_OK);
+	const char *row = "{\"name\":\"fresh\"}";
+	TEST_CHECK(sqlite3_client_send(HTTP_METHOD_POST, "devices", row, strlen(row)) == ESP_OK);
+	int after = 0;
+	TEST_CHECK(sqlite3_replica_read("devices", test_count_raw, &after) == ESP_OK);
+	TEST_CHECK(after == before + 1);
+}
+#endif
+
+static void test_task(void *pvParameters)
+{
+	test_cursor_retry();
+#if CONFIG_ESP_CACHE_ENABLE
+	test_cache_stale();
+#endif
+	test_wal_offline_writes();
+	test_wal_rejected_insert();
+#if CONFIG_ESP_REPLICA_ENABLE
+	test_replica_load();
+	test_replica_compact();
+	test_replica_posted();
+#endif
+
+	if (s_failures) {
+		ESP_LOGE(TAG, "%d checks failed", s_failures);
+	} else {
+		ESP_LOGW(TAG, "all tests passed");
+	}
+	exit(s_failures);
+}
+
+/* Start from an empty write-ahead queue and replica */
+static void test_clear_dir(const char *path)
+{
+	mkdir(path, 0755);
+	DIR *dir = opendir(path);
+	if (dir == NULL) return;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		char name[300];
+		if (entry->d_name[0] == '.') continue;
+		snprintf(name, sizeof(name), "%s/%s", path, entry->d_name);
+		unlink(name);
+	}
+	closedir(dir);
+}
+
+void app_main()
+{
+	const char *server = getenv("TEST_SERVER");
+	const char *port = getenv("TEST_PORT");
+	test_clear_dir(CONFIG_ESP_WAL_BASE_PATH);
+#if CONFIG_ESP_REPLICA_ENABLE
+	test_clear_dir(CONFIG_ESP_REPLICA_BASE_PATH);
+#endif
+	ESP_ERROR_CHECK(json_arena_init());
+	ESP_ERROR_CHECK(http_pool_init(server ? server : "127.0.0.1", port ? atoi(port) : 8080));
+#if CONFIG_ESP_CACHE_ENABLE
+	ESP_ERROR_CHECK(sqlite3_cache_init());
+#endif
+#if CONFIG_ESP_COALESCE_ENABLE
+	ESP_ERROR_CHECK(sqlite3_flight_init());
+#endif
+	ESP_ERROR_CHECK(sqlite3_wal_init());
+#if CONFIG_ESP_REPLICA_ENABLE
+	ESP_ERROR_CHECK(sqlite3_replica_init());
+#endif
+	xTaskCreate(test_task, "TEST", 1024*16, NULL, 2, NULL);
+}